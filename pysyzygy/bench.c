@@ -0,0 +1,547 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include "transit.h"
+
+// The single precision experiments in benchfloat.c
+int FluxKernelFloat(const double *b, const double *z, int n, double RpRs, double *lambdae, double *lambdad, double *etad);
+double FluxKernelFloatError(double RpRs, double u1, double u2, double bmin);
+void LookupDouble(const double *t, int n, const ARRAYS *arr, double per, const double *f, float *out);
+void LookupFloat(const double *t, int n, const ARRAYS *arr, double per, const float *f, float *out);
+
+/*
+    Benchmarks for the C core. Build with `make bench` and run `./bench`.
+
+    Each case is a stage of the light curve pipeline (Compute, Bin and
+    Interpolate) in one regime, or one of the low-level kernels (the Kepler
+    solvers, the elliptic integrals and the flux kernel) on a fixed batch of
+    inputs. We report the best time per point over a few rounds, the
+    corresponding throughput, and the number of mallocs per call, both on
+    the first call (which sizes the workspace) and afterwards (which should
+    be zero). The output is tab-separated, one case per line; save it and
+    pass it back with `-b` to compare against it:
+
+        ./bench > base.tsv
+        ... change something and rebuild ...
+        ./bench -b base.tsv
+
+    With `-a`, we first print (as comments) the largest errors in the flux
+    that the lookup tables introduce, for the quadratic law and for the
+    nonlinear law, whose light curves are timed as the `nonlinear` regime,
+    and that computing the flux in single precision would introduce (see
+    benchfloat.c, whose experiments are timed as `flux/analytic-float` and
+    as the `lookup-double` and `lookup-float` cases of a few regimes).
+
+    Usage: bench [-a] [-t seconds per case] [-b baseline file] [case prefix]
+*/
+
+#define BENCH_ROUNDS    5                                                             // We keep the fastest of this many rounds
+#define BENCH_MINTIME   0.25                                                          // Default seconds spent on each case
+#define BENCH_MICRO     4096                                                          // Inputs to each of the low-level kernels
+#define BENCH_LCPTS     65536                                                         // Points in the light curves we interpolate onto
+#define BENCH_MAXBASE   256                                                           // Most cases we read from a baseline file
+#define BENCH_NAME      48
+
+#ifdef BENCH_WRAP
+static long allocs = 0;                                                               // Calls to malloc, if we're able to count them
+
+void *__real_malloc(size_t size);
+void *__wrap_malloc(size_t size) {
+  /*
+      Counts calls to malloc. The Makefile links the benchmarks with
+      `--wrap=malloc`, which routes the core's calls here.
+  */
+  allocs++;
+  return __real_malloc(size);
+}
+#endif
+
+typedef struct {
+  const char *name;
+  TRANSIT transit;
+  LIMBDARK limbdark;
+  SETTINGS settings;
+  ARRAYS arr;
+  double *t;
+  double *out;
+  int ipts;
+  int lookup;                                                                         // Also time the lookups in a double and a float grid?
+  float *grid;
+  float *fout;
+} REGIME;
+
+typedef struct {
+  double *M;
+  double *E;
+  double *k;
+  double *b;
+  double *z;
+  double *le;
+  double *ld;
+  double *ed;
+  KEPLER kep;
+} MICRO;
+
+typedef struct {
+  char name[BENCH_NAME];
+  double ns;
+} BASELINE;
+
+typedef double (*BENCHFN)(void *data, int *err);                                      // Runs one call and returns the number of points it handled
+
+static double Now(void) {
+  /*
+      Wall clock time in seconds.
+  */
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1.e-9 * ts.tv_nsec;
+}
+
+static double StageCompute(void *data, int *err) {
+  REGIME *r = (REGIME *)data;
+
+  *err = ComputeR(&r->transit, &r->limbdark, &r->settings, &r->arr);
+  return r->arr.nend - r->arr.nstart;
+}
+
+static double StageBin(void *data, int *err) {
+  REGIME *r = (REGIME *)data;
+
+  *err = BinR(&r->transit, &r->limbdark, &r->settings, &r->arr);
+  return r->arr.nend - r->arr.nstart;
+}
+
+static double StageInterpolate(void *data, int *err) {
+  REGIME *r = (REGIME *)data;
+
+  *err = InterpolateR(r->t, r->ipts, ARR_BFLX, &r->transit, &r->limbdark, &r->settings, &r->arr, r->out);
+  return r->ipts;
+}
+
+static double MicroNewton(void *data, int *err) {
+  MICRO *m = (MICRO *)data;
+  int i;
+
+  for (i = 0; i < BENCH_MICRO; i++) m->E[i] = EccentricAnomaly(m->M[i], m->kep.ecc, 1.e-15, 100);
+  *err = isnan(m->E[BENCH_MICRO - 1]) ? ERR_KEPLER : ERR_NONE;
+  return BENCH_MICRO;
+}
+
+static double MicroFast(void *data, int *err) {
+  MICRO *m = (MICRO *)data;
+  int i;
+
+  for (i = 0; i < BENCH_MICRO; i++) m->E[i] = EccentricAnomalyFast(m->M[i], m->kep.ecc, 1.e-15, 100);
+  *err = isnan(m->E[BENCH_MICRO - 1]) ? ERR_KEPLER : ERR_NONE;
+  return BENCH_MICRO;
+}
+
+static double MicroBatch(void *data, int *err) {
+  MICRO *m = (MICRO *)data;
+  KEPSTATS stats = {0};
+
+  *err = EccentricAnomalyBatch(m->M, BENCH_MICRO, &m->kep, 1.e-15, 100, m->E, &stats);
+  return BENCH_MICRO;
+}
+
+static double MicroEllk(void *data, int *err) {
+  MICRO *m = (MICRO *)data;
+  int i;
+
+  for (i = 0; i < BENCH_MICRO; i++) m->E[i] = ellk(m->k[i]);
+  *err = ERR_NONE;
+  return BENCH_MICRO;
+}
+
+static double MicroEllec(void *data, int *err) {
+  MICRO *m = (MICRO *)data;
+  int i;
+
+  for (i = 0; i < BENCH_MICRO; i++) m->E[i] = ellec(m->k[i]);
+  *err = ERR_NONE;
+  return BENCH_MICRO;
+}
+
+static double MicroRj(void *data, int *err) {
+  MICRO *m = (MICRO *)data;
+  int i;
+
+  *err = ERR_NONE;
+  for (i = 0; (i < BENCH_MICRO) && (*err == ERR_NONE); i++)
+    m->E[i] = rj(m->k[i], 1. - m->k[i], 1., 1. + m->M[i], err);
+  return BENCH_MICRO;
+}
+
+static double StageLookupDouble(void *data, int *err) {
+  REGIME *r = (REGIME *)data;
+
+  LookupDouble(r->t, r->ipts, &r->arr, r->transit.per, r->arr.bflx, r->fout);
+  *err = ERR_NONE;
+  return r->ipts;
+}
+
+static double StageLookupFloat(void *data, int *err) {
+  REGIME *r = (REGIME *)data;
+
+  LookupFloat(r->t, r->ipts, &r->arr, r->transit.per, r->grid, r->fout);
+  *err = ERR_NONE;
+  return r->ipts;
+}
+
+static double MicroFlux(void *data, int *err) {
+  MICRO *m = (MICRO *)data;
+
+  *err = FluxKernel(m->b, m->z, BENCH_MICRO, 0.1, m->le, m->ld, m->ed);
+  return BENCH_MICRO;
+}
+
+static double MicroFluxFloat(void *data, int *err) {
+  MICRO *m = (MICRO *)data;
+
+  *err = FluxKernelFloat(m->b, m->z, BENCH_MICRO, 0.1, m->le, m->ld, m->ed);
+  return BENCH_MICRO;
+}
+
+static double MicroTable(void *data, int *err) {
+  MICRO *m = (MICRO *)data;
+
+  *err = FluxTableKernel(m->b, m->z, BENCH_MICRO, 0.1, m->le, m->ld, m->ed);
+  return BENCH_MICRO;
+}
+
+static double MicroNonlinear(void *data, int *err) {
+  MICRO *m = (MICRO *)data;
+
+  *err = NonlinearKernel(m->b, m->z, BENCH_MICRO, 0.1, m->le, m->ld);
+  return BENCH_MICRO;
+}
+
+static int Run(const char *name, BENCHFN fn, void *data, double mintime, const BASELINE *base, int nbase) {
+  /*
+      Times `fn` and prints a line with the results. The first call is
+      timed separately, since that's where the workspace gets allocated;
+      then we calibrate the number of calls per round so that all the
+      rounds take about `mintime`, and keep the fastest round.
+  */
+  double t, best = INFINITY, pts, first;
+#ifdef BENCH_WRAP
+  long a0, afirst, acall;
+#endif
+  int i, j, reps = 1, err = ERR_NONE;
+
+#ifdef BENCH_WRAP
+  a0 = allocs;
+#endif
+  t = Now();
+  pts = fn(data, &err);
+  first = Now() - t;
+#ifdef BENCH_WRAP
+  afirst = allocs - a0;
+#endif
+  if (err != ERR_NONE) {
+    fprintf(stderr, "%s: error %d\n", name, err);
+    return err;
+  }
+
+  while (reps < (1 << 24)) {                                                          // Calibrate
+    t = Now();
+    for (i = 0; i < reps; i++) fn(data, &err);
+    if (Now() - t > mintime / (4 * BENCH_ROUNDS)) break;
+    reps *= 2;
+  }
+  reps = (int)ceil(reps * (mintime / BENCH_ROUNDS) / DMAX(Now() - t, 1.e-9));
+  reps = IMAX(reps, 1);
+
+#ifdef BENCH_WRAP
+  a0 = allocs;
+#endif
+  for (j = 0; j < BENCH_ROUNDS; j++) {
+    t = Now();
+    for (i = 0; i < reps; i++) fn(data, &err);
+    best = DMIN(best, (Now() - t) / reps);
+  }
+#ifdef BENCH_WRAP
+  acall = allocs - a0;
+#endif
+
+#ifdef BENCH_WRAP
+  printf("%s\t%.0f\t%.3f\t%.4g\t%.3f\t%ld\t%.3g", name, pts, 1.e9 * best / pts, pts / best,
+         1.e9 * first / pts, afirst, (double)acall / (BENCH_ROUNDS * reps));
+#else
+  printf("%s\t%.0f\t%.3f\t%.4g\t%.3f\t-1\t-1", name, pts, 1.e9 * best / pts, pts / best,
+         1.e9 * first / pts);
+#endif
+  if (base) {
+    for (i = 0; i < nbase; i++)
+      if (!strcmp(base[i].name, name)) break;
+    if (i < nbase) printf("\t%.3f\t%.3f", base[i].ns, 1.e9 * best / pts / base[i].ns);
+    else printf("\t-\t-");
+  }
+  printf("\n");
+  fflush(stdout);
+  return ERR_NONE;
+}
+
+static int Lookups(REGIME *r, const char *prefix, double mintime, const BASELINE *base, int nbase) {
+  /*
+      Times the stripped-down lookups of `benchfloat.c` in the binned flux
+      of the regime `r`, stored as double and as float
+  */
+  char name[BENCH_NAME];
+  int i, iErr = ERR_NONE;
+
+  snprintf(name, sizeof(name), "%s/lookup", r->name);
+  if (strncmp(name, prefix, IMIN(strlen(name), strlen(prefix)))) return ERR_NONE;
+  if (!r->arr.binned) {
+    if (!r->arr.computed) StageCompute(r, &iErr);
+    if (iErr == ERR_NONE) StageBin(r, &iErr);
+    if (iErr != ERR_NONE) return iErr;
+  }
+  r->grid = malloc(r->arr.nend * sizeof(float));
+  r->fout = malloc(r->ipts * sizeof(float));
+  if (!(r->grid && r->fout)) {
+    free(r->grid);
+    free(r->fout);
+    return ERR_ALLOC;
+  }
+  for (i = r->arr.nstart; i < r->arr.nend; i++) r->grid[i] = (float)r->arr.bflx[i];
+  snprintf(name, sizeof(name), "%s/lookup-double", r->name);
+  if (!strncmp(name, prefix, strlen(prefix)))
+    iErr |= Run(name, StageLookupDouble, r, mintime, base, nbase);
+  snprintf(name, sizeof(name), "%s/lookup-float", r->name);
+  if (!strncmp(name, prefix, strlen(prefix)))
+    iErr |= Run(name, StageLookupFloat, r, mintime, base, nbase);
+  free(r->grid);
+  free(r->fout);
+  return iErr;
+}
+
+static void Defaults(REGIME *r, const char *name) {
+  /*
+      A Kepler long cadence light curve of a hot Jupiter on a circular
+      orbit, which the regimes below tweak.
+  */
+  memset(r, 0, sizeof(REGIME));
+  r->name = name;
+  r->transit.per = 5.;
+  r->transit.RpRs = 0.1;
+  r->transit.bcirc = 0.3;
+  r->transit.aRs = 12.;
+  r->transit.rhos = NAN;
+  r->transit.MpMs = 0.;
+  r->transit.ecc = 0.;
+  r->transit.w = 0.;
+  r->transit.esw = NAN;
+  r->transit.ecw = NAN;
+  r->transit.t0 = 0.;
+  r->limbdark.ldmodel = QUADRATIC;
+  r->limbdark.u1 = 0.40;
+  r->limbdark.u2 = 0.26;
+  r->settings.exptime = KEPLONGEXP;
+  r->settings.keptol = 1.e-15;
+  r->settings.maxpts = 10000;
+  r->settings.exppts = 50;
+  r->settings.binmethod = RIEMANN;
+  r->settings.intmethod = SMARTINT;
+  r->settings.maxkepiter = 100;
+  r->settings.kepsolver = NEWTON;
+  r->settings.outputs = OUT_FLUX | OUT_BFLX;
+  r->settings.gridmethod = UNIFORM;
+  r->settings.fluxtol = 1.e-6;
+  r->settings.evalmethod = GRID;
+  r->settings.fluxmethod = ANALYTIC;
+  r->settings.orbtol = 1.e-6;
+}
+
+static int Regimes(REGIME *reg) {
+  /*
+      The light curve regimes we benchmark. Returns how many there are.
+  */
+  static double tN[20], dur[20];
+  int i, n = 0;
+
+  Defaults(&reg[n], "circular");
+  reg[n++].lookup = 1;
+
+  Defaults(&reg[n], "eccentric");
+  reg[n].transit.esw = 0.3;
+  reg[n++].transit.ecw = 0.2;
+
+  Defaults(&reg[n], "grazing");
+  reg[n++].transit.bcirc = 1.05;
+
+  Defaults(&reg[n], "small");
+  reg[n++].transit.RpRs = 0.01;
+
+  Defaults(&reg[n], "large");
+  reg[n++].transit.RpRs = 0.3;
+
+  Defaults(&reg[n], "short");
+  reg[n].settings.exptime = KEPSHRTEXP;
+  reg[n].settings.maxpts = 100000;
+  reg[n].settings.exppts = 10;
+  reg[n++].lookup = 1;
+
+  Defaults(&reg[n], "adaptive");
+  reg[n++].settings.gridmethod = ADAPTIVE;
+
+  Defaults(&reg[n], "fullorbit");
+  reg[n].settings.fullorbit = 1;
+  reg[n].settings.maxpts = 100000;
+  reg[n].settings.exppts = 10;
+  reg[n++].lookup = 1;
+
+  Defaults(&reg[n], "fullorbit-adaptive");                                           // The same orbit, coarse out of transit
+  reg[n].settings.fullorbit = 1;
+  reg[n++].settings.gridmethod = ADAPTIVE;
+
+  Defaults(&reg[n], "nonlinear");                                                    // Claret (2011), for the Sun in the Kepler band
+  reg[n].limbdark.ldmodel = NONLINEAR;
+  reg[n].limbdark.c1 = 0.53;
+  reg[n].limbdark.c2 = -0.25;
+  reg[n].limbdark.c3 = 0.84;
+  reg[n++].limbdark.c4 = -0.37;
+
+  Defaults(&reg[n], "ttv");
+  for (i = 0; i < 20; i++) {
+    tN[i] = 5. * i + 0.01 * sin(1.3 * i);
+    dur[i] = 1. + 0.05 * cos(0.7 * i);
+  }
+  reg[n].transit.t0 = NAN;
+  reg[n].transit.ntrans = 20;
+  reg[n].transit.tN = tN;
+  reg[n++].transit.dur = dur;
+
+  return n;
+}
+
+static int ReadBaseline(const char *path, BASELINE *base) {
+  /*
+      Reads the case names and times per point from the output of an
+      earlier run. Returns the number of cases, or -1 on error.
+  */
+  FILE *fp;
+  char line[1024];
+  int n = 0;
+
+  fp = fopen(path, "r");
+  if (fp == NULL) return -1;
+  while ((n < BENCH_MAXBASE) && fgets(line, sizeof(line), fp)) {
+    if (line[0] == '#') continue;
+    if (sscanf(line, "%47s %*f %lf", base[n].name, &base[n].ns) == 2) n++;
+  }
+  fclose(fp);
+  return n;
+}
+
+int main(int argc, char **argv) {
+  /*
+      Runs every case whose name starts with the optional prefix.
+  */
+  static REGIME reg[16];
+  static BASELINE base[BENCH_MAXBASE];
+  static const char *stages[] = {"compute", "bin", "interpolate"};
+  static const BENCHFN stagefn[] = {StageCompute, StageBin, StageInterpolate};
+  struct {
+    const char *name;
+    BENCHFN fn;
+    double ecc;
+  } micro[] = {{"kepler/newton", MicroNewton, 0.3},
+               {"kepler/newton-e0.9", MicroNewton, 0.9},
+               {"kepler/fast", MicroFast, 0.3},
+               {"kepler/fast-e0.9", MicroFast, 0.9},
+               {"kepler/batch", MicroBatch, 0.3},
+               {"kepler/batch-e0.9", MicroBatch, 0.9},
+               {"ellip/ellk", MicroEllk, 0.},
+               {"ellip/ellec", MicroEllec, 0.},
+               {"ellip/rj", MicroRj, 0.},
+               {"flux/analytic", MicroFlux, 0.},
+               {"flux/analytic-float", MicroFluxFloat, 0.},
+               {"flux/table", MicroTable, 0.},
+               {"flux/nonlinear", MicroNonlinear, 0.}};
+  MICRO m;
+  char name[BENCH_NAME];
+  const char *prefix = "";
+  double mintime = BENCH_MINTIME;
+  int nbase = 0, usebase = 0, accuracy = 0;
+  int i, k, nreg, iErr = ERR_NONE;
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-t") && (i + 1 < argc)) mintime = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-a")) accuracy = 1;
+    else if (!strcmp(argv[i], "-b") && (i + 1 < argc)) {
+      nbase = ReadBaseline(argv[++i], base);
+      if (nbase < 0) {
+        fprintf(stderr, "Unable to read baseline `%s`.\n", argv[i]);
+        return 1;
+      }
+      usebase = 1;
+    } else if (argv[i][0] == '-') {
+      fprintf(stderr, "Usage: %s [-a] [-t seconds per case] [-b baseline file] [case prefix]\n", argv[0]);
+      return 1;
+    } else prefix = argv[i];
+  }
+
+  if (accuracy) {                                                                     // The coefficients of the `circular` and `nonlinear` regimes
+    printf("# accuracy/quadratic-table\t%.3g\n", FluxTableError(0.40, 0.26));
+    printf("# accuracy/nonlinear-table\t%.3g\n", NonlinearTableError(0.53, -0.25, 0.84, -0.37));
+    printf("# accuracy/analytic-float\t%.3g\t(RpRs = 0.1)\n", FluxKernelFloatError(0.1, 0.40, 0.26, 0.));
+    printf("# accuracy/analytic-float\t%.3g\t(RpRs = 0.1, |b - RpRs| > 0.001)\n", FluxKernelFloatError(0.1, 0.40, 0.26, 1.e-3));
+    printf("# accuracy/analytic-float\t%.3g\t(RpRs = 0.01, |b - RpRs| > 0.001)\n", FluxKernelFloatError(0.01, 0.40, 0.26, 1.e-3));
+  }
+  printf("# case\tpoints\tns/point\tpoints/s\tns/point (first call)\tallocs (first call)\tallocs/call");
+  if (usebase) printf("\tns/point (baseline)\tratio");
+  printf("\n");
+
+  m.M = malloc(BENCH_MICRO * sizeof(double));                                         // Inputs to the low-level kernels
+  m.E = malloc(BENCH_MICRO * sizeof(double));
+  m.k = malloc(BENCH_MICRO * sizeof(double));
+  m.b = malloc(BENCH_MICRO * sizeof(double));
+  m.z = malloc(BENCH_MICRO * sizeof(double));
+  m.le = malloc(BENCH_MICRO * sizeof(double));
+  m.ld = malloc(BENCH_MICRO * sizeof(double));
+  m.ed = malloc(BENCH_MICRO * sizeof(double));
+  if (!(m.M && m.E && m.k && m.b && m.z && m.le && m.ld && m.ed)) return ERR_ALLOC;
+  for (i = 0; i < BENCH_MICRO; i++) {
+    m.M[i] = 2. * PI * (i + 0.5) / BENCH_MICRO;
+    m.k[i] = (i + 0.5) / BENCH_MICRO;
+    m.b[i] = 1.15 * (i + 0.5) / BENCH_MICRO;                                          // Covers every piece of the flux kernel...
+    m.z[i] = -1.;                                                                     // ...since the planet's in front of the star
+  }
+  for (k = 0; k < (int)(sizeof(micro) / sizeof(micro[0])); k++) {
+    if (strncmp(micro[k].name, prefix, strlen(prefix))) continue;
+    KeplerStarter(micro[k].ecc, &m.kep);
+    iErr |= Run(micro[k].name, micro[k].fn, &m, mintime, usebase ? base : NULL, nbase);
+  }
+
+  nreg = Regimes(reg);
+  for (i = 0; i < nreg; i++) {
+    reg[i].ipts = BENCH_LCPTS;                                                        // Four years of long cadence data
+    reg[i].t = malloc(BENCH_LCPTS * sizeof(double));
+    reg[i].out = malloc(BENCH_LCPTS * sizeof(double));
+    if (!(reg[i].t && reg[i].out)) return ERR_ALLOC;
+    for (k = 0; k < BENCH_LCPTS; k++) reg[i].t[k] = -1. + k * KEPLONGCAD;
+    for (k = 0; k < 3; k++) {
+      snprintf(name, sizeof(name), "%s/%s", reg[i].name, stages[k]);
+      if (strncmp(name, prefix, strlen(prefix))) continue;
+      if ((k > 0) && !reg[i].arr.computed)
+        StageCompute(&reg[i], &iErr);                                                 // Later stages need the earlier ones
+      if ((k > 1) && !reg[i].arr.binned)
+        StageBin(&reg[i], &iErr);
+      iErr |= Run(name, stagefn[k], &reg[i], mintime, usebase ? base : NULL, nbase);
+    }
+    if (reg[i].lookup) 
+      iErr |= Lookups(&reg[i], prefix, mintime, usebase ? base : NULL, nbase);
+    FreeArrays(&reg[i].arr);
+    free(reg[i].t);
+    free(reg[i].out);
+  }
+
+  free(m.M); free(m.E); free(m.k); free(m.b); free(m.z);
+  free(m.le); free(m.ld); free(m.ed);
+  return iErr ? 1 : 0;
+}
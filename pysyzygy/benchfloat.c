@@ -0,0 +1,312 @@
+#include <stdlib.h>
+#include <math.h>
+#include "transit.h"
+
+/*
+    Single precision experiments for the benchmarks. None of this is part
+    of the library: it's here so that `make bench` can show what computing
+    the model in float instead of double would buy, and what it would cost
+    in accuracy. The answer, so far, is that it doesn't pay off:
+
+    - `FluxKernelFloat()` is a float port of the vectorized flux kernel,
+      with twice the lanes. It's about twice as fast as `FluxKernel()`,
+      which is most of the cost of computing the grid. But the occultation
+      functions are small differences of terms of order unity, so it loses
+      four or five digits: the flux is off by ~3e-6 for RpRs = 0.1, by
+      ~2e-5 (a fifth of the depth) for RpRs = 0.01, and by 1e-4 to 1e-3
+      near b = RpRs, where the elliptic integral of the third kind blows
+      up. The double kernel is good to ~1e-8 everywhere, and the lookup 
+      table, which is faster still, to ~1e-6.
+    - Storing the grid in float halves its size, but even the full orbit
+      grids fit in the cache, so looking the flux up in them costs the
+      same either way.
+
+    See the `flux/analytic-float` case, the `lookup-double` and
+    `lookup-float` cases of the regimes, and `./bench -a` for the accuracy.
+*/
+
+#define FLOAT_LANES (2 * FLUX_LANES)                                                  // Twice as many floats fit in a vector
+#define FLOAT_PI 3.14159265f
+#define FLOAT_ELLPIC_TOL 3.e-4f                                                       // Squared, that's the precision of a float
+#define FLOAT_TINY 1.e-6f
+
+static inline float LogF(float x) {
+  /*
+      Same as `LogV()`, in single precision
+  */
+  union {float f; int i;} u;
+  float m, s, s2, e, big;
+  u.f = x;
+  e = (float)((u.i >> 23) & 0xff) - 127.f;
+  u.i = (u.i & 0x007fffff) | 0x3f800000;                                              // The mantissa, in [1, 2)
+  m = u.f;
+  big = (m > 1.41421356f) ? 1.f : 0.f;                                                // Move it to [sqrt(1/2), sqrt(2))
+  m = m * (1.f - 0.5f * big);
+  e = e + big;
+  s = (m - 1.f) / (m + 1.f);
+  s2 = s * s;
+  return e * 0.69314718f + 2.f * s * (1.f + s2 * (1.f/3.f + s2 * (1.f/5.f +
+         s2 * (1.f/7.f + s2 * (1.f/9.f)))));
+}
+
+static void EllBlockFloat(const float *k, float *Kk, float *Ek) {
+  /*
+      Same as `EllBlock()`, in single precision
+  */
+  int l;
+  LANES
+  for (l = 0; l < FLOAT_LANES; l++) {
+    float m1 = 1.f - k[l] * k[l];
+    float lm = LogF(m1);
+    Kk[l] = 1.38629436f + m1 * (0.09666344f + m1 * (0.03590092f +
+            m1 * (0.03742564f + m1 * 0.01451196f))) - (0.5f + m1 *
+            (0.12498594f + m1 * (0.06880249f + m1 * (0.03328355f +
+            m1 * 0.00441787f)))) * lm;
+    Ek[l] = 1.f + m1 * (0.44325141f + m1 * (0.06260601f + m1 *
+            (0.04757384f + m1 * 0.01736506f))) - m1 * (0.24998368f +
+            m1 * (0.09200180f + m1 * (0.04069698f + m1 * 0.00526450f))) * lm;
+  }
+}
+
+static void PiBlockFloat(const float *n, const float *k, float *res, int *bad) {
+  /*
+      Same as `PiBlock()`, in single precision
+  */
+  float kc[FLOAT_LANES], p[FLOAT_LANES], m0[FLOAT_LANES], c[FLOAT_LANES];
+  float d[FLOAT_LANES], e[FLOAT_LANES];
+  int go[FLOAT_LANES];
+  int i, l, more;
+
+  LANES
+  for (l = 0; l < FLOAT_LANES; l++) {
+    bad[l] = (1.f - k[l] * k[l] < FLOAT_TINY) | (1.f + n[l] < FLOAT_TINY);
+    go[l] = !bad[l];
+    kc[l] = bad[l] ? 1.f : sqrtf(1.f - k[l] * k[l]);
+    p[l] = bad[l] ? 1.f : sqrtf(1.f + n[l]);
+    m0[l] = 1.f;
+    c[l] = 1.f;
+    d[l] = 1.f / p[l];
+    e[l] = kc[l];
+  }
+  for (i = 0; i < ELLPIC_MAXIT; i++) {
+    more = 0;
+    LANES_ANY
+    for (l = 0; l < FLOAT_LANES; l++) {
+      float f = c[l];
+      float g = e[l] / p[l];
+      float cn = d[l] / p[l] + f;
+      float dn = 2.f * (f * g + d[l]);
+      float pn = g + p[l];
+      float mn = kc[l] + m0[l];
+      int again = go[l] & (fabsf(1.f - kc[l] / m0[l]) > FLOAT_ELLPIC_TOL);
+      float kn = 2.f * sqrtf(e[l]);
+      c[l] = go[l] ? cn : c[l];
+      d[l] = go[l] ? dn : d[l];
+      p[l] = go[l] ? pn : p[l];
+      m0[l] = go[l] ? mn : m0[l];
+      kc[l] = again ? kn : kc[l];
+      e[l] = again ? kn * mn : e[l];
+      go[l] = again;
+      more |= again;
+    }
+    if (!more) break;
+  }
+  LANES
+  for (l = 0; l < FLOAT_LANES; l++) {
+    bad[l] |= go[l];                                                                  // Didn't converge
+    res[l] = 0.5f * FLOAT_PI * (c[l] * m0[l] + d[l]) / (m0[l] * (m0[l] + p[l]));
+  }
+}
+
+static void InsideBlockFloat(const float *b, float RpRs, float *lambdae, float *lambdad, float *etad, int *bad) {
+  /*
+      Same as `InsideBlock()`, in single precision
+  */
+  float x1[FLOAT_LANES], x3[FLOAT_LANES], n[FLOAT_LANES], q[FLOAT_LANES];
+  float Kk[FLOAT_LANES], Ek[FLOAT_LANES], Pk[FLOAT_LANES];
+  float p2 = RpRs * RpRs;
+  int l;
+  LANES
+  for (l = 0; l < FLOAT_LANES; l++) {
+    float x2 = (RpRs + b[l]) * (RpRs + b[l]);
+    x1[l] = (RpRs - b[l]) * (RpRs - b[l]);
+    x3[l] = p2 - b[l] * b[l];
+    n[l] = x2 / x1[l] - 1.f;
+    q[l] = sqrtf((x2 - x1[l]) / (1.f - x1[l]));
+  }
+  EllBlockFloat(q, Kk, Ek);
+  PiBlockFloat(n, q, Pk, bad);
+  LANES
+  for (l = 0; l < FLOAT_LANES; l++) {
+    lambdae[l] = p2;
+    lambdad[l] = 2.f / 9.f / FLOAT_PI / sqrtf(1.f - x1[l]) * ((1.f - 5.f * b[l] * b[l] + p2 +
+                 x3[l] * x3[l]) * Kk[l] + (1.f - x1[l]) * (b[l] * b[l] + 7.f * p2 - 4.f) *
+                 Ek[l] - 3.f * x3[l] / x1[l] * Pk[l]);
+    lambdad[l] += (b[l] < RpRs) ? 2.f/3.f : 0.f;
+    etad[l] = p2 / 2.f * (p2 + 2.f * b[l] * b[l]);
+  }
+}
+
+static void LimbBlockFloat(const float *b, float RpRs, float *lambdae, float *lambdad, float *etad, int *bad) {
+  /*
+      Same as `LimbBlock()`, in single precision
+  */
+  float x1[FLOAT_LANES], x2[FLOAT_LANES], x3[FLOAT_LANES], n[FLOAT_LANES], q[FLOAT_LANES];
+  float Kk[FLOAT_LANES], Ek[FLOAT_LANES], Pk[FLOAT_LANES];
+  float kap0[FLOAT_LANES], kap1[FLOAT_LANES];
+  float p2 = RpRs * RpRs;
+  int l;
+  for (l = 0; l < FLOAT_LANES; l++) {
+    kap1[l] = acosf(fminf((1.f - p2 + b[l] * b[l]) / 2.f / b[l], 1.f));
+    kap0[l] = acosf(fminf((p2 + b[l] * b[l] - 1.f) / 2.f / RpRs / b[l], 1.f));
+  }
+  LANES
+  for (l = 0; l < FLOAT_LANES; l++) {
+    x1[l] = (RpRs - b[l]) * (RpRs - b[l]);
+    x2[l] = (RpRs + b[l]) * (RpRs + b[l]);
+    x3[l] = p2 - b[l] * b[l];
+    lambdae[l] = (p2 * kap0[l] + kap1[l] - 0.5f * sqrtf(fmaxf(4.f * b[l] * b[l] -
+                 (1.f - x3[l]) * (1.f - x3[l]), 0.f))) / FLOAT_PI;
+    n[l] = 1.f / x1[l] - 1.f;
+    q[l] = sqrtf((1.f - x1[l]) / 4.f / b[l] / RpRs);
+  }
+  EllBlockFloat(q, Kk, Ek);
+  PiBlockFloat(n, q, Pk, bad);
+  LANES
+  for (l = 0; l < FLOAT_LANES; l++) {
+    lambdad[l] = 1.f / 9.f / FLOAT_PI / sqrtf(RpRs * b[l]) * (((1.f - x2[l]) * (2.f * x2[l] +
+                 x1[l] - 3.f) - 3.f * x3[l] * (x2[l] - 2.f)) * Kk[l] + 4.f * RpRs * b[l] *
+                 (b[l] * b[l] + 7.f * p2 - 4.f) * Ek[l] - 3.f * x3[l] / x1[l] * Pk[l]);
+    lambdad[l] += (b[l] < RpRs) ? 2.f/3.f : 0.f;
+    etad[l] = 1.f / 2.f / FLOAT_PI * (kap1[l] + p2 * (p2 + 2.f * b[l] * b[l]) * kap0[l] -
+              (1.f + 5.f * p2 + b[l] * b[l]) / 4.f * sqrtf((1.f - x1[l]) * (x2[l] - 1.f)));
+  }
+}
+
+int FluxKernelFloat(const double *b, const double *z, int n, double RpRs, double *lambdae, double *lambdad, double *etad) {
+  /*
+      Same as `FluxKernel()`, but the inside and limb blocks are computed
+      in single precision, FLOAT_LANES at a time. The points are still
+      classified, and the special cases still computed, in double.
+  */
+  int idx[2][FLUX_CHUNK], cnt[2];
+  float bb[FLOAT_LANES], le[FLOAT_LANES], ld[FLOAT_LANES], ed[FLOAT_LANES];
+  int bad[FLOAT_LANES];
+  double x1, x2;
+  int c, i, k, l, m, j;
+  int iErr = ERR_NONE;
+  void (*block[2])(const float *, float, float *, float *, float *, int *) = {InsideBlockFloat, LimbBlockFloat};
+
+  for (c = 0; c < n; c += FLUX_CHUNK) {
+    m = (n - c < FLUX_CHUNK) ? n - c : FLUX_CHUNK;
+    cnt[0] = 0;
+    cnt[1] = 0;
+    for (i = c; i < c + m; i++) {                                                     // Same as `FluxKernel()`
+      x1 = SQR(RpRs - b[i]);
+      x2 = SQR(RpRs + b[i]);
+      if (((z != NULL) && (z[i] > 0)) || (b[i] > 1. + RpRs)) {
+        lambdae[i] = 0.;
+        lambdad[i] = 0.;
+        etad[i] = 0.;
+      } else if ((RpRs < 1.) && (((b[i] > 0.5 + fabs(RpRs - 0.5)) && (b[i] < 1. + RpRs)) ||
+                 ((RpRs > 0.5) && (b[i] > fabs(1. - RpRs) * 1.0001) && (b[i] < RpRs))) &&
+                 (1. / x1 <= RJ_BIG)) {
+        idx[1][cnt[1]++] = i;
+      } else if ((b[i] <= 1. - RpRs) && (x2 / x1 <= RJ_BIG)) {
+        idx[0][cnt[0]++] = i;
+      } else {
+        iErr = FluxPoint(b[i], RpRs, &lambdae[i], &lambdad[i], &etad[i]);
+        if (iErr != ERR_NONE) return iErr;
+      }
+    }
+    for (k = 0; k < 2; k++) {
+      for (j = 0; j < cnt[k]; j += FLOAT_LANES) {
+        for (l = 0; l < FLOAT_LANES; l++)
+          bb[l] = (float)b[idx[k][(j + l < cnt[k]) ? j + l : j]];
+        block[k](bb, (float)RpRs, le, ld, ed, bad);
+        for (l = 0; (l < FLOAT_LANES) && (j + l < cnt[k]); l++) {
+          i = idx[k][j + l];
+          if (bad[l]) {
+            iErr = FluxPoint(b[i], RpRs, &lambdae[i], &lambdad[i], &etad[i]);
+            if (iErr != ERR_NONE) return iErr;
+          } else {
+            lambdae[i] = le[l];
+            lambdad[i] = ld[l];
+            etad[i] = ed[l];
+          }
+        }
+      }
+    }
+  }
+  return iErr;
+}
+
+double FluxKernelFloatError(double RpRs, double u1, double u2, double bmin) {
+  /*
+      The largest difference in the flux between `FluxKernelFloat()` and
+      `FluxKernel()` for quadratic limb darkening, over impact parameters
+      that are at least `bmin` away from `RpRs` (zero for all of them)
+  */
+  int i, n = 100000;
+  double *b, *le, *ld, *ed, *lef, *ldf, *edf;
+  double omega = 1. - u1/3. - u2/6., err = 0., f, ff;
+
+  b = malloc(7 * n * sizeof(double));
+  if (b == NULL) return NAN;
+  le = b + n; ld = le + n; ed = ld + n; lef = ed + n; ldf = lef + n; edf = ldf + n;
+  for (i = 0; i < n; i++) b[i] = (1. + RpRs) * (i + 0.5) / n;
+  if ((FluxKernel(b, NULL, n, RpRs, le, ld, ed) != ERR_NONE) ||
+      (FluxKernelFloat(b, NULL, n, RpRs, lef, ldf, edf) != ERR_NONE)) {
+    free(b);
+    return NAN;
+  }
+  for (i = 0; i < n; i++) {
+    if (fabs(b[i] - RpRs) < bmin) continue;
+    f = ((1. - u1 - 2. * u2) * le[i] + (u1 + 2. * u2) * ld[i] + u2 * ed[i]) / omega;
+    ff = ((1. - u1 - 2. * u2) * lef[i] + (u1 + 2. * u2) * ldf[i] + u2 * edf[i]) / omega;
+    err = DMAX(err, fabs(f - ff));
+  }
+  free(b);
+  return err;
+}
+
+void LookupDouble(const double *t, int n, const ARRAYS *arr, double per, const double *f, float *out) {
+  /*
+      A stripped-down interpolation of the uniform grid `f` (one transit
+      at t = 0 with period `per`) at the `n` times `t`, into a float
+      output. `LookupFloat()` is the same, for a float grid, so the two
+      only differ in how the grid is stored.
+  */
+  double ti, x;
+  int i, j, ng = arr->nend - arr->nstart;
+
+  for (i = 0; i < n; i++) {
+    ti = t[i] - per * floor(t[i] / per + 0.5);
+    x = (ti - arr->tstart) / arr->dt;
+    j = (int)floor(x);
+    if ((j < 0) || (j >= ng - 1)) {
+      out[i] = 1.f;
+      continue;
+    }
+    out[i] = (float)(f[arr->nstart + j] + (f[arr->nstart + j + 1] - f[arr->nstart + j]) * (x - j));
+  }
+}
+
+void LookupFloat(const double *t, int n, const ARRAYS *arr, double per, const float *f, float *out) {
+  /*
+      Same as `LookupDouble()`, for a grid stored in float
+  */
+  double ti, x;
+  int i, j, ng = arr->nend - arr->nstart;
+
+  for (i = 0; i < n; i++) {
+    ti = t[i] - per * floor(t[i] / per + 0.5);
+    x = (ti - arr->tstart) / arr->dt;
+    j = (int)floor(x);
+    if ((j < 0) || (j >= ng - 1)) {
+      out[i] = 1.f;
+      continue;
+    }
+    out[i] = f[arr->nstart + j] + (f[arr->nstart + j + 1] - f[arr->nstart + j]) * (float)(x - j);
+  }
+}
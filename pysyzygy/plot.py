@@ -93,9 +93,9 @@ def PlotTransit(compact = False, ldplot = True, plottitle = "",
   if not notransit:
     if binned:
       trn.Bin()
-      flux = trn.arrays.bflx
+      flux = trn.arrays.bflx.copy()
     else:
-      flux = trn.arrays.flux
+      flux = trn.arrays.flux.copy()
 
     time = np.concatenate(([-1.e5], time, [1.e5]))                                    # Add baseline on each side
     flux = np.concatenate(([1.], flux, [1.]))
@@ -128,9 +128,9 @@ def PlotTransit(compact = False, ldplot = True, plottitle = "",
     else: raise Exception(e)
 
   # Sky-projected motion
-  x = trn.arrays.x
-  y = trn.arrays.y
-  z = trn.arrays.z
+  x = trn.arrays.x.copy()
+  y = trn.arrays.y.copy()
+  z = trn.arrays.z.copy()
   inc = (np.arccos(trn.transit.bcirc/trn.transit.aRs)*180./np.pi)                     # Orbital inclination
   
   # Mask the star
@@ -174,8 +174,8 @@ def PlotTransit(compact = False, ldplot = True, plottitle = "",
     if str(e) == "Object does not transit the star.":
       pass
     else: raise Exception(e)
-  xp = trn.arrays.x
-  yp = trn.arrays.y
+  xp = trn.arrays.x.copy()
+  yp = trn.arrays.y.copy()
   inset2.plot(xp, yp, '-', color='DarkBlue', alpha=0.5)
   # Draw some invisible dots at the corners to set the window size
   xmin, xmax, ymin, ymax = np.nanmin(xp), np.nanmax(xp), np.nanmin(yp), np.nanmax(yp)
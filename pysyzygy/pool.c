@@ -0,0 +1,197 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "transit.h"
+
+/*
+    A small persistent thread pool with work stealing. Each participant
+    owns a contiguous range of task indices, which it consumes from the
+    front; when it runs dry, it steals the back half of another
+    participant's range. Tasks are coarse (typically a whole light curve),
+    so a mutex per queue is plenty.
+*/
+
+typedef struct {
+  pthread_mutex_t lock;
+  int lo;
+  int hi;
+} QUEUE;
+
+typedef struct {
+  int id;
+  unsigned long gen;
+} BIRTH;
+
+typedef struct {
+  void (*fn)(int, void *);
+  void *data;
+  int nq;
+  QUEUE *q;
+} JOB;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;                         // Protects the pool state below
+static pthread_mutex_t pool_busy = PTHREAD_MUTEX_INITIALIZER;                         // Only one job runs at a time
+static pthread_cond_t pool_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+static int pool_size = 0;                                                             // Number of worker threads spawned so far
+static int pool_active = 0;                                                           // Workers still busy with the current job
+static unsigned long pool_gen = 0;                                                    // Incremented every time a job is posted
+static JOB *pool_job = NULL;
+
+static int Pop(QUEUE *q) {
+  /*
+      Take the next task from the front of our own queue
+  */
+  int task = -1;
+  pthread_mutex_lock(&q->lock);
+  if (q->lo < q->hi) task = q->lo++;
+  pthread_mutex_unlock(&q->lock);
+  return task;
+}
+
+static int Steal(JOB *job, int id) {
+  /*
+      Steal the back half of someone else's queue. Returns the first
+      stolen task and keeps the rest in our own queue.
+  */
+  int k, v, n, lo = -1, hi = -1;
+  for (k = 1; k < job->nq; k++) {
+    v = (id + k) % job->nq;
+    pthread_mutex_lock(&job->q[v].lock);
+    n = job->q[v].hi - job->q[v].lo;
+    if (n > 0) {
+      n = (n + 1) / 2;
+      hi = job->q[v].hi;
+      lo = hi - n;
+      job->q[v].hi = lo;
+    }
+    pthread_mutex_unlock(&job->q[v].lock);
+    if (lo >= 0) break;
+  }
+  if (lo < 0) return -1;
+  pthread_mutex_lock(&job->q[id].lock);
+  job->q[id].lo = lo + 1;
+  job->q[id].hi = hi;
+  pthread_mutex_unlock(&job->q[id].lock);
+  return lo;
+}
+
+static void Work(JOB *job, int id) {
+  /*
+      Run tasks until every queue is empty
+  */
+  int task;
+  for (;;) {
+    task = Pop(&job->q[id]);
+    if (task < 0) task = Steal(job, id);
+    if (task < 0) break;
+    job->fn(task, job->data);
+  }
+}
+
+static void *Worker(void *arg) {
+  /*
+      The worker thread main loop: sleep until a job is posted, help out
+      if we're one of its participants, then go back to sleep
+  */
+  int id = ((BIRTH *)arg)->id;
+  unsigned long seen = ((BIRTH *)arg)->gen;                                           // The generation we were born in, so we don't miss the next job
+  JOB *job;
+
+  free(arg);
+  pthread_mutex_lock(&pool_lock);
+  for (;;) {
+    while (pool_gen == seen) pthread_cond_wait(&pool_wake, &pool_lock);
+    seen = pool_gen;
+    job = pool_job;
+    if ((job == NULL) || (id >= job->nq)) continue;                                   // Not needed for this one
+    pthread_mutex_unlock(&pool_lock);
+    Work(job, id);
+    pthread_mutex_lock(&pool_lock);
+    pool_active--;
+    if (pool_active == 0) pthread_cond_signal(&pool_done);
+  }
+  return NULL;
+}
+
+int PoolThreads(int nthreads) {
+  /*
+      The number of threads to use when the user asks for `nthreads`
+      (zero or negative means all of them)
+  */
+  long ncpu;
+  if (nthreads > 0) return nthreads;
+  ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  return (ncpu > 0) ? (int)ncpu : 1;
+}
+
+int PoolRun(int ntasks, void (*fn)(int, void *), void *data, int nthreads) {
+  /*
+      Runs `fn(task, data)` for every task in [0, ntasks), spread over
+      `nthreads` threads (the caller is one of them). If the pool is
+      already busy (e.g., a nested call), the tasks are run serially.
+      Returns ERR_ALLOC, without running any task, if we can't allocate
+      the queues.
+  */
+  int i, nq;
+  BIRTH *birth;
+  pthread_t thread;
+  JOB job;
+
+  if (ntasks <= 0) return ERR_NONE;
+  nq = PoolThreads(nthreads);
+  if (nq > ntasks) nq = ntasks;
+  if ((nq == 1) || (pthread_mutex_trylock(&pool_busy) != 0)) {
+    for (i = 0; i < ntasks; i++) fn(i, data);
+    return ERR_NONE;
+  }
+
+  pthread_mutex_lock(&pool_lock);
+  while (pool_size < nq - 1) {                                                        // Grow the pool lazily
+    birth = malloc(sizeof(BIRTH));
+    if (!birth) break;                                                                // Make do with the threads we have
+    birth->id = pool_size + 1;
+    birth->gen = pool_gen;
+    if (pthread_create(&thread, NULL, Worker, birth) != 0) {
+      free(birth);
+      break;
+    }
+    pthread_detach(thread);
+    pool_size++;
+  }
+  if (nq > pool_size + 1) nq = pool_size + 1;                                         // In case we couldn't spawn enough threads
+  pthread_mutex_unlock(&pool_lock);
+
+  job.fn = fn;
+  job.data = data;
+  job.nq = nq;
+  job.q = malloc(nq * sizeof(QUEUE));
+  if (!job.q) {
+    pthread_mutex_unlock(&pool_busy);
+    return ERR_ALLOC;
+  }
+  for (i = 0; i < nq; i++) {                                                          // Deal out contiguous ranges of tasks
+    pthread_mutex_init(&job.q[i].lock, NULL);
+    job.q[i].lo = (int)(((long)ntasks * i) / nq);
+    job.q[i].hi = (int)(((long)ntasks * (i + 1)) / nq);
+  }
+
+  pthread_mutex_lock(&pool_lock);
+  pool_job = &job;
+  pool_active = nq - 1;
+  pool_gen++;
+  pthread_cond_broadcast(&pool_wake);
+  pthread_mutex_unlock(&pool_lock);
+
+  Work(&job, 0);                                                                      // The caller helps out too
+
+  pthread_mutex_lock(&pool_lock);
+  while (pool_active > 0) pthread_cond_wait(&pool_done, &pool_lock);
+  pool_job = NULL;
+  pthread_mutex_unlock(&pool_lock);
+
+  for (i = 0; i < nq; i++) pthread_mutex_destroy(&job.q[i].lock);
+  free(job.q);
+  pthread_mutex_unlock(&pool_busy);
+  return ERR_NONE;
+}
@@ -0,0 +1,568 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "transit.h"
+
+/*
+    A lookup table for the occultation functions `lambdae`, `lambdad` and
+    `etad`. These only depend on the impact parameter `b` and the radius
+    ratio `p`; the limb darkening coefficients just weight them, so a
+    single table serves every model, and it's built once per process (or
+    loaded from disk).
+
+    The functions have square root singularities at the contact points,
+    b = 1 - p and b = 1 + p, so we split the impact parameter into three
+    segments, [0, 1 - p], [1 - p, 1] and [1, 1 + p], and tabulate each one
+    against a variable `u` in [0, 1] such that the distance from the
+    singular end is proportional to u^2. The functions are smooth in `u`.
+    They're divided by p^2 (so they're of order unity), and the radius
+    ratio is sampled uniformly in log p. We interpolate with Catmull-Rom
+    cubics in both directions; since `p` is the same for every point in a
+    light curve, we interpolate in `p` once per call (and cache the result),
+    leaving a four-point cubic in `u` per point.
+*/
+
+#define TABLE_ROW       (3 * (TABLE_NU + 3) * 3)                                      // Doubles per value of p: segments x nodes in u x functions
+#define TABLE_SIZE      ((TABLE_NP + 2) * TABLE_ROW)
+#define TABLE_MAGIC     0x54465350                                                    // "PSFT"
+#define TABLE_PROBES    4                                                             // Error probes per cell in `u` and in `p`
+#define TABLE_VERSION   1
+
+typedef struct RETIRED {
+  double *tab;
+  struct RETIRED *next;
+} RETIRED;
+
+typedef struct {
+  int magic;
+  int version;
+  int nu;
+  int np;
+  double pmin;
+  double pmax;
+  double err[3];
+} TABLEHEADER;
+
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;                        // Protects the table while it's built or loaded
+static double *table = NULL;                                                          // (TABLE_NP + 2) rows in p, including one ghost on each end (atomic)
+static double table_err[3];                                                           // Largest interpolation errors of lambdae, lambdad, etad,
+static int table_haserr = 0;                                                          // which we only estimate when asked for
+static int table_gen = 0;                                                             // Incremented whenever the table changes
+static RETIRED *retired = NULL;                                                       // Tables replaced by `LoadFluxTable()`, freed at exit
+static __thread int cache_gen = 0;                                                    // The table interpolated to a single value of p,
+static __thread double cache_p = 0.;                                                  // one per thread
+static __thread double cache_row[TABLE_ROW];
+
+static inline void CatmullRom(double t, double *w) {
+  /*
+      The weights of the four nodes around a point a fraction `t` of the
+      way through an interval
+  */
+  w[0] = 0.5 * t * ((2. - t) * t - 1.);
+  w[1] = 0.5 * (t * t * (3. * t - 5.) + 2.);
+  w[2] = 0.5 * t * ((4. - 3. * t) * t + 1.);
+  w[3] = 0.5 * (t - 1.) * t * t;
+}
+
+static inline double TableP(int j) {
+  /*
+      The radius ratio at node `j`, which may be a ghost node (-1 or TABLE_NP)
+  */
+  return exp(log(TABLE_PMIN) + j * (log(TABLE_PMAX) - log(TABLE_PMIN)) / (TABLE_NP - 1));
+}
+
+static inline double TableB(int seg, double u, double p) {
+  /*
+      The impact parameter at `u` in segment `seg` for radius ratio `p`.
+      Ghost nodes past the ends are still well defined: the functions are
+      even in `b`, and the segments overlap.
+  */
+  if (seg == 0) return fabs((1. - p) * (1. - u * u));
+  else if (seg == 1) return 1. - p + p * u * u;
+  else return 1. + p - p * u * u;
+}
+
+static int TableRow(double p, double *row) {
+  /*
+      Tabulates the occultation functions (divided by p^2) for a single `p`
+  */
+  double b[3 * (TABLE_NU + 3)], le[3 * (TABLE_NU + 3)], ld[3 * (TABLE_NU + 3)], ed[3 * (TABLE_NU + 3)];
+  int seg, k, i, iErr;
+
+  for (seg = 0; seg < 3; seg++) {
+    for (k = -1; k <= TABLE_NU + 1; k++)
+      b[seg * (TABLE_NU + 3) + k + 1] = TableB(seg, (double)k / TABLE_NU, p);
+  }
+  iErr = FluxKernel(b, NULL, 3 * (TABLE_NU + 3), p, le, ld, ed);
+  if (iErr != ERR_NONE) return iErr;
+  for (i = 0; i < 3 * (TABLE_NU + 3); i++) {
+    row[3 * i] = le[i] / (p * p);
+    row[3 * i + 1] = ld[i] / (p * p);
+    row[3 * i + 2] = ed[i] / (p * p);
+  }
+  return ERR_NONE;
+}
+
+static void Collapse(const double *tab, int len, double p, double *row) {
+  /*
+      Interpolates a table with rows of `len` doubles in `p`, leaving a
+      single row
+  */
+  double s, w[4];
+  int j, i, l;
+
+  s = (log(p) - log(TABLE_PMIN)) / (log(TABLE_PMAX) - log(TABLE_PMIN)) * (TABLE_NP - 1);
+  j = (int)s;
+  if (j > TABLE_NP - 2) j = TABLE_NP - 2;
+  if (j < 0) j = 0;
+  CatmullRom(s - j, w);
+  tab += j * len;                                                                     // Row j - 1 (the rows are offset by one for the ghost)
+  LANES
+  for (i = 0; i < len; i++) {
+    row[i] = 0.;
+    for (l = 0; l < 4; l++) row[i] += w[l] * tab[l * len + i];
+  }
+}
+
+static inline int TableNode(double b, double p, double *w) {
+  /*
+      The first of the four nodes around impact parameter `b`, which must
+      be on the stellar disk, counting nodes across the segments, and
+      their interpolation weights
+  */
+  double u, s;
+  int seg, k;
+
+  if (b <= 1. - p) {
+    seg = 0;
+    u = sqrt((1. - p - b) / (1. - p));
+  } else if (b <= 1.) {
+    seg = 1;
+    u = sqrt((b - 1. + p) / p);
+  } else {
+    seg = 2;
+    u = sqrt((1. + p - b) / p);
+  }
+  s = u * TABLE_NU;
+  k = (int)s;
+  if (k > TABLE_NU - 1) k = TABLE_NU - 1;
+  CatmullRom(s - k, w);
+  return seg * (TABLE_NU + 3) + k;                                                    // Node k - 1 (again offset by one for the ghost)
+}
+
+static inline void Lookup(const double *row, double b, double p, double *le, double *ld, double *ed) {
+  /*
+      Interpolates the single-`p` row at impact parameter `b`, which must
+      be on the stellar disk
+  */
+  double w[4], p2 = p * p;
+
+  row += 3 * TableNode(b, p, w);
+  *le = p2 * (w[0] * row[0] + w[1] * row[3] + w[2] * row[6] + w[3] * row[9]);
+  *ld = p2 * (w[0] * row[1] + w[1] * row[4] + w[2] * row[7] + w[3] * row[10]);
+  *ed = p2 * (w[0] * row[2] + w[1] * row[5] + w[2] * row[8] + w[3] * row[11]);
+}
+
+static int TableErrors(const double *tab, double *err) {
+  /*
+      Estimates the interpolation error by comparing against the exact
+      functions at `TABLE_PROBES` points inside every cell, in both `u`
+      and `p`
+  */
+  double row[TABLE_ROW], b[3 * TABLE_PROBES * TABLE_NU], le[3 * TABLE_PROBES * TABLE_NU],
+         ld[3 * TABLE_PROBES * TABLE_NU], ed[3 * TABLE_PROBES * TABLE_NU];
+  double p, e[3];
+  int j, seg, k, i, iErr, m = TABLE_PROBES * TABLE_NU;
+
+  err[0] = err[1] = err[2] = 0.;
+  for (j = 0; j < TABLE_PROBES * (TABLE_NP - 1); j++) {
+    p = TABLE_PMIN * pow(TABLE_PMAX / TABLE_PMIN, (j + 0.5) / (TABLE_PROBES * (TABLE_NP - 1)));
+    Collapse(tab, TABLE_ROW, p, row);
+    for (seg = 0; seg < 3; seg++) {
+      for (k = 0; k < m; k++)
+        b[seg * m + k] = TableB(seg, (k + 0.5) / m, p);
+    }
+    iErr = FluxKernel(b, NULL, 3 * m, p, le, ld, ed);
+    if (iErr != ERR_NONE) return iErr;
+    for (i = 0; i < 3 * m; i++) {
+      if (b[i] >= 1. + p) continue;
+      Lookup(row, b[i], p, &e[0], &e[1], &e[2]);
+      err[0] = DMAX(err[0], fabs(e[0] - le[i]));
+      err[1] = DMAX(err[1], fabs(e[1] - ld[i]));
+      err[2] = DMAX(err[2], fabs(e[2] - ed[i]));
+    }
+  }
+  return ERR_NONE;
+}
+
+static int TableBuild(void) {
+  /*
+      Builds the table, if we haven't already. Thread safe.
+  */
+  double *tab;
+  int j, iErr = ERR_NONE;
+
+  if (__atomic_load_n(&table_gen, __ATOMIC_ACQUIRE)) return ERR_NONE;
+  pthread_mutex_lock(&table_lock);
+  if (table == NULL) {
+    tab = malloc(TABLE_SIZE * sizeof(double));
+    if (tab == NULL) iErr = ERR_ALLOC;
+    for (j = -1; (iErr == ERR_NONE) && (j <= TABLE_NP); j++)
+      iErr = TableRow(TableP(j), tab + (j + 1) * TABLE_ROW);
+    if (iErr == ERR_NONE) {
+      __atomic_store_n(&table, tab, __ATOMIC_RELEASE);
+      __atomic_add_fetch(&table_gen, 1, __ATOMIC_RELEASE);
+    } else free(tab);
+  }
+  pthread_mutex_unlock(&table_lock);
+  return iErr;
+}
+
+static int TableErrorsOnce(void) {
+  /*
+      Builds the table and estimates its errors, if we haven't already.
+      Probing every cell is several times slower than building the table,
+      so we don't do it unless we need to.
+  */
+  int iErr;
+
+  iErr = TableBuild();
+  if (iErr != ERR_NONE) return iErr;
+  pthread_mutex_lock(&table_lock);
+  if (!table_haserr) {
+    iErr = TableErrors(table, table_err);
+    if (iErr == ERR_NONE) table_haserr = 1;
+  }
+  pthread_mutex_unlock(&table_lock);
+  return iErr;
+}
+
+int FluxTableKernel(const double *b, const double *z, int n, double RpRs, double *lambdae, double *lambdad, double *etad) {
+  /*
+      Same as `FluxKernel()`, but interpolates the occultation functions
+      from the lookup table. Radius ratios outside the range of the table
+      are passed on to `FluxKernel()`.
+  */
+  int i, gen, iErr;
+
+  if (!((RpRs >= TABLE_PMIN) && (RpRs <= TABLE_PMAX)))
+    return FluxKernel(b, z, n, RpRs, lambdae, lambdad, etad);
+  iErr = TableBuild();
+  if (iErr != ERR_NONE) return iErr;
+  gen = __atomic_load_n(&table_gen, __ATOMIC_ACQUIRE);
+  if ((cache_gen != gen) || (cache_p != RpRs)) {
+    Collapse(__atomic_load_n(&table, __ATOMIC_ACQUIRE), TABLE_ROW, RpRs, cache_row);
+    cache_gen = gen;
+    cache_p = RpRs;
+  }
+
+  LANES
+  for (i = 0; i < n; i++) {
+    if (((z != NULL) && (z[i] > 0)) || !(b[i] < 1. + RpRs)) {                         // No occultation
+      lambdae[i] = 0.;
+      lambdad[i] = 0.;
+      etad[i] = 0.;
+    } else
+      Lookup(cache_row, b[i], RpRs, &lambdae[i], &lambdad[i], &etad[i]);
+  }
+  return ERR_NONE;
+}
+
+double FluxTableError(double u1, double u2) {
+  /*
+      An estimate of the largest error in the flux computed with the
+      lookup table, for quadratic limb darkening coefficients `u1` and `u2`
+  */
+  if (TableErrorsOnce() != ERR_NONE) return NAN;
+  return (fabs(1. - u1 - 2. * u2) * table_err[0] + fabs(u1 + 2. * u2) * table_err[1] +
+          fabs(u2) * table_err[2]) / (1. - u1/3. - u2/6.);
+}
+
+int SaveFluxTable(const char *path) {
+  /*
+      Saves the lookup table (building it first, if needed) to `path`,
+      along with its error estimates
+  */
+  TABLEHEADER h = {TABLE_MAGIC, TABLE_VERSION, TABLE_NU, TABLE_NP, TABLE_PMIN, TABLE_PMAX, {0., 0., 0.}};
+  FILE *fp;
+  int iErr;
+
+  iErr = TableErrorsOnce();
+  if (iErr != ERR_NONE) return iErr;
+  memcpy(h.err, table_err, sizeof(h.err));
+  fp = fopen(path, "wb");
+  if (fp == NULL) return ERR_TABLE;
+  if ((fwrite(&h, sizeof(h), 1, fp) != 1) ||
+      (fwrite(__atomic_load_n(&table, __ATOMIC_ACQUIRE), sizeof(double), TABLE_SIZE, fp) != TABLE_SIZE)) 
+    iErr = ERR_TABLE;
+  if (fclose(fp) != 0) iErr = ERR_TABLE;
+  return iErr;
+}
+
+int LoadFluxTable(const char *path) {
+  /*
+      Loads a lookup table saved with `SaveFluxTable()`, so we don't need
+      to build it. The table must have been made with the same settings.
+  */
+  TABLEHEADER h;
+  double *tab;
+  RETIRED *old;
+  FILE *fp;
+  int iErr = ERR_NONE;
+
+  fp = fopen(path, "rb");
+  if (fp == NULL) return ERR_TABLE;
+  tab = malloc(TABLE_SIZE * sizeof(double));
+  old = malloc(sizeof(RETIRED));
+  if ((tab == NULL) || (old == NULL)) iErr = ERR_ALLOC;
+  else if ((fread(&h, sizeof(h), 1, fp) != 1) || (h.magic != TABLE_MAGIC) ||
+           (h.version != TABLE_VERSION) || (h.nu != TABLE_NU) || (h.np != TABLE_NP) ||
+           (h.pmin != TABLE_PMIN) || (h.pmax != TABLE_PMAX) ||
+           (fread(tab, sizeof(double), TABLE_SIZE, fp) != TABLE_SIZE)) iErr = ERR_TABLE;
+  fclose(fp);
+  if (iErr != ERR_NONE) {
+    free(tab);
+    free(old);
+    return iErr;
+  }
+
+  pthread_mutex_lock(&table_lock);
+  old->tab = __atomic_exchange_n(&table, tab, __ATOMIC_ACQ_REL);                      // Other threads may be using the old one, so we keep it until exit
+  old->next = retired;
+  retired = old;
+  memcpy(table_err, h.err, sizeof(table_err));
+  table_haserr = 1;
+  __atomic_add_fetch(&table_gen, 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&table_lock);
+  return ERR_NONE;
+}
+
+/*
+    --- NONLINEAR LIMB DARKENING ---
+
+    The nonlinear law of Claret (2000) is a sum of powers of mu, and so is
+    the occulted flux: the integer powers (1, mu and mu^2) are the quadratic
+    law's `lambdae`, `lambdad` and `lambdae - etad`, but the half-integer
+    ones, mu^(1/2) and mu^(3/2), have no closed form. We call their
+    occulted fractions `lambda1` and `lambda3`, normalized like the others
+    (by pi), and tabulate them divided by p^2, exactly like the table above
+    and on the same nodes, so each point is again a four-point cubic per
+    function. The nodes are integrated numerically, once per process.
+
+    The integral is over rings about the center of the star, each weighted
+    by the angle the planet subtends on it. The integrand has square root
+    singularities at both ends, and a fourth root one at the limb, so we
+    use tanh-sinh quadrature, which converges exponentially regardless.
+*/
+
+#define HALF_ROW        (3 * (TABLE_NU + 3) * 2)                                      // Doubles per value of p: segments x nodes in u x functions
+#define HALF_SIZE       ((TABLE_NP + 2) * HALF_ROW)
+#define HALF_STEP       0.15                                                          // Step of the tanh-sinh rule...
+#define HALF_NODES      21                                                            // ...and nodes on either side of its center
+
+static double *half = NULL;                                                           // Same layout as `table`, with two functions
+static double half_err[2];
+static int half_haserr = 0;
+static int half_gen = 0;
+static __thread int hcache_gen = 0;
+static __thread double hcache_p = 0.;
+static __thread double hcache_row[HALF_ROW];
+
+void NonlinearPoint(double b, double p, double *lambda1, double *lambda3) {
+  /*
+      The occulted fractions of the mu^(1/2) and mu^(3/2) terms of the
+      limb darkening law, for a planet on the stellar disk, integrated
+      numerically. Accurate to about 1e-13.
+  */
+  double mu, r0, r1, h, s, e, d, dl, dr, r, A, B, C, D, kap, f, s1 = 0., s3 = 0.;
+  int k;
+
+  *lambda1 = *lambda3 = 0.;
+  if (b < p) {                                                                        // The rings inside `p - b` are fully occulted
+    mu = sqrt((1. - p + b) * (1. + p - b));
+    *lambda1 = 0.8 * (1. - pow(mu, 2.5));
+    *lambda3 = 4. / 7. * (1. - pow(mu, 3.5));
+  }
+  r0 = fabs(b - p);
+  r1 = DMIN(b + p, 1.);
+  if (!(r1 > r0)) return;
+  h = 0.5 * (r1 - r0);
+  for (k = -HALF_NODES; k <= HALF_NODES; k++) {
+    s = 0.5 * PI * sinh(k * HALF_STEP);
+    e = exp(2. * fabs(s));
+    d = 2. * h / (1. + e);                                                            // Distance to the nearer end, without cancellation
+    dl = (k < 0) ? d : 2. * h - d;
+    dr = (k < 0) ? 2. * h - d : d;
+    r = (k < 0) ? r0 + dl : r1 - dr;
+    A = (b + p - r1) + dr;                                                            // b + p - r
+    B = (r0 + p - b) + dl;                                                            // p - b + r
+    C = (r0 + b - p) + dl;                                                            // r + b - p
+    D = r + b + p;
+    kap = 2. * atan2(sqrt(A * B), sqrt(C * D));                                       // Half the angle the planet subtends on the ring
+    mu = sqrt(((1. - r1) + dr) * (1. + r));
+    f = kap * r * h * HALF_STEP * 0.5 * PI * cosh(k * HALF_STEP) * 4. * e / SQR(1. + e);
+    s1 += f * sqrt(mu);
+    s3 += f * mu * sqrt(mu);
+  }
+  *lambda1 += 2. / PI * s1;
+  *lambda3 += 2. / PI * s3;
+}
+
+static void HalfRow(double p, double *row) {
+  /*
+      Tabulates `lambda1` and `lambda3` (divided by p^2) for a single `p`
+  */
+  double b;
+  int seg, k, i;
+
+  for (seg = 0; seg < 3; seg++) {
+    for (k = -1; k <= TABLE_NU + 1; k++) {
+      i = seg * (TABLE_NU + 3) + k + 1;
+      b = TableB(seg, (double)k / TABLE_NU, p);
+      if (b < 1. + p) NonlinearPoint(b, p, &row[2 * i], &row[2 * i + 1]);
+      else row[2 * i] = row[2 * i + 1] = 0.;                                          // The ghost past last contact
+      row[2 * i] /= p * p;
+      row[2 * i + 1] /= p * p;
+    }
+  }
+}
+
+static inline void HalfLookup(const double *row, double b, double p, double *l1, double *l3) {
+  /*
+      Interpolates the single-`p` row of the nonlinear table at impact
+      parameter `b`, which must be on the stellar disk
+  */
+  double w[4], p2 = p * p;
+
+  row += 2 * TableNode(b, p, w);
+  *l1 = p2 * (w[0] * row[0] + w[1] * row[2] + w[2] * row[4] + w[3] * row[6]);
+  *l3 = p2 * (w[0] * row[1] + w[1] * row[3] + w[2] * row[5] + w[3] * row[7]);
+}
+
+static int HalfBuild(void) {
+  /*
+      Builds the nonlinear table, if we haven't already. Thread safe.
+  */
+  double *tab;
+  int j, iErr = ERR_NONE;
+
+  if (__atomic_load_n(&half_gen, __ATOMIC_ACQUIRE)) return ERR_NONE;
+  pthread_mutex_lock(&table_lock);
+  if (half == NULL) {
+    tab = malloc(HALF_SIZE * sizeof(double));
+    if (tab == NULL) iErr = ERR_ALLOC;
+    else {
+      for (j = -1; j <= TABLE_NP; j++)
+        HalfRow(TableP(j), tab + (j + 1) * HALF_ROW);
+      half = tab;
+      __atomic_add_fetch(&half_gen, 1, __ATOMIC_RELEASE);
+    }
+  }
+  pthread_mutex_unlock(&table_lock);
+  return iErr;
+}
+
+int NonlinearKernel(const double *b, const double *z, int n, double RpRs, double *lambda1, double *lambda3) {
+  /*
+      Computes `lambda1` and `lambda3` for the `n` impact parameters `b`,
+      interpolated from the nonlinear table, with zeros for the points
+      that aren't occulted, like `FluxTableKernel()`. Radius ratios outside
+      the range of the table are integrated numerically, which is a couple
+      of orders of magnitude slower.
+  */
+  int i, gen, iErr;
+
+  if (!((RpRs >= TABLE_PMIN) && (RpRs <= TABLE_PMAX))) {
+    for (i = 0; i < n; i++) {
+      if (((z != NULL) && (z[i] > 0)) || !(b[i] < 1. + RpRs))
+        lambda1[i] = lambda3[i] = 0.;
+      else
+        NonlinearPoint(b[i], RpRs, &lambda1[i], &lambda3[i]);
+    }
+    return ERR_NONE;
+  }
+  iErr = HalfBuild();
+  if (iErr != ERR_NONE) return iErr;
+  gen = __atomic_load_n(&half_gen, __ATOMIC_ACQUIRE);
+  if ((hcache_gen != gen) || (hcache_p != RpRs)) {
+    Collapse(half, HALF_ROW, RpRs, hcache_row);
+    hcache_gen = gen;
+    hcache_p = RpRs;
+  }
+
+  LANES
+  for (i = 0; i < n; i++) {
+    if (((z != NULL) && (z[i] > 0)) || !(b[i] < 1. + RpRs)) {                         // No occultation
+      lambda1[i] = 0.;
+      lambda3[i] = 0.;
+    } else
+      HalfLookup(hcache_row, b[i], RpRs, &lambda1[i], &lambda3[i]);
+  }
+  return ERR_NONE;
+}
+
+static void HalfErrors(const double *tab, double *err) {
+  /*
+      Estimates the interpolation error of the nonlinear table, like
+      `TableErrors()`
+  */
+  double row[HALF_ROW], p, b, l1, l3, e1, e3;
+  int j, seg, k, m = TABLE_PROBES * TABLE_NU;
+
+  err[0] = err[1] = 0.;
+  for (j = 0; j < TABLE_PROBES * (TABLE_NP - 1); j++) {
+    p = TABLE_PMIN * pow(TABLE_PMAX / TABLE_PMIN, (j + 0.5) / (TABLE_PROBES * (TABLE_NP - 1)));
+    Collapse(tab, HALF_ROW, p, row);
+    for (seg = 0; seg < 3; seg++) {
+      for (k = 0; k < m; k++) {
+        b = TableB(seg, (k + 0.5) / m, p);
+        if (b >= 1. + p) continue;
+        NonlinearPoint(b, p, &l1, &l3);
+        HalfLookup(row, b, p, &e1, &e3);
+        err[0] = DMAX(err[0], fabs(e1 - l1));
+        err[1] = DMAX(err[1], fabs(e3 - l3));
+      }
+    }
+  }
+}
+
+double NonlinearTableError(double c1, double c2, double c3, double c4) {
+  /*
+      An estimate of the largest error in the flux computed with the
+      nonlinear table, for the nonlinear limb darkening coefficients
+      `c1` through `c4`. The integer powers of mu are exact, so only
+      the first and third coefficients matter, but the normalization
+      depends on all four. The first call probes every cell, which
+      takes a few seconds.
+  */
+  if (HalfBuild() != ERR_NONE) return NAN;
+  pthread_mutex_lock(&table_lock);
+  if (!half_haserr) {
+    HalfErrors(half, half_err);
+    half_haserr = 1;
+  }
+  pthread_mutex_unlock(&table_lock);
+  return (fabs(c1) * half_err[0] + fabs(c3) * half_err[1]) / 
+         (1. - c1 / 5. - c2 / 3. - 3. * c3 / 7. - c4 / 2.);
+}
+
+__attribute__((destructor)) static void TableFree(void) {
+  /*
+      Frees the tables (and the ones they replaced) when the library is
+      unloaded, or at exit
+  */
+  RETIRED *r;
+
+  while (retired != NULL) {
+    r = retired;
+    retired = r->next;
+    free(r->tab);
+    free(r);
+  }
+  free(table);
+  free(half);
+  table = NULL;
+  half = NULL;
+}
@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <time.h>
 #include "transit.h"
  
 void dbl_free(double *ptr){
@@ -9,6 +11,237 @@ void dbl_free(double *ptr){
   */ 
   free(ptr);
 } 
+
+typedef struct {
+  long refs;
+  long pad;                                                                           // Keeps the doubles that follow 16-byte aligned
+} ARENAHDR;
+
+static double *ArenaAlloc(size_t n) {
+  /*
+      Allocates an arena of `n` doubles, with a reference count in front 
+      of it. The ARRAYS it's allocated for holds the first reference; the
+      NumPy views of it in Python take out more (see `ArenaRetain()`), so
+      the memory outlives the workspace if it's freed or regrown while
+      they're around.
+  */
+  ARENAHDR *h = malloc(sizeof(ARENAHDR) + n * sizeof(double));
+  
+  if (h == NULL) return NULL;
+  h->refs = 1;
+  return (double *)(h + 1);
+}
+
+void ArenaRetain(double *arena) {
+  /*
+      Takes out another reference to `arena`
+  */
+  if (arena != NULL) __atomic_add_fetch(&((ARENAHDR *)arena - 1)->refs, 1, __ATOMIC_RELAXED);
+}
+
+void ArenaRelease(double *arena) {
+  /*
+      Gives up a reference to `arena`, freeing it if that was the last one
+  */
+  if ((arena != NULL) && (__atomic_sub_fetch(&((ARENAHDR *)arena - 1)->refs, 1, __ATOMIC_ACQ_REL) == 0))
+    free((ARENAHDR *)arena - 1);
+}
+
+void FreeArrays(ARRAYS *arr){
+  /* 
+      Frees the workspace in `arr`. It can be reused afterwards; the 
+      arena is simply reallocated on the next call. Arenas still viewed
+      from Python are only freed when the last view goes away.
+  */ 
+  ArenaRelease(arr->arena);
+  ArenaRelease(arr->iarr);
+  ArenaRelease(arr->garena);
+  free(arr->larena);
+  arr->arena = NULL;
+  arr->time = arr->flux = arr->bflx = NULL;
+  arr->M = arr->E = arr->f = arr->r = NULL;
+  arr->x = arr->y = arr->z = arr->b = arr->cflx = arr->cfl2 = NULL;
+  arr->iarr = NULL;
+  arr->garena = arr->grad = arr->bgrad = arr->cgrd = arr->cgr2 = NULL;
+  arr->larena = arr->lame = arr->lamd = arr->etad = arr->lam1 = arr->lam3 = NULL;
+  arr->nalloc = 0;
+  arr->ialloc = 0;
+  arr->galloc = 0;
+  arr->lalloc = 0;
+  arr->basis = 0;
+  arr->computed = 0;
+  arr->binned = 0;
+  arr->integrated = 0;
+  arr->nsym = 0;
+}
+
+static int BasisWorkspace(ARRAYS *arr){
+  /* 
+      Makes sure the arena of occultation functions holds BASIS_ARRAYS 
+      arrays as long as the ones in the main arena. It's allocated the 
+      first time a uniform grid is computed, and when the main arena grows.
+  */ 
+  double *larena;
+  size_t n = (size_t)arr->nalloc;
+  
+  if (arr->lalloc == arr->nalloc) return ERR_NONE;
+  larena = malloc((size_t)BASIS_ARRAYS * n * sizeof(double));
+  if (larena == NULL) return ERR_ALLOC;
+  free(arr->larena);
+  arr->larena = larena;
+  arr->lalloc = arr->nalloc;
+  arr->lame = larena;
+  arr->lamd = larena + n;
+  arr->etad = larena + 2 * n;
+  arr->lam1 = larena + 3 * n;
+  arr->lam3 = larena + 4 * n;
+  arr->basis = 0;
+  return ERR_NONE;
+}
+
+int Workspace(ARRAYS *arr, int npts){
+  /* 
+      Makes sure the arena in `arr` holds at least `npts` points for each
+      of its arrays. The arena is a single allocation that is kept across
+      calls and only grows, so repeated calls don't allocate at all. Its
+      contents are discarded when it grows.
+  */ 
+  double *arena;
+  
+  if (npts <= arr->nalloc) return ERR_NONE;
+  arena = ArenaAlloc((size_t)ARENA_ARRAYS * npts);
+  if (arena == NULL) return ERR_ALLOC;
+  ArenaRelease(arr->arena);
+  arr->arena = arena;
+  arr->nalloc = npts;
+  arr->time = arena;
+  arr->flux = arena + (size_t)npts;
+  arr->bflx = arena + (size_t)2 * npts;
+  arr->M = arena + (size_t)3 * npts;
+  arr->E = arena + (size_t)4 * npts;
+  arr->f = arena + (size_t)5 * npts;
+  arr->r = arena + (size_t)6 * npts;
+  arr->x = arena + (size_t)7 * npts;
+  arr->y = arena + (size_t)8 * npts;
+  arr->z = arena + (size_t)9 * npts;
+  arr->b = arena + (size_t)10 * npts;
+  arr->cflx = arena + (size_t)11 * npts;
+  arr->cfl2 = arena + (size_t)12 * npts;
+  arr->computed = 0;
+  arr->binned = 0;
+  arr->integrated = 0;
+  return ERR_NONE;
+}
+
+static int GradWorkspace(ARRAYS *arr){
+  /* 
+      Makes sure the gradient arena holds NGRAD arrays of each kind, with
+      the same length as the ones in the main arena. Like the main arena,
+      it's only allocated when it needs to grow (or the first time the
+      gradients are asked for), and its contents are discarded then.
+  */ 
+  double *garena;
+  size_t n = (size_t)NGRAD * arr->nalloc;
+  
+  if (arr->galloc == arr->nalloc) return ERR_NONE;
+  garena = ArenaAlloc((size_t)GRAD_ARRAYS * arr->nalloc);
+  if (garena == NULL) return ERR_ALLOC;
+  ArenaRelease(arr->garena);
+  arr->garena = garena;
+  arr->galloc = arr->nalloc;
+  arr->grad = garena;
+  arr->bgrad = garena + n;
+  arr->cgrd = garena + 2 * n;
+  arr->cgr2 = garena + 3 * n;
+  return ERR_NONE;
+}
+
+/*
+    --- INSTRUMENTATION ---
+    
+    When compiled with -DINSTRUMENT, the hot paths bump the counters in
+    the ARRAYS they're working on, and the stages (Compute, Bin and
+    Interpolate) are timed. The functions deep in the call tree don't see
+    the ARRAYS, so the stages point a thread-local pointer at its counters
+    for as long as they run. Otherwise COUNT() is a no-op and this all 
+    compiles away.
+*/
+
+typedef struct {
+  COUNTERS *prof;
+  int stage;
+} PROFSAVE;
+
+#ifdef INSTRUMENT
+static _Thread_local COUNTERS *prof = NULL;                                           // The counters of the stage running on this thread, if any
+static _Thread_local int pstage = 0;                                                  // Which stage that is...
+static _Thread_local double pmark = 0.;                                               // ...and when it last started or resumed
+#define COUNT(field, n)         do { if (prof) prof->field += (n); } while (0)
+#define GAUGE(field, v)         do { if (prof) prof->field = (v); } while (0)
+
+static inline double Clock(void) {
+  /*
+      Wall clock time in seconds
+  */
+  struct timespec ts;
+  
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1.e-9 * ts.tv_nsec;
+}
+#else
+#define COUNT(field, n)         do { } while (0)
+#define GAUGE(field, v)         do { } while (0)
+#endif
+
+int Instrumented(void) {
+  /*
+      Whether the counters are compiled in
+  */
+#ifdef INSTRUMENT
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+static inline PROFSAVE ProfBegin(ARRAYS *arr, int stage) {
+  /*
+      Enters `stage`, pausing the clock of the stage that called it, if 
+      any. Returns what `ProfEnd()` needs to resume it.
+  */
+  PROFSAVE saved = {NULL, 0};
+#ifdef INSTRUMENT
+  double now = Clock();
+  
+  saved.prof = prof;
+  saved.stage = pstage;
+  if (prof) prof->time[pstage] += now - pmark;
+  prof = &arr->prof;
+  pstage = stage;
+  pmark = now;
+  prof->calls[stage]++;
+#else
+  (void)arr;
+  (void)stage;
+#endif
+  return saved;
+}
+
+static inline void ProfEnd(PROFSAVE saved) {
+  /*
+      Leaves the current stage and resumes the one that called it
+  */
+#ifdef INSTRUMENT
+  double now = Clock();
+  
+  prof->time[pstage] += now - pmark;
+  prof = saved.prof;
+  pstage = saved.stage;
+  pmark = now;
+#else
+  (void)saved;
+#endif
+}
  
 double modulus(double x, double y) {
   /*
@@ -58,6 +291,45 @@ double ellk(double k) {
   ek2 = (b0+m1*(b1+m1*(b2+m1*(b3+m1*b4))))*log(m1);
   return ek1 - ek2;
 }
+
+double ellpic(double n, double k, int *err) {
+  /*
+      The complete elliptic integral of the third kind, Pi(-n, k), for
+      `n > -1` and `k < 1`, via Bulirsch's (1969) `cel` algorithm. This
+      converges quadratically and is exact to machine precision, unlike
+      `ellk() - n / 3 * rj(0, 1 - k^2, 1, 1 + n)`, which inherits the
+      error of the Hastings approximation and amplifies it when `n` is large.
+  */
+  double kc, p, m0, c, d, e, f, g;
+  int i;
+  if (1. - k * k < RJ_TINY || 1. + n < RJ_TINY) {
+    *err = ERR_RJ;
+    return 0.;
+  }
+  COUNT(ellpic, 1);
+  kc = sqrt(1. - k * k);
+  p = sqrt(1. + n);
+  m0 = 1.;
+  c = 1.;
+  d = 1. / p;
+  e = kc;
+  for (i = 0; i < ELLPIC_MAXIT; i++) {
+    COUNT(ellpicit, 1);
+    f = c;
+    c = d / p + c;
+    g = e / p;
+    d = 2. * (f * g + d);
+    p = g + p;
+    g = m0;
+    m0 = kc + m0;
+    if (fabs(1. - kc / g) <= ELLPIC_TOL) 
+      return 0.5 * PI * (c * m0 + d) / (m0 * (m0 + p));
+    kc = 2. * sqrt(e);
+    e = kc * m0;
+  }
+  *err = ERR_RJ;
+  return 0.;
+}
  
 double rc(double x, double y, int *err) { 
   /* 
@@ -219,9 +491,11 @@ double EccentricAnomalyFast(double dMeanA, double dEcc, double tol, int maxiter)
   int iter;
   
   if (dEcc == 0.) return dMeanA;                                                      // The trivial circular case
+  COUNT(kepsolves, 1);
   dEccA = dMeanA + sgn(sin(dMeanA))*0.85*dEcc;
 
   for (iter = 1; iter <= maxiter; iter++) {
+    COUNT(kepiter, 1);
     fi = dEccA - dEcc*sin(dEccA) - dMeanA;
     if (fi > 0)
       up = dEccA;
@@ -262,38 +536,685 @@ double EccentricAnomaly(double M, double e, double tol, int maxiter) {
   double E = M, eps = tol;                                                            // Kreidberg: eps = 1.0e-7;
   
   if (e == 0.) return M;                                                              // The trivial circular case
+  COUNT(kepsolves, 1);
   
-	while(fabs(E - e*sin(E) - M) > eps) E = E - (E - e*sin(E) - M)/(1.0 - e*cos(E));
+	while(fabs(E - e*sin(E) - M) > eps) {
+	  E = E - (E - e*sin(E) - M)/(1.0 - e*cos(E));
+	  COUNT(kepiter, 1);
+	}
 	return E;
 	
 }
 
-int Compute(TRANSIT *transit, LIMBDARK *limbdark, SETTINGS *settings, ARRAYS *arr){
+/*
+    --- BATCH KEPLER SOLVER ---
+    
+    Solves Kepler's equation for a whole array of mean anomalies at once,
+    KEPLER_CHUNK at a time, with every point of a chunk iterating in 
+    lock-step so the compiler can vectorize it. Each solve starts from a
+    cubic Hermite interpolant of a table of E(M) for the current 
+    eccentricity, and then takes Halley steps, which roughly triple the
+    number of correct digits each time. From that starting point a single
+    step almost always reaches `keptol`, which we can tell from the size
+    of the step without evaluating the residual again; the few lanes that
+    need more than KEPLER_ITER steps are finished by the scalar solver.
+*/
+
+static inline double RoundV(double x) {
   /*
-      Compute the transit model
-  */    
-  double au, bu, u1, u2, c1, c2, c3, c4;
-  double omega, per, RpRs, aRs, inc, w, ecc, fi, tperi0, t;
-  double dt, tmp;
-  double x1, x2, x3, x4, kap1, kap0, lambdae, lambdad, lam, q, Kk, Ek, n, Pk, etad;
-  int i, s;
-  int np = 0, nm = 0, npctr = 0, nmctr = 0;
+      Rounds to the nearest integer (for |x| < 2^51). Unlike `floor()` 
+      and friends, the compiler will vectorize this.
+  */
+  return (x + 6755399441055744.) - 6755399441055744.;
+}
+
+static inline void SinCosV(double x, double *s, double *c) {
+  /*
+      A branch-free sine and cosine the compiler can vectorize. Good to
+      a couple of ulp for the angles we need here (|x| < 1000, say).
+  */
+  double k, q, r, r2, sr, cr, swap;
+  
+  k = RoundV(x * 0.6366197723675814);                                                 // Nearest multiple of pi / 2
+  r = (x - k * 1.5707963267948966) - k * 6.123233995736766e-17;                       // Cody-Waite reduction to [-pi / 4, pi / 4]
+  r2 = r * r;
+  sr = r + r * r2 * (-1./6. + r2 * (1./120. + r2 * (-1./5040. + r2 * (1./362880. + 
+       r2 * (-1./39916800. + r2 * (1./6227020800. + r2 * (-1./1307674368000. + 
+       r2 * (1./355687428096000.))))))));
+  cr = 1. + r2 * (-0.5 + r2 * (1./24. + r2 * (-1./720. + r2 * (1./40320. + 
+       r2 * (-1./3628800. + r2 * (1./479001600. + r2 * (-1./87178291200. + 
+       r2 * (1./20922789888000. + r2 * (-1./6402373705728000.)))))))));
+  q = k - 4. * RoundV(0.25 * k - 0.375);                                              // Quadrant, 0 through 3
+  swap = (fabs(q - 2.) == 1.) ? 1. : 0.;
+  *s = ((q > 1.5) ? -1. : 1.) * (swap * cr + (1. - swap) * sr);
+  *c = ((fabs(q - 1.5) < 1.) ? -1. : 1.) * (swap * sr + (1. - swap) * cr);
+}
+
+static int KeplerNewton(double M, double ecc, double tol, int maxiter, double *E) {
+  /*
+      Newton's method for Kepler's equation, starting from `*E`. Same
+      stopping criterion as `EccentricAnomaly()`, but it gives up after
+      `maxiter` iterations
+  */
+  double f;
+  int iter;
+  
+  for (iter = 0; iter < maxiter; iter++) {
+    f = *E - ecc * sin(*E) - M;
+    if (!(fabs(f) > tol)) return ERR_NONE;
+    COUNT(kepiter, 1);
+    *E -= f / (1. - ecc * cos(*E));
+  }
+  return ERR_KEPLER;
+}
+
+int KeplerStarter(double ecc, KEPLER *kep) {
+  /*
+      Tabulates the mean anomaly and the derivative of the eccentric 
+      anomaly with respect to it at KEPLER_NODES equal intervals of the 
+      eccentric anomaly in [0, pi], which is all we need by symmetry. 
+      There's nothing to solve for in this direction, and the nodes end 
+      up closest together in mean anomaly where E(M) is steepest.
+  */
+  double E;
+  int j;
+  
+  if (!((ecc >= 0.) && (ecc < 1.))) return ERR_BAD_ECC;
+  kep->ecc = ecc;
+  for (j = 0; j <= KEPLER_NODES; j++) {
+    E = j * PI / KEPLER_NODES;
+    kep->M[j] = E - ecc * sin(E);
+    kep->E[j] = E;
+    kep->dE[j] = 1. / (1. - ecc * cos(E));
+  }
+  kep->M[KEPLER_NODES] = PI;                                                          // Exactly
+  return ERR_NONE;
+}
+
+int EccentricAnomalyBatch(const double *M, int n, const KEPLER *kep, double tol, int maxiter, double *E, KEPSTATS *stats) {
+  /*
+      The eccentric anomaly at each of the `n` mean anomalies `M`, for 
+      the eccentricity in the starter table `kep`. Iteration statistics 
+      are added to `stats`, if it's not NULL.
+  */
+  double ecc = kep->ecc;
+  double m[KEPLER_CHUNK], sg[KEPLER_CHUNK], off[KEPLER_CHUNK];
+  int j[KEPLER_CHUNK], ok[KEPLER_CHUNK];
+  int i, l, k, step, iter, more, iErr;
+  
+  for (i = 0; i < n; i += KEPLER_CHUNK) {
+    k = IMIN(n - i, KEPLER_CHUNK);
+    
+    // Reduce to [0, pi]...
+    LANES
+    for (l = 0; l < k; l++) {
+      off[l] = 2. * PI * RoundV(M[i + l] / (2. * PI));
+      sg[l] = (M[i + l] - off[l] < 0) ? -1. : 1.;
+      m[l] = fabs(M[i + l] - off[l]);
+      j[l] = 0;
+    }
+    
+    // ...find the interval by bisection...
+    for (step = KEPLER_NODES / 2; step > 0; step /= 2) {
+      LANES
+      for (l = 0; l < k; l++)
+        j[l] += (kep->M[j[l] + step] <= m[l]) ? step : 0;
+    }
+    
+    // ...and interpolate the starting guess
+    LANES
+    for (l = 0; l < k; l++) {
+      int q = (j[l] < KEPLER_NODES) ? j[l] : KEPLER_NODES - 1;
+      double h = kep->M[q + 1] - kep->M[q];
+      double t = DMIN((m[l] - kep->M[q]) / h, 1.);
+      double h00 = (1. + 2. * t) * (1. - t) * (1. - t);
+      double h10 = t * (1. - t) * (1. - t);
+      double h01 = t * t * (3. - 2. * t);
+      double h11 = t * t * (t - 1.);
+      E[i + l] = h00 * kep->E[q] + h10 * h * kep->dE[q] + h01 * kep->E[q + 1] + h11 * h * kep->dE[q + 1];
+      E[i + l] = DMIN(DMAX(E[i + l], m[l]), m[l] + ecc);                              // We know that M <= E <= M + e
+      ok[l] = 0;
+    }
+    
+    // Halley's method, in lock-step
+    for (iter = 1; ; iter++) {
+      more = 0;
+      LANES_ANY
+      for (l = 0; l < k; l++) {
+        double En = E[i + l], s, c, f, fp, d, K;
+        int done;
+        SinCosV(En, &s, &c);
+        f = En - ecc * s - m[l];
+        fp = 1. - ecc * c;
+        d = f / fp;
+        done = ok[l] || !(fabs(f) > tol);
+        K = ecc / (6. * fp) + 0.25 * SQR(ecc / fp);                                   // Bounds the error after this step, K |d|^3, when |d| is small
+        ok[l] = done || ((fabs(d) < 1.e-3) && (fp * K * d * d * fabs(d) < 0.1 * tol));
+        more |= !ok[l];
+        E[i + l] = done ? En : En - d / (1. - 0.5 * d * ecc * s / fp);
+      }
+      if (!more || (iter == KEPLER_ITER)) break;
+    }
+    
+    // Finish off any stragglers, and undo the reduction
+    for (l = 0; l < k; l++) {
+      if (!ok[l]) {
+        iErr = KeplerNewton(m[l], ecc, tol, maxiter, &E[i + l]);
+        if (iErr != ERR_NONE) return iErr;
+        if (stats) stats->fallback++;
+      }
+    }
+    LANES
+    for (l = 0; l < k; l++)
+      E[i + l] = sg[l] * E[i + l] + off[l];
+    if (stats) {
+      stats->blocks++;
+      stats->iter += iter;
+      if (iter > stats->maxiter) stats->maxiter = iter;
+    }
+  }
+  if (stats) {
+    stats->batches++;
+    stats->solves += n;
+  }
+  return ERR_NONE;
+}
+
+int FluxPoint(double b, double RpRs, double *lambdae_, double *lambdad_, double *etad_) {
+  /*
+      The Mandel & Agol (2002) occultation functions for a single impact
+      parameter `b`. This is the scalar reference implementation, which 
+      the vectorized kernel falls back to in the (rare) special cases.
+  */
+  double x1, x2, x3, x4, kap1 = 0., kap0 = 0., lambdae = 0., lambdad = 0., etad = 0.;
+  double q, Kk, Ek, n, Pk;
+  int iErr = ERR_NONE;
+  
+  COUNT(fluxpoint, 1);
+  x1 = pow(RpRs - b, 2.);                                                             // Set up some quantities to compute the transit flux
+  x2 = pow(RpRs + b, 2.);                                                             // The following is adapted from Eric Agol's fortran routines
+  x3 = RpRs * RpRs - b*b;
+  x4 = RpRs * RpRs + b*b;
+  
+  // 1. Compute lambdae
+  if (RpRs >= 1. && b <= RpRs - 1.) {                                                 // [ONE] Occulting object completely occults source
+    lambdae=1.;
+  } else if (b > 1. - RpRs) {                                                         // [TWO] Occultor is crossing the limb. Equation (26)
+    kap1 = acos(fmin((1. - x3) / 2. / b, 1.));
+    kap0 = acos(fmin((x4 - 1.) / 2 / RpRs / b, 1.));
+    lambdae = RpRs * RpRs * kap0 + kap1;
+    lambdae -= 0.5*sqrt(fmax(4. * b * b - pow(1. - x3, 2.), 0.));
+    lambdae /= PI;
+  } else if (b <= 1. - RpRs) {                                                        // [THREE] Occultor is crossing the star
+    lambdae = RpRs * RpRs;
+  }
+  
+  // 2. Compute lambdad and etad
+  if (RpRs >= 1. && b <= RpRs - 1.) {                                                 // [ONE] Occulting object completely occults source
+    lambdad=1.;
+    etad=1.;
+  } else if ((b > 0.5 + fabs(RpRs - 0.5) && b < 1. + RpRs) || 
+             (RpRs > 0.5 && b > fabs(1. - RpRs) * 
+             1.0001 && b < RpRs)) {                                                   // [TWO] The occultor partly occults the star and crosses the limb
+    n = 1./x1 - 1.;
+    
+    if (1. + n > RJ_BIG){
+      COUNT(rjbig, 1);
+      // When the impact parameter approaches RpRs, x1 tends to zero and
+      // n tends to infinity. The old approach was to set n = RJ_BIG - 1,
+      // but this introduces its own set of issues. Here instead we use the
+      // equations in Table 3, Case V.
+      // NOTE: TODO: Verify this section. Not yet tested.
+      if (RpRs == 0.5) {
+        lambdad = 1. / 3. - 4. / PI / 9.;
+        etad = 3. / 32.;
+      } else {
+        q = 0.5 / RpRs;
+        Kk = ellk(q);
+        Ek = ellec(q);
+        lambdad = 1. / 3. + 16. * RpRs / 9. / PI * (2. * RpRs * RpRs - 1.) * Ek - 
+                  (32. * pow(RpRs, 4) - 20. * RpRs * RpRs + 3.) / 9. / PI / 
+                  RpRs * Kk;
+        etad = 1. / 2. / PI * (kap1 + RpRs * RpRs * (RpRs * RpRs + 2. * 
+               b * b) * kap0 - (1. + 5. * RpRs * RpRs + 
+               b * b) / 4. * sqrt((1. - x1) * (x2 - 1.)));
+      }
+    } else {
+      // Business as usual.
+      q = sqrt((1. - x1)/ 4. / b / RpRs);
+      if (1. - q * q < RJ_TINY) {
+        COUNT(contact, 1);
+        // We're right on the inner contact point (to within rounding), where
+        // the elliptic integrals diverge, and `kap0` and `kap1` may not have
+        // been set. Use the limiting forms (see below).
+        lambdad = 2. / 3. / PI * acos(1. - 2. * RpRs) - 4. / 9. / PI * 
+                  sqrt(RpRs * (1. - RpRs)) * (3. + 2. * RpRs - 8. * RpRs * RpRs);
+        etad = RpRs * RpRs / 2. * (RpRs * RpRs + 2. * b * b);
+      } else {
+        Kk = ellk(q);
+        Ek = ellec(q);
+        Pk = ellpic(n, q, &iErr);
+        if (iErr != ERR_NONE) return iErr;
+        lambdad = 1. / 9. / PI / sqrt(RpRs * b) * (((1. - x2) * 
+                  (2. * x2 + x1 - 3.) - 3. * x3 * (x2 - 2.)) * Kk + 4. * 
+                  RpRs * b * ( b * b + 7. * RpRs * 
+                  RpRs - 4.) * Ek - 3. * x3 / x1 * Pk);                               // Equation (34), lambda_1
+        if (b < RpRs) lambdad += 2./3.;
+        etad = 1. / 2. / PI * (kap1 + RpRs * RpRs * 
+              (RpRs * RpRs + 2. * b * b) * kap0 - 
+              (1. + 5. * RpRs * RpRs + b * b) / 4. * 
+              sqrt((1. - x1) * (x2 - 1.)));                                           // Equation (34), eta_1
+      }
+    }
+  } else if (RpRs <= 1. && b <= (1. - RpRs) * 1.0001) {                               // [THREE] Occultor is crossing the star
+      n = x2 / x1 - 1.;
+      
+      if (1. + n > RJ_BIG) {
+        COUNT(rjbig, 1);
+        // When the impact parameter approaches RpRs, x1 tends to zero and
+        // n tends to infinity. The old approach was to set n = RJ_BIG - 1,
+        // but this introduces its own set of issues. Here instead we use the
+        // equations in Table 3, Case VI.
+        q = 2. * RpRs;
+        Kk = ellk(q);
+        Ek = ellec(q);
+        lambdad = 1. / 3. + 2. / 9. / PI * (4. * (2. * RpRs * RpRs - 1.) * Ek + 
+                 (1. - 4. * RpRs * RpRs) * Kk);
+        etad = RpRs * RpRs / 2. * (RpRs * RpRs + 2. * b * b);
+      } else {
+        // Business as usual. At the inner contact point (b = 1 - RpRs) the 
+        // elliptic integrals diverge, but `lambdad` doesn't: use the limiting form.
+        q = sqrt((x2 - x1) / (1. - x1));
+        if (1. - q * q < RJ_TINY) {
+          COUNT(contact, 1);
+          lambdad = 2. / 3. / PI * acos(1. - 2. * RpRs) - 4. / 9. / PI * 
+                    sqrt(RpRs * (1. - RpRs)) * (3. + 2. * RpRs - 8. * RpRs * RpRs);
+        } else {
+          Kk = ellk(q);
+          Ek = ellec(q);
+          Pk = ellpic(n, q, &iErr);
+          if (iErr != ERR_NONE) return iErr;
+          lambdad = 2. / 9. / PI / sqrt(1. - x1) * ((1. - 5. * b * 
+                    b + RpRs * RpRs + x3 * x3) * Kk + (1. - x1) * (b 
+                    * b + 7. * RpRs * RpRs - 4.) * Ek - 3. * x3 / x1 * Pk);           // Equation (34), lambda_2   
+          if (b < RpRs) lambdad += 2./3.;
+        }
+        etad = RpRs * RpRs / 2. * (RpRs * RpRs + 2. * b * b);                         // Equation (34), eta_2
+      }
+  }
+  
+  *lambdae_ = lambdae;
+  *lambdad_ = lambdad;
+  *etad_ = etad;
+  return iErr;
+}
+
+/*
+    --- VECTORIZED FLUX KERNEL ---
+    
+    The functions below evaluate the occultation functions on blocks of
+    FLUX_LANES impact parameters at a time. Every loop over `l` is 
+    straight-line code with a fixed trip count, so the compiler turns it 
+    into AVX2/AVX-512 instructions (or SSE2 pairs in the portable build). 
+    Points are sorted by occultation case beforehand so that all lanes of 
+    a block follow the same branch; the iterative elliptic integrals run 
+    all lanes in lock-step, masking the ones that have already converged.
+*/
+
+static inline double LogV(double x) {
+  /*
+      A branch-free natural logarithm the compiler can vectorize. Valid
+      for positive, normal `x`; good to a couple of ulp, which is far 
+      better than the Hastings approximations that use it.
+  */
+  union {double d; long long i;} u;
+  double m, s, s2, e, big;
+  u.d = x;
+  e = (double)(int)((u.i >> 52) & 0x7ff) - 1023.;
+  u.i = (u.i & 0x000fffffffffffffLL) | 0x3ff0000000000000LL;                          // The mantissa, in [1, 2)
+  m = u.d;
+  big = (m > 1.4142135623730951) ? 1. : 0.;                                           // Move it to [sqrt(1/2), sqrt(2))
+  m = m * (1. - 0.5 * big);
+  e = e + big;
+  s = (m - 1.) / (m + 1.);
+  s2 = s * s;
+  return e * 0.6931471805599453 + 2. * s * (1. + s2 * (1./3. + s2 * (1./5. + 
+         s2 * (1./7. + s2 * (1./9. + s2 * (1./11. + s2 * (1./13. + s2 * (1./15. + 
+         s2 * (1./17. + s2 * (1./19. + s2 * (1./21.)))))))))));
+}
+
+static void EllBlock(const double *k, double *Kk, double *Ek) {
+  /*
+      Complete elliptic integrals of the first and second kind (same
+      Hastings approximations as `ellk` and `ellec`) for a block of lanes.
+      The two share a single logarithm.
+  */
+  int l;
+  LANES
+  for (l = 0; l < FLUX_LANES; l++) {
+    double m1 = 1. - k[l] * k[l];
+    double lm = LogV(m1);
+    Kk[l] = 1.38629436112 + m1 * (0.09666344259 + m1 * (0.03590092383 + 
+            m1 * (0.03742563713 + m1 * 0.01451196212))) - (0.5 + m1 * 
+            (0.12498593597 + m1 * (0.06880248576 + m1 * (0.03328355346 + 
+            m1 * 0.00441787012)))) * lm;
+    Ek[l] = 1. + m1 * (0.44325141463 + m1 * (0.06260601220 + m1 * 
+            (0.04757383546 + m1 * 0.01736506451))) - m1 * (0.24998368310 + 
+            m1 * (0.09200180037 + m1 * (0.04069697526 + m1 * 0.00526449639))) * lm;
+  }
+}
+
+static void PiBlock(const double *n, const double *k, double *res, int *bad) {
+  /*
+      The complete elliptic integral of the third kind, Pi(-n, k), for a
+      block of lanes (see `ellpic`). The lanes iterate in lock-step until
+      they've all converged; lanes outside the domain are flagged as `bad`.
+  */
+  double kc[FLUX_LANES], p[FLUX_LANES], m0[FLUX_LANES], c[FLUX_LANES];
+  double d[FLUX_LANES], e[FLUX_LANES];
+  int go[FLUX_LANES];
+  int i, l, more;
+  
+  COUNT(piblocks, 1);
+  LANES
+  for (l = 0; l < FLUX_LANES; l++) {
+    bad[l] = (1. - k[l] * k[l] < RJ_TINY) | (1. + n[l] < RJ_TINY);
+    go[l] = !bad[l];
+    kc[l] = bad[l] ? 1. : sqrt(1. - k[l] * k[l]);                                     // A dummy value that converges right away
+    p[l] = bad[l] ? 1. : sqrt(1. + n[l]);
+    m0[l] = 1.;
+    c[l] = 1.;
+    d[l] = 1. / p[l];
+    e[l] = kc[l];
+  }
+  for (i = 0; i < ELLPIC_MAXIT; i++) {
+    COUNT(piblockit, 1);
+    more = 0;
+    LANES_ANY
+    for (l = 0; l < FLUX_LANES; l++) {
+      double f = c[l];
+      double g = e[l] / p[l];
+      double cn = d[l] / p[l] + f;
+      double dn = 2. * (f * g + d[l]);
+      double pn = g + p[l];
+      double mn = kc[l] + m0[l];
+      int again = go[l] & (fabs(1. - kc[l] / m0[l]) > ELLPIC_TOL);
+      double kn = 2. * sqrt(e[l]);
+      c[l] = go[l] ? cn : c[l];
+      d[l] = go[l] ? dn : d[l];
+      p[l] = go[l] ? pn : p[l];
+      m0[l] = go[l] ? mn : m0[l];
+      kc[l] = again ? kn : kc[l];
+      e[l] = again ? kn * mn : e[l];
+      go[l] = again;
+      more |= again;
+    }
+    if (!more) break;
+  }
+  LANES
+  for (l = 0; l < FLUX_LANES; l++) {
+    bad[l] |= go[l];                                                                  // Didn't converge
+    res[l] = 0.5 * PI * (c[l] * m0[l] + d[l]) / (m0[l] * (m0[l] + p[l]));
+  }
+}
+
+static void InsideBlock(const double *b, double RpRs, double *lambdae, double *lambdad, double *etad, int *bad) {
+  /*
+      Case [THREE]: the occultor is entirely inside the stellar disk
+  */
+  double x1[FLUX_LANES], x3[FLUX_LANES], n[FLUX_LANES], q[FLUX_LANES];
+  double Kk[FLUX_LANES], Ek[FLUX_LANES], Pk[FLUX_LANES];
+  double p2 = RpRs * RpRs;
+  int l;
+  LANES
+  for (l = 0; l < FLUX_LANES; l++) {
+    double x2 = SQR(RpRs + b[l]);
+    x1[l] = SQR(RpRs - b[l]);
+    x3[l] = p2 - b[l] * b[l];
+    n[l] = x2 / x1[l] - 1.;
+    q[l] = sqrt((x2 - x1[l]) / (1. - x1[l]));
+  }
+  EllBlock(q, Kk, Ek);
+  PiBlock(n, q, Pk, bad);
+  LANES
+  for (l = 0; l < FLUX_LANES; l++) {
+    lambdae[l] = p2;
+    lambdad[l] = 2. / 9. / PI / sqrt(1. - x1[l]) * ((1. - 5. * b[l] * b[l] + p2 + 
+                 x3[l] * x3[l]) * Kk[l] + (1. - x1[l]) * (b[l] * b[l] + 7. * p2 - 4.) * 
+                 Ek[l] - 3. * x3[l] / x1[l] * Pk[l]);                                 // Equation (34), lambda_2
+    lambdad[l] += (b[l] < RpRs) ? 2./3. : 0.;
+    etad[l] = p2 / 2. * (p2 + 2. * b[l] * b[l]);                                      // Equation (34), eta_2
+  }
+}
+
+static void LimbBlock(const double *b, double RpRs, double *lambdae, double *lambdad, double *etad, int *bad) {
+  /*
+      Case [TWO]: the occultor is crossing the stellar limb
+  */
+  double x1[FLUX_LANES], x2[FLUX_LANES], x3[FLUX_LANES], n[FLUX_LANES], q[FLUX_LANES];
+  double Kk[FLUX_LANES], Ek[FLUX_LANES], Pk[FLUX_LANES];
+  double kap0[FLUX_LANES], kap1[FLUX_LANES];
+  double p2 = RpRs * RpRs;
+  int l;
+  for (l = 0; l < FLUX_LANES; l++) {                                                  // These two don't vectorize, but they're cheap
+    kap1[l] = acos(fmin((1. - p2 + b[l] * b[l]) / 2. / b[l], 1.));
+    kap0[l] = acos(fmin((p2 + b[l] * b[l] - 1.) / 2 / RpRs / b[l], 1.));
+  }
+  LANES
+  for (l = 0; l < FLUX_LANES; l++) {
+    x1[l] = SQR(RpRs - b[l]);
+    x2[l] = SQR(RpRs + b[l]);
+    x3[l] = p2 - b[l] * b[l];
+    lambdae[l] = (p2 * kap0[l] + kap1[l] - 0.5 * sqrt(fmax(4. * b[l] * b[l] - 
+                 SQR(1. - x3[l]), 0.))) / PI;                                         // Equation (26)
+    n[l] = 1. / x1[l] - 1.;
+    q[l] = sqrt((1. - x1[l]) / 4. / b[l] / RpRs);
+  }
+  EllBlock(q, Kk, Ek);
+  PiBlock(n, q, Pk, bad);
+  LANES
+  for (l = 0; l < FLUX_LANES; l++) {
+    lambdad[l] = 1. / 9. / PI / sqrt(RpRs * b[l]) * (((1. - x2[l]) * (2. * x2[l] + 
+                 x1[l] - 3.) - 3. * x3[l] * (x2[l] - 2.)) * Kk[l] + 4. * RpRs * b[l] * 
+                 (b[l] * b[l] + 7. * p2 - 4.) * Ek[l] - 3. * x3[l] / x1[l] * Pk[l]);  // Equation (34), lambda_1
+    lambdad[l] += (b[l] < RpRs) ? 2./3. : 0.;
+    etad[l] = 1. / 2. / PI * (kap1[l] + p2 * (p2 + 2. * b[l] * b[l]) * kap0[l] - 
+              (1. + 5. * p2 + b[l] * b[l]) / 4. * sqrt((1. - x1[l]) * (x2[l] - 1.))); // Equation (34), eta_1
+  }
+}
+
+int FluxKernel(const double *b, const double *z, int n, double RpRs, double *lambdae, double *lambdad, double *etad) {
+  /*
+      Computes the occultation functions `lambdae`, `lambdad` and `etad`
+      for the `n` impact parameters `b`. Points behind the star (`z > 0`)
+      or off the stellar disk get zeros. `z` may be NULL.
+  */
+  int idx[2][FLUX_CHUNK], cnt[2];
+  double bb[FLUX_LANES], le[FLUX_LANES], ld[FLUX_LANES], ed[FLUX_LANES];
+  int bad[FLUX_LANES];
+  double x1, x2;
+  int c, i, k, l, m, j;
   int iErr = ERR_NONE;
+  void (*block[2])(const double *, double, double *, double *, double *, int *) = {InsideBlock, LimbBlock};
+  
+  for (c = 0; c < n; c += FLUX_CHUNK) {
+    m = (n - c < FLUX_CHUNK) ? n - c : FLUX_CHUNK;
+    cnt[0] = 0;
+    cnt[1] = 0;
+    
+    // Sort the points by occultation case
+    for (i = c; i < c + m; i++) {
+      x1 = SQR(RpRs - b[i]);
+      x2 = SQR(RpRs + b[i]);
+      if (((z != NULL) && (z[i] > 0)) || (b[i] > 1. + RpRs)) {                        // No occultation
+        COUNT(outside, 1);
+        lambdae[i] = 0.;
+        lambdad[i] = 0.;
+        etad[i] = 0.;
+      } else if ((RpRs < 1.) && (((b[i] > 0.5 + fabs(RpRs - 0.5)) && (b[i] < 1. + RpRs)) || 
+                 ((RpRs > 0.5) && (b[i] > fabs(1. - RpRs) * 1.0001) && (b[i] < RpRs))) &&
+                 (1. / x1 <= RJ_BIG)) {                                               // [TWO] Crossing the limb
+        idx[1][cnt[1]++] = i;
+      } else if ((b[i] <= 1. - RpRs) && 
+                 (x2 / x1 <= RJ_BIG)) {                                               // [THREE] Inside the disk
+        idx[0][cnt[0]++] = i;
+      } else {                                                                        // Everything else is rare, so we use the scalar code
+        COUNT(special, 1);
+        iErr = FluxPoint(b[i], RpRs, &lambdae[i], &lambdad[i], &etad[i]);
+        if (iErr != ERR_NONE) return iErr;
+      }
+    }
+    
+    // Now process each case in blocks of FLUX_LANES
+    COUNT(inside, cnt[0]);
+    COUNT(limb, cnt[1]);
+    for (k = 0; k < 2; k++) {
+      for (j = 0; j < cnt[k]; j += FLUX_LANES) {
+        for (l = 0; l < FLUX_LANES; l++)
+          bb[l] = b[idx[k][(j + l < cnt[k]) ? j + l : j]];                            // Pad the last block with copies of its first point
+        block[k](bb, RpRs, le, ld, ed, bad);
+        for (l = 0; (l < FLUX_LANES) && (j + l < cnt[k]); l++) {
+          i = idx[k][j + l];
+          if (bad[l]) {                                                               // Let the scalar code deal with it (and flag the error)
+            COUNT(special, 1);
+            iErr = FluxPoint(b[i], RpRs, &lambdae[i], &lambdad[i], &etad[i]);
+            if (iErr != ERR_NONE) return iErr;
+          } else {
+            lambdae[i] = le[l];
+            lambdad[i] = ld[l];
+            etad[i] = ed[l];
+          }
+        }
+      }
+    }
+  }
+  
+  return iErr;
+}
+
+/*
+    --- GRADIENTS ---
+    
+    The derivatives of the flux with respect to the radius ratio and the
+    impact parameter follow from differentiating the occulted flux, an
+    integral over the overlap of the two disks, under the integral sign:
+    only the planet's limb moves, so each is a line integral of the 
+    intensity along the part of the limb that's inside the star. For
+    quadratic limb darkening these reduce to complete elliptic integrals.
+*/
+
+static void EllipticKE(double m, double *K, double *E) {
+  /*
+      The complete elliptic integrals of the first and second kind, for the
+      parameter `0 <= m < 1`, by the arithmetic-geometric mean. This is
+      accurate to rounding, unlike the Hastings approximations in `ellk` 
+      and `ellec`, which matters for their (small) differences below.
+  */
+  double a = 1., g = sqrt(1. - m), c, tmp, pw = 0.5, sum = 0.5 * m;
+  int i;
+  
+  for (i = 0; (i < 64) && (fabs(a - g) > 1.e-15 * a); i++) {
+    c = 0.5 * (a - g);
+    tmp = 0.5 * (a + g);
+    g = sqrt(a * g);
+    a = tmp;
+    pw *= 2.;
+    sum += pw * c * c;
+  }
+  *K = PI / (2. * a);
+  *E = *K * (1. - sum);
+}
 
-  arr->time = malloc(settings->maxpts*sizeof(double)); 
-  arr->flux = malloc(settings->maxpts*sizeof(double)); 
-  arr->M = malloc(settings->maxpts*sizeof(double)); 
-  arr->E = malloc(settings->maxpts*sizeof(double)); 
-  arr->f = malloc(settings->maxpts*sizeof(double)); 
-  arr->r = malloc(settings->maxpts*sizeof(double)); 
-  arr->x = malloc(settings->maxpts*sizeof(double)); 
-  arr->y = malloc(settings->maxpts*sizeof(double)); 
-  arr->z = malloc(settings->maxpts*sizeof(double)); 
-  arr->b = malloc(settings->maxpts*sizeof(double)); 
-  arr->calloc = 1;
+static void EllipticSeries(double n, double *E, double *H) {
+  /*
+      The complete elliptic integral of the second kind, `E(n)`, and 
+      `H(n) = ((n - 2) E(n) + 2 (1 - n) K(n)) / (3 n^2)`, summed as power
+      series in `n`, for small `n`, where the latter cancels catastrophically
+  */
+  double ak, ek, ak1 = 1., ek1 = 1., nk = 1., nh = 1., term;
+  int k;
+  
+  *E = 1.;
+  *H = 0.;
+  for (k = 1; k < 64; k++) {
+    ak = ak1 * SQR((2. * k - 1.) / (2. * k));                                         // The coefficients of K(n), divided by pi / 2...
+    ek = -ak / (2. * k - 1.);                                                         // ...and of E(n)
+    nk *= n;
+    *E += ek * nk;
+    if (k >= 2) {
+      term = (ek1 - 2. * ek + 2. * ak - 2. * ak1) * nh;
+      *H += term;
+      if (fabs(term) < 1.e-17) break;
+      nh *= n;
+    }
+    ak1 = ak;
+    ek1 = ek;
+  }
+  *E *= PI / 2.;
+  *H *= PI / 6.;
+}
 
-  if (settings->exppts % 2) return ERR_EXP_PTS;                                       // Verify user input: Must be even!
+static void FluxGrad(double b, double RpRs, double u1, double u2, double omega, double *dp, double *db) {
+  /*
+      The derivatives of the flux with respect to the radius ratio `RpRs`,
+      stored in `dp`, and with respect to the impact parameter `b`, divided
+      by `b`, stored in `db`. The latter is finite at `b = 0`, where we'll 
+      need it, since the flux is even in `b`.
+  */
+  double p = RpRs, a = 1. - b * b - p * p, q = 2. * b * p, s = a + q;
+  double c0 = 1. - u1 - u2, c1 = u1 + 2. * u2, c2 = -u2;
+  double J0, J1, J2, J0c, J1c, J2c, J0cc, K, E, H, m, phi, cphi;
+  
+  *dp = *db = 0.;
+  if (b >= 1. + p) return;                                                            // No occultation
+  if (b + p <= 1.) {                                                                  // The planet's entirely inside the disk
+    m = 2. * q / s;
+    if (m < GRAD_SERIES)
+      EllipticSeries(m, &E, &H);
+    else if (m < 1.) {
+      EllipticKE(m, &K, &E);
+      H = ((m - 2.) * E + 2. * (1. - m) * K) / (3. * m * m);
+    } else {                                                                          // Touching the limb, where (1 - m) K vanishes
+      E = 1.;
+      H = (m - 2.) / (3. * m * m);
+    }
+    J0 = 2. * PI;
+    J1 = 4. * sqrt(s) * E;
+    J2 = a * J0;
+    J0c = 0.;
+    J1c = 16. * p * H / sqrt(s);                                                      // These three are divided by `b`
+    J2c = -2. * PI * p;
+  } else {                                                                            // Crossing the limb
+    m = s / (2. * q);
+    cphi = DMAX(-1., DMIN(1., a / q));
+    phi = acos(cphi);
+    if (m < 1.) EllipticKE(m, &K, &E);
+    else {
+      K = 0.;
+      E = 1.;
+    }
+    J0 = 2. * (PI - phi);
+    J0c = -2. * sin(phi);
+    J0cc = PI - phi - sin(phi) * cphi;
+    J1 = 4. * sqrt(2. * q) * (E - (1. - m) * K);
+    J1c = 4. * sqrt(2. * q) / 3. * ((1. - 2. * m) * E - (1. - m) * K);
+    J2 = a * J0 - q * J0c;
+    J2c = (a * J0c - q * J0cc) / b;
+    J0c /= b;
+    J1c /= b;
+  }
+  *dp = -p * (c0 * J0 + c1 * J1 + c2 * J2) / (PI * omega);
+  *db = -p * (c0 * J0c + c1 * J1c + c2 * J2c) / (PI * omega);
+}
 
+int Setup(const TRANSIT *transit, const LIMBDARK *limbdark, PARAMS *par) {
+  /*
+      Validates the user input and computes the derived orbital and limb
+      darkening parameters. The inputs are never modified.
+  */
+  double au, bu, u1, u2, c1 = 0., c3 = 0., per, RpRs, MpMs, aRs, w, ecc, fi;
+  int i;
+  
   if (limbdark->ldmodel == QUADRATIC) {                                               // Verify user input: Limb darkening model
     u1 = limbdark->u1;
     u2 = limbdark->u2;
@@ -305,8 +1226,11 @@ int Compute(TRANSIT *transit, LIMBDARK *limbdark, SETTINGS *settings, ARRAYS *ar
     u2 = au*(1 - bu);    
     if (isnan(u1) || isnan(u2)) return ERR_LD;
   } else if (limbdark->ldmodel == NONLINEAR) {
-    // TODO: Implement this!
-    return ERR_NOT_IMPLEMENTED;
+    c1 = limbdark->c1;
+    c3 = limbdark->c3;
+    u1 = limbdark->c2 + 2. * limbdark->c4;                                            // The integer powers of mu, as a quadratic law
+    u2 = -limbdark->c4;
+    if (isnan(c1) || isnan(c3) || isnan(u1) || isnan(u2)) return ERR_LD;
   } else {
     return ERR_NOT_IMPLEMENTED;
   }
@@ -314,337 +1238,1681 @@ int Compute(TRANSIT *transit, LIMBDARK *limbdark, SETTINGS *settings, ARRAYS *ar
   per = transit->per;                                                                 // Orbital period
   if (!(per > 0.)) return ERR_PER;
   
+  if (transit->ntrans) {                                                              // Transit times, when given
+    if (transit->tN == NULL) return ERR_T0;
+    for (i = 0; i < transit->ntrans; i++) {
+      if ((i > 0) && !(transit->tN[i] >= transit->tN[i - 1])) return ERR_T0;          // They must be sorted
+      if (transit->dur && !(transit->dur[i] > 0.)) return ERR_EPOCH;
+    }
+  }
+  
   RpRs = transit->RpRs;                                                               // Planet radius in units of stellar radius
   if (!((RpRs > 0.) && (RpRs < 1.))) return ERR_RADIUS;
   
-  if (isnan(transit->MpMs)) transit->MpMs = 0.;                                       // We'll assume the secondary is massless
+  MpMs = transit->MpMs;
+  if (isnan(MpMs)) MpMs = 0.;                                                         // We'll assume the secondary is massless
   
   if (isnan(transit->rhos)) {                                                         // Stellar density
     if (isnan(transit->aRs)) return ERR_RHOS_ARS;
     else aRs = transit->aRs;
   } else {
     if (transit->rhos <= 0.) return ERR_RHOS;
-    aRs = pow(((G * transit->rhos * (1. + transit->MpMs) * 
+    aRs = pow(((G * transit->rhos * (1. + MpMs) * 
           pow(per * DAYSEC, 2)) / (3. * PI)), 1./3.);                                 // Semi-major axis in units of stellar radius
-    transit->aRs = aRs;
   }
   
-  inc = acos(transit->bcirc / aRs);                                                   // Orbital inclination
-  
   if (isnan(transit->esw) || isnan(transit->ecw)) {                                   // Eccentricity and longitude of pericenter
     if (isnan(transit->ecc)) return ERR_ECC_W;
-    if ((transit->ecc != 0) && isnan(transit->w)) 
-      return ERR_ECC_W;
-    else if (transit->ecc == 0)
-      transit->w = 0;
-    else if (isnan(transit->w))
-      return ERR_ECC_W;                           
-    if ((transit->ecc < 0) || (transit->ecc >= 1)) return ERR_ECC_W;
-    if ((transit->w < 0) || (transit->w >= 2 * PI)) return ERR_ECC_W;
-    w = transit->w;
     ecc = transit->ecc;
+    w = transit->w;
+    if ((ecc != 0) && isnan(w)) 
+      return ERR_ECC_W;
+    else if (ecc == 0)
+      w = 0;
+    if ((ecc < 0) || (ecc >= 1)) return ERR_ECC_W;
+    if ((w < 0) || (w >= 2 * PI)) return ERR_ECC_W;
   } else {
     w = atan2(transit->esw, transit->ecw);
     ecc = sqrt(transit->esw * transit->esw + transit->ecw * transit->ecw);
     if ((ecc < 0.) || (ecc >= 1.)) return ERR_BAD_ECC;
-    transit->ecc = ecc;
-    transit->w = w;
   }
   
+  par->per = per;
+  par->RpRs = RpRs;
+  par->MpMs = MpMs;
+  par->aRs = aRs;
+  par->inc = acos(transit->bcirc / aRs);                                              // Orbital inclination
+  par->ecc = ecc;
+  par->w = w;
+  par->u1 = u1;
+  par->u2 = u2;
+  par->c1 = c1;
+  par->c3 = c3;
+  par->omega = 1. - u1/3. - u2/6. - c1/5. - 3. * c3/7.;                               // See Mandel and Agol (2002)
+  
   // HACK: My definition of omega in the equations below is apparently
   // off by 180 degrees from Laura Kreidberg's in BATMAN. This isn't elegant,
   // but the two models agree now that I added the following line:
   w = w - PI;
   
   fi = (3. * PI / 2.) - w;                                                            // True anomaly at transit center (Shields et al. 2015)
-  tperi0 = per * sqrt(1. - ecc * ecc) / (2. * PI) * (ecc * sin(fi) / 
-           (1. + ecc * cos(fi)) - 2. / sqrt(1. - ecc * ecc) * 
-           atan2(sqrt(1. - ecc * ecc) * tan(fi/2.), 1. + ecc));                       // Time of pericenter passage (Shields et al. 2015)
+  par->tperi0 = per * sqrt(1. - ecc * ecc) / (2. * PI) * (ecc * sin(fi) / 
+                (1. + ecc * cos(fi)) - 2. / sqrt(1. - ecc * ecc) * 
+                atan2(sqrt(1. - ecc * ecc) * tan(fi/2.), 1. + ecc));                  // Time of pericenter passage (Shields et al. 2015)
+  
+  return ERR_NONE;
+}
 
-  omega = 1. - u1/3. - u2/6.;                                                         // See Mandel and Agol (2002)
-  dt = settings->exptime / settings->exppts;                                          // The time step
+typedef struct {
+  double M;
+  double E;
+  double f;
+  double r;
+  double b;
+  double z;
+} ORBIT;
+
+static inline int OrbitFinish(const PARAMS *par, ORBIT *o) {
+  /*
+      Solves for the rest of the orbit once we know the eccentric anomaly
+  */
+  double w = par->w - PI;                                                             // See the HACK note in Setup()
+  double ecc = par->ecc;
+  double sinwf;
   
-  for (s = -1; s <= 1; s+=2) {                                                        // Sign: -1 or +1
-    t = 0.;
-    for (i = settings->maxpts/2; ((i < settings->maxpts) && (i >= 0)) ; i+=s) {                           // Loop over all points. Start from transit center and go left, then right
-         
-      /*
-      --- ORBITAL SOLUTION ---
-      */
-      
-      arr->time[i] = t;
-      arr->M[i] = 2. * PI / per * (arr->time[i] - tperi0);                            // Mean anomaly
-      if (settings->kepsolver == MDFAST)
-        arr->E[i] = EccentricAnomalyFast(arr->M[i], ecc, settings->keptol, 
-                                         settings->maxkepiter);                       // Eccentric anomaly
+  o->f = TrueAnomaly(o->E, ecc);                                                      // True anomaly
+  o->r = par->aRs * (1. - ecc * ecc)/(1. + ecc * cos(o->f));                          // Star-planet separation in units of stellar radius
+  if (o->r - par->RpRs < 1.) return ERR_STAR_CROSS;                                   // Star-crossing orbit!
+  sinwf = sin(w + o->f);
+  o->b = o->r * sqrt(1. - pow(sinwf * sin(par->inc), 2.));                            // Instantaneous impact parameter                                   
+  o->z = o->r * sinwf;                                                                // Sky-projected coordinate along the line of sight
+  return ERR_NONE;
+}
+
+static inline int OrbitPoint(double t, const PARAMS *par, const SETTINGS *settings, ORBIT *o) {
+  /*
+      Solves for the position of the planet at time `t` since transit center
+  */
+  o->M = 2. * PI / par->per * (t - par->tperi0);                                      // Mean anomaly
+  if (settings->kepsolver == MDFAST)
+    o->E = EccentricAnomalyFast(o->M, par->ecc, settings->keptol, 
+                                settings->maxkepiter);                                // Eccentric anomaly
+  else
+    o->E = EccentricAnomaly(o->M, par->ecc, settings->keptol, settings->maxkepiter);
+  if (o->E == -1) return ERR_KEPLER;
+  return OrbitFinish(par, o);
+}
+
+/*
+    --- ORBIT KERNELS ---
+    
+    `OrbitSolve()` is written once, but inlined into a separate kernel for
+    each Kepler solver (and for circular orbits) with `solver` a constant,
+    so each one is compiled without the checks on the settings the others
+    need. `OrbitKernel()` picks one for the whole call, after which the 
+    loops over the points don't branch on the settings at all.
+*/
+
+typedef int (*ORBITFN)(const double *t, int n, const PARAMS *par, const SETTINGS *settings, const KEPLER *kep, KEPSTATS *stats, ORBIT *o, int *err);
+
+static int OrbitBatch(const double *t, int n, const PARAMS *par, const SETTINGS *settings, const KEPLER *kep, KEPSTATS *stats, ORBIT *o, int *err) {
+  /*
+      The batch (Halley) branch of `OrbitSolve()`: finds all the eccentric
+      anomalies at once, so it needs the mean anomalies in a contiguous
+      array. Only this branch uses it, so it lives in its own frame.
+  */
+  double M[KEPLER_CHUNK], E[KEPLER_CHUNK];
+  int i, iErr;
+  
+  if (n <= 0) return ERR_NONE;                                                        // Nothing to solve (and `M` would be unset)
+  for (i = 0; i < n; i++)
+    M[i] = 2. * PI / par->per * (t[i] - par->tperi0);                                 // Mean anomaly
+  iErr = EccentricAnomalyBatch(M, n, kep, settings->keptol, settings->maxkepiter, E, stats);
+  if (iErr != ERR_NONE) return iErr;
+  for (i = 0; i < n; i++) {
+    o[i].M = M[i];
+    o[i].E = E[i];
+    err[i] = OrbitFinish(par, &o[i]);
+  }
+  return ERR_NONE;
+}
+
+static inline int OrbitSolve(const double *t, int n, const PARAMS *par, const SETTINGS *settings, const KEPLER *kep, KEPSTATS *stats, ORBIT *o, int *err, const int solver) {
+  /*
+      Solves for the position of the planet at the `n` (at most 
+      KEPLER_CHUNK) times `t` with the Kepler `solver`. Circular orbits 
+      (`solver` is zero) don't need one at all: the anomalies are all the 
+      same, and the separation is `aRs`. With the batch solver (`kep` 
+      holds its starter table), all the eccentric anomalies are found at 
+      once. Errors that only concern a single point (like a star-crossing
+      orbit) are stored in `err`, since the caller may not need all of 
+      them; anything else is returned.
+  */
+  double w = par->w - PI, sini = sin(par->inc), sinwf;                                // See the HACK note in Setup()
+  int i, cross;
+  
+  if (solver == 0) {
+    cross = (par->aRs - par->RpRs < 1.) ? ERR_STAR_CROSS : ERR_NONE;                  // Star-crossing orbit!
+    for (i = 0; i < n; i++) {
+      o[i].M = 2. * PI / par->per * (t[i] - par->tperi0);                             // Mean anomaly
+      o[i].E = o[i].M;
+      o[i].f = o[i].M;
+      o[i].r = par->aRs;
+      sinwf = sin(w + o[i].f);
+      o[i].b = o[i].r * sqrt(1. - pow(sinwf * sini, 2.));                             // Same as `OrbitFinish()`
+      o[i].z = o[i].r * sinwf;
+      err[i] = cross;
+    }
+    return ERR_NONE;
+  }
+  if (solver != HALLEY) {
+    for (i = 0; i < n; i++) {
+      o[i].M = 2. * PI / par->per * (t[i] - par->tperi0);                             // Mean anomaly
+      if (solver == MDFAST)
+        o[i].E = EccentricAnomalyFast(o[i].M, par->ecc, settings->keptol, settings->maxkepiter);
       else
-        arr->E[i] = EccentricAnomaly(arr->M[i], ecc, settings->keptol, 
-                                     settings->maxkepiter);
-      if (arr->E[i] == -1) return ERR_KEPLER;
-      arr->f[i] = TrueAnomaly(arr->E[i], ecc);                                        // True anomaly
-      arr->r[i] = aRs * (1. - ecc * ecc)/(1. + ecc * cos(arr->f[i]));                 // Star-planet separation in units of stellar radius
-      if (arr->r[i] - RpRs < 1.) return ERR_STAR_CROSS;                               // Star-crossing orbit!
-      arr->b[i] = arr->r[i] * sqrt(1. - pow(sin(w + arr->f[i]) * sin(inc), 2.));      // Instantaneous impact parameter                                   
-      arr->x[i] = arr->r[i] * cos(w + arr->f[i]);                                     // Cartesian sky-projected coordinates
-      arr->z[i] = arr->r[i] * sin(w + arr->f[i]);
-      if (arr->b[i] * arr->b[i] - arr->x[i] * arr->x[i] < 1.e-10) 
-        arr->y[i] = 0.;                                                               // Prevent numerical errors
-      else {
-        tmp = modulus(arr->f[i] + w, 2 * PI);                                         // TODO: Verify this modulus
-        arr->y[i] = sqrt(arr->b[i] * arr->b[i] - arr->x[i] * arr->x[i]);
-        if (!((0 < tmp) && (tmp < PI))) arr->y[i] *= -1;
+        o[i].E = EccentricAnomaly(o[i].M, par->ecc, settings->keptol, settings->maxkepiter);
+      err[i] = (o[i].E == -1) ? ERR_KEPLER : OrbitFinish(par, &o[i]);
+    }
+    return ERR_NONE;
+  }
+  return OrbitBatch(t, n, par, settings, kep, stats, o, err);
+}
+
+#define ORBIT_KERNEL(name, solver) \
+  static int name(const double *t, int n, const PARAMS *par, const SETTINGS *settings, const KEPLER *kep, KEPSTATS *stats, ORBIT *o, int *err) { \
+    return OrbitSolve(t, n, par, settings, kep, stats, o, err, solver); \
+  }
+
+ORBIT_KERNEL(OrbitCircular, 0)
+ORBIT_KERNEL(OrbitFast, MDFAST)
+ORBIT_KERNEL(OrbitNewton, NEWTON)
+ORBIT_KERNEL(OrbitHalley, HALLEY)
+
+static ORBITFN OrbitKernel(const PARAMS *par, const SETTINGS *settings, const KEPLER *kep) {
+  /*
+      The orbit kernel for these parameters and settings. Without a 
+      starter table `kep`, the batch solver falls back on Newton's method,
+      as `OrbitPoint()` does.
+  */
+  if (par->ecc == 0.) return OrbitCircular;
+  if ((settings->kepsolver == HALLEY) && (kep != NULL)) return OrbitHalley;
+  if (settings->kepsolver == MDFAST) return OrbitFast;
+  return OrbitNewton;
+}
+
+static inline void SkyXY(const ORBIT *o, double w, double *x, double *y) {
+  /*
+      The Cartesian sky-projected coordinates of the planet
+  */
+  double tmp;
+  *x = o->r * cos(w + o->f);
+  if (o->b * o->b - *x * *x < 1.e-10) 
+    *y = 0.;                                                                          // Prevent numerical errors
+  else {
+    tmp = modulus(o->f + w, 2 * PI);                                                  // TODO: Verify this modulus
+    *y = sqrt(o->b * o->b - *x * *x);
+    if (!((0 < tmp) && (tmp < PI))) *y *= -1;
+  }
+}
+
+static inline double GridTime(const ARRAYS *arr, int i) {
+  /*
+      The time of grid point `i`, which is implicit on a uniform grid
+  */
+  return arr->dt ? arr->tstart + (i - arr->nstart) * arr->dt : arr->time[i];
+}
+
+static inline void StorePoint(ARRAYS *arr, int i, double t, const ORBIT *o, int outputs, int keepz) {
+  /*
+      Stores the orbital solution `o` at index `i` of the arrays, but only
+      the bits we were asked for. Uniform grids don't store the time.
+  */
+  if (!arr->dt) arr->time[i] = t;
+  if (outputs & OUT_M) arr->M[i] = o->M;
+  if (outputs & OUT_E) arr->E[i] = o->E;
+  if (outputs & OUT_F) arr->f[i] = o->f;
+  if (outputs & OUT_R) arr->r[i] = o->r;
+  if (keepz) {
+    arr->b[i] = o->b;
+    arr->z[i] = o->z;
+  } else 
+    arr->b[i] = (o->z > 0) ? HUGE_VAL : o->b;                                         // Behind the star: no occultation
+  if (outputs & (OUT_X | OUT_Y)) 
+    SkyXY(o, arr->par.w - PI, &arr->x[i], &arr->y[i]);
+}
+
+static inline int Occultation(const SETTINGS *settings, const double *b, const double *z, int n, double RpRs, double *lambdae, double *lambdad, double *etad) {
+  /*
+      The occultation functions, either analytic or from the lookup table
+  */
+  if (settings->fluxmethod == TABLE)
+    return FluxTableKernel(b, z, n, RpRs, lambdae, lambdad, etad);
+  return FluxKernel(b, z, n, RpRs, lambdae, lambdad, etad);
+}
+
+static inline int HalfBasis(const PARAMS *par, const double *b, const double *z, int n, const double *lambdae, double *d1, double *d3) {
+  /*
+      The half-integer occultation functions of the nonlinear law, less
+      `lambdae`, for `n <= FLUX_CHUNK` points, from the lookup table
+  */
+  double lambda1[FLUX_CHUNK], lambda3[FLUX_CHUNK];
+  int j, iErr;
+  
+  iErr = NonlinearKernel(b, z, n, par->RpRs, lambda1, lambda3);
+  if (iErr != ERR_NONE) return iErr;
+  for (j = 0; j < n; j++) {
+    d1[j] = lambda1[j] - lambdae[j];
+    d3[j] = lambda3[j] - lambdae[j];
+  }
+  return ERR_NONE;
+}
+
+static inline int HalfTerms(const PARAMS *par, const double *b, const double *z, int n, const double *lambdae, double *half) {
+  /*
+      The extra flux occulted under the nonlinear law, over and above its
+      integer powers of mu, for `n <= FLUX_CHUNK` points. Zero for the 
+      other laws.
+  */
+  double d1[FLUX_CHUNK], d3[FLUX_CHUNK];
+  int j, iErr;
+  
+  if ((par->c1 == 0.) && (par->c3 == 0.)) {
+    for (j = 0; j < n; j++) half[j] = 0.;
+    return ERR_NONE;
+  }
+  iErr = HalfBasis(par, b, z, n, lambdae, d1, d3);
+  if (iErr != ERR_NONE) return iErr;
+  for (j = 0; j < n; j++)
+    half[j] = par->c1 * d1[j] + par->c3 * d3[j];
+  return ERR_NONE;
+}
+
+static inline void ComposeLoop(const PARAMS *par, int lo, int hi, ARRAYS *arr, const int basis) {
+  /*
+      The transit flux on the grid points `lo` through `hi`, from the 
+      occultation functions kept in `arr` by `ComputeGrid()`. It's linear
+      in them, with coefficients that depend only on the limb darkening.
+      The half-integer terms are only added if `basis` is BASIS_HALF.
+  */
+  double u1 = par->u1, u2 = par->u2, omega = par->omega, half = 0.;
+  int i;
+  
+  for (i = lo; i <= hi; i++) {
+    if (basis == BASIS_HALF) half = par->c1 * arr->lam1[i] + par->c3 * arr->lam3[i];
+    arr->flux[i] = 1. - ((1. - u1 - 2. * u2) * arr->lame[i] + (u1 + 2. * u2) * 
+                   arr->lamd[i] + u2 * arr->etad[i] + half) / omega;                  // Finally, the transit flux (baseline = 1.)
+  }
+}
+
+#define COMPOSE_KERNEL(name, basis) \
+  static void name(const PARAMS *par, int lo, int hi, ARRAYS *arr) { \
+    ComposeLoop(par, lo, hi, arr, basis); \
+  }
+
+COMPOSE_KERNEL(ComposeInt, BASIS_INT)
+COMPOSE_KERNEL(ComposeHalf, BASIS_HALF)
+
+static void ComposeFlux(const PARAMS *par, int lo, int hi, ARRAYS *arr) {
+  /*
+      Composes the flux with the loop for the basis of the limb darkening
+      law, so the loop itself doesn't test it
+  */
+  if (arr->basis == BASIS_HALF) ComposeHalf(par, lo, hi, arr);
+  else ComposeInt(par, lo, hi, arr);
+}
+
+static int FluxAt(double t, const PARAMS *par, const SETTINGS *settings, ORBIT *o, double *flux) {
+  /*
+      The orbital solution and the transit flux at a single time `t`
+  */
+  double lambdae, lambdad, etad, half;
+  int iErr;
+  
+  iErr = OrbitPoint(t, par, settings, o);
+  if (iErr != ERR_NONE) return iErr;
+  if ((o->z > 0) || (o->b > 1. + par->RpRs)) {
+    *flux = 1.;
+    return ERR_NONE;
+  }
+  if (settings->fluxmethod == TABLE)
+    iErr = FluxTableKernel(&o->b, NULL, 1, par->RpRs, &lambdae, &lambdad, &etad);
+  else
+    iErr = FluxPoint(o->b, par->RpRs, &lambdae, &lambdad, &etad);
+  if (iErr != ERR_NONE) return iErr;
+  iErr = HalfTerms(par, &o->b, NULL, 1, &lambdae, &half);
+  *flux = 1. - ((1. - par->u1 - 2. * par->u2) * lambdae + (par->u1 + 2. * par->u2) * 
+          lambdad + par->u2 * etad + half) / par->omega;
+  return iErr;
+}
+
+static int Contact(double tin, double tout, double target, int outer, const PARAMS *par, const SETTINGS *settings, double *tc) {
+  /*
+      Bisects for the time at which the impact parameter crosses `target`,
+      given a time `tin` on the inside and a time `tout` on the outside. If
+      `outer` is set, points behind the star count as outside, too. Returns
+      the outside end of the final bracket.
+  */
+  ORBIT o;
+  double tm;
+  int i, iErr;
+  
+  for (i = 0; (i < ADAPTIVE_MAXITER) && (fabs(tout - tin) > ADAPTIVE_TTOL * par->per); i++) {
+    tm = 0.5 * (tin + tout);
+    iErr = OrbitPoint(tm, par, settings, &o);
+    if (iErr != ERR_NONE) return iErr;
+    if ((o.b > target) || (outer && (o.z > 0))) tout = tm;
+    else tin = tm;
+  }
+  *tc = tout;
+  return ERR_NONE;
+}
+
+static int Edge(int s, const PARAMS *par, const SETTINGS *settings, double *tc) {
+  /*
+      Finds the time of first (`s = -1`) or last (`s = 1`) contact by 
+      stepping away from transit center in steps that double in size 
+      until we're out of transit, then bisecting
+  */
+  ORBIT o;
+  double tin = 0., tout, dt = ADAPTIVE_DT0 * par->per;
+  int iErr;
+  
+  for (;;) {
+    tout = s * fmin(dt, par->per / 2.);
+    iErr = OrbitPoint(tout, par, settings, &o);
+    if (iErr != ERR_NONE) return iErr;
+    if ((o.b > 1. + par->RpRs) || (o.z > 0) || (dt >= par->per / 2.)) break;
+    tin = tout;
+    dt *= 2.;
+  }
+  return Contact(tin, tout, 1. + par->RpRs, 1, par, settings, tc);
+}
+
+static int Symmetric(const PARAMS *par, const SETTINGS *settings, double thalf) {
+  /*
+      Is the light curve symmetric about transit center? Circular orbits
+      are exactly symmetric. Otherwise, if `settings->symtol > 0`, we compare
+      the impact parameter at `SYM_PROBES` pairs of times within `thalf` of
+      transit center; since the flux can't change faster than
+      2 RpRs Imax / (pi omega) per unit impact parameter, this bounds the
+      difference between the two halves of the light curve. Returns
+      `SYM_EXACT`, `SYM_APPROX`, or zero if it's not symmetric (or if
+      `settings->symtol < 0`, which disables the mirroring altogether).
+  */
+  ORBIT op, om;
+  double dfdb, t;
+  int k;
+
+  if (settings->symtol < 0) return 0;
+  if (par->ecc == 0.) return SYM_EXACT;
+  if (!((settings->symtol > 0) && (thalf > 0))) return 0;
+  dfdb = 2. * par->RpRs * (1. + fabs(par->u1) + fabs(par->u2) + fabs(par->c1) + 
+         fabs(par->c3)) / (PI * par->omega);                                          // Bound on the slope of the flux with respect to the impact parameter
+  for (k = 1; k <= SYM_PROBES; k++) {
+    t = k * thalf / SYM_PROBES;
+    if (OrbitPoint(t, par, settings, &op) != ERR_NONE) return 0;                      // Let the full calculation report any errors
+    if (OrbitPoint(-t, par, settings, &om) != ERR_NONE) return 0;
+    if ((op.b > 1. + par->RpRs) && (om.b > 1. + par->RpRs)) continue;                 // No flux change on either side
+    if ((op.z > 0) != (om.z > 0)) return 0;
+    if (fabs(op.b - om.b) * dfdb > settings->symtol) return 0;
+  }
+  return SYM_APPROX;
+}
+
+static int Mirror(const SETTINGS *settings, const KEPLER *kep, int c, int n, int outputs, int keepz, int sym, ARRAYS *arr) {
+  /*
+      Fills in the `n` points to the right of transit center (index `c`) by
+      reflecting the ones on the left. The flux is always reflected. If the
+      orbit is exactly symmetric, so are the orbital arrays (the angles are
+      odd about their values at transit center, as is `x`); otherwise, any
+      that were requested are solved for.
+  */
+  ORBIT o[KEPLER_CHUNK];
+  double t[KEPLER_CHUNK];
+  int err[KEPLER_CHUNK];
+  int i, j, k, m, iErr;
+  int solve = (sym != SYM_EXACT) && (outputs & ~(OUT_FLUX | OUT_BFLX));
+  ORBITFN orbit = OrbitKernel(&arr->par, settings, kep);
+
+  for (i = c + 1; i <= c + n; i++) {
+    m = 2 * c - i;
+    if (!arr->dt) arr->time[i] = -arr->time[m];
+    arr->flux[i] = arr->flux[m];
+    if (solve) continue;
+    if (keepz) {
+      arr->b[i] = arr->b[m];
+      arr->z[i] = arr->z[m];
+    }
+    if (outputs & OUT_M) arr->M[i] = 2. * arr->M[c] - arr->M[m];
+    if (outputs & OUT_E) arr->E[i] = 2. * arr->E[c] - arr->E[m];
+    if (outputs & OUT_F) arr->f[i] = 2. * arr->f[c] - arr->f[m];
+    if (outputs & OUT_R) arr->r[i] = arr->r[m];
+    if (outputs & (OUT_X | OUT_Y)) {
+      arr->x[i] = -arr->x[m];
+      arr->y[i] = arr->y[m];
+    }
+  }
+  for (i = c + 1; solve && (i <= c + n); i += KEPLER_CHUNK) {
+    k = IMIN(c + n + 1 - i, KEPLER_CHUNK);
+    for (j = 0; j < k; j++) 
+      t[j] = arr->dt ? (i + j - c) * arr->dt : arr->time[i + j];
+    iErr = orbit(t, k, &arr->par, settings, kep, &arr->kep, o, err);
+    if (iErr != ERR_NONE) return iErr;
+    for (j = 0; j < k; j++) {
+      if (err[j] != ERR_NONE) return err[j];
+      StorePoint(arr, i + j, t[j], &o[j], outputs, keepz);
+    }
+  }
+  arr->nsym = c;
+  return ERR_NONE;
+}
+
+typedef struct {
+  double ta;
+  double tb;
+  double fa;
+  double fb;
+  ORBIT oa;
+  ORBIT ob;
+  int depth;
+} SPAN;
+
+static inline int Bends(const ORBIT *a, const ORBIT *m, const ORBIT *b, double tol) {
+  /*
+      Is the orbit between `a` and `b` further than `tol` times the 
+      separation from the straight line between them at their midpoint 
+      `m`? The sky coordinates are a rotation of the ones in the orbital 
+      plane, so they're interpolated to the same accuracy.
+  */
+  double dx = m->r * cos(m->f) - 0.5 * (a->r * cos(a->f) + b->r * cos(b->f));
+  double dy = m->r * sin(m->f) - 0.5 * (a->r * sin(a->f) + b->r * sin(b->f));
+  return dx * dx + dy * dy > SQR(tol * m->r);
+}
+
+static int ComputeAdaptive(const SETTINGS *settings, int outputs, int keepz, ARRAYS *arr) {
+  /*
+      Computes the transit model on an adaptive grid. We find the four 
+      contact points, then recursively bisect the intervals between them
+      until the flux is linear to within `settings->fluxtol`. Points are 
+      concentrated where the light curve is curved (ingress and egress) 
+      and the grid spans the transit plus half an exposure on each side, 
+      so there's no need for `maxpts` tuning. In full orbit mode, the grid
+      goes on to half a period either side of transit center (which needn't
+      be a transit, then), and every interval is also bisected until the
+      orbit is straight to within `settings->orbtol` of the separation, so
+      it's coarse out of transit, and finest near pericenter.
+  */
+  const PARAMS *par = &arr->par;
+  double seeds[9], h, tc, t1 = 0., t4 = 0., dt, fc, fa, tol = settings->fluxtol;
+  ORBIT oc, oa;
+  SPAN stack[ADAPTIVE_SEEDS + ADAPTIVE_MAXDEPTH + 1], sp, left, right;
+  int nseeds = 0, top, n = 0, j, k, m, flat, sym, transit, iErr;
+  int full = settings->fullorbit;
+  
+  arr->nsym = 0;
+  iErr = FluxAt(0., par, settings, &oc, &fc);                                         // Transit center
+  if (iErr != ERR_NONE) return iErr;
+  transit = (oc.b <= 1. + par->RpRs) && (oc.z <= 0);
+  if (!(transit || full)) return ERR_NO_TRANSIT;                                      // There's no transit!
+  if (full && !(settings->orbtol > 0)) return ERR_NOT_IMPLEMENTED;
+  
+  h = 0.5 * settings->exptime;                                                        // The binning needs half an exposure on each side
+  if (full) seeds[nseeds++] = -0.5 * par->per;
+  if (transit) {
+    iErr = Edge(-1, par, settings, &t1);
+    if (iErr != ERR_NONE) return iErr;
+    if ((h > 0) && (!full || (t1 - h > seeds[0]))) seeds[nseeds++] = t1 - h;
+    seeds[nseeds++] = t1;
+    if (oc.b < 1. - par->RpRs) {                                                      // Second and third contacts
+      iErr = Contact(0., seeds[nseeds - 1], 1. - par->RpRs, 0, par, settings, &tc);
+      if (iErr != ERR_NONE) return iErr;
+      seeds[nseeds++] = tc;
+    }
+  }
+  seeds[nseeds++] = 0.;
+  sym = (outputs & OUT_GRAD) ? 0 : Symmetric(par, settings, -seeds[0]);               // The gradients aren't symmetric
+  if (full && (sym != SYM_EXACT)) sym = 0;                                            // Nor is the rest of an eccentric orbit
+  if (!sym) {                                                                         // Otherwise we only need the left half
+    if (transit) {
+      iErr = Edge(1, par, settings, &t4);
+      if (iErr != ERR_NONE) return iErr;
+      if (oc.b < 1. - par->RpRs) {
+        iErr = Contact(0., t4, 1. - par->RpRs, 0, par, settings, &seeds[nseeds++]);
+        if (iErr != ERR_NONE) return iErr;
+      }
+      seeds[nseeds++] = t4;
+      if ((h > 0) && (!full || (t4 + h < 0.5 * par->per))) seeds[nseeds++] = t4 + h;
+    }
+    if (full) seeds[nseeds++] = 0.5 * par->per;
+  }
+  
+  iErr = FluxAt(seeds[0], par, settings, &oa, &fa);
+  if (iErr != ERR_NONE) return iErr;
+  for (k = 0; k < nseeds - 1; k++) {
+    
+    // Split each interval into a few pieces to start with, so we don't miss anything.
+    // The flux is flat off the ends of the transit, so unless we're following the
+    // orbit, the half exposures there need no more points.
+    flat = !transit || (seeds[k + 1] <= t1) || (!sym && (seeds[k] >= t4));
+    m = (flat && !full) ? 1 : ADAPTIVE_SEEDS;
+    dt = (seeds[k + 1] - seeds[k]) / m;
+    for (top = 0; top < m; top++) {                                                   // Push them right to left...
+      j = m - 1 - top;
+      stack[top].ta = seeds[k] + j * dt;
+      stack[top].tb = (j == m - 1) ? seeds[k + 1] : seeds[k] + (j + 1) * dt;
+      stack[top].depth = (flat && !full) ? ADAPTIVE_MAXDEPTH : 0;
+    }
+    for (j = top - 1; j >= 0; j--) {                                                  // ...and chain the end points left to right
+      stack[j].fa = fa;
+      stack[j].oa = oa;
+      iErr = FluxAt(stack[j].tb, par, settings, &stack[j].ob, &stack[j].fb);
+      if (iErr != ERR_NONE) return iErr;
+      fa = stack[j].fb;
+      oa = stack[j].ob;
+    }
+    
+    while (top > 0) {                                                                 // Depth-first, left first, so the points come out sorted
+      sp = stack[--top];
+      if (sp.depth < ADAPTIVE_MAXDEPTH) {
+        left.ta = sp.ta;
+        left.fa = sp.fa;
+        left.oa = sp.oa;
+        left.tb = 0.5 * (sp.ta + sp.tb);
+        iErr = FluxAt(left.tb, par, settings, &left.ob, &left.fb);
+        if (iErr != ERR_NONE) return iErr;
+        if ((fabs(left.fb - 0.5 * (sp.fa + sp.fb)) > tol) || 
+            (full && Bends(&sp.oa, &left.ob, &sp.ob, settings->orbtol))) {            // Not linear enough: split it in two
+          right.ta = left.tb;
+          right.fa = left.fb;
+          right.oa = left.ob;
+          right.tb = sp.tb;
+          right.fb = sp.fb;
+          right.ob = sp.ob;
+          right.depth = left.depth = sp.depth + 1;
+          stack[top++] = right;
+          stack[top++] = left;
+          continue;
+        }
+        if (n + 2 > settings->maxpts) return ERR_MAX_PTS;
+        arr->flux[n] = sp.fa;
+        StorePoint(arr, n++, sp.ta, &sp.oa, outputs, keepz);
+        arr->flux[n] = left.fb;                                                       // We might as well keep the midpoint
+        StorePoint(arr, n++, left.tb, &left.ob, outputs, keepz);
+      } else {
+        if (n + 1 > settings->maxpts) return ERR_MAX_PTS;
+        arr->flux[n] = sp.fa;
+        StorePoint(arr, n++, sp.ta, &sp.oa, outputs, keepz);
       }
-      t += s*dt;                                                                      // Increment the time
+    }
+  }
+  if (n + 1 > settings->maxpts) return ERR_MAX_PTS;
+  arr->flux[n] = fa;                                                                  // The very last point
+  StorePoint(arr, n++, seeds[nseeds - 1], &oa, outputs, keepz);
+  if (sym) {                                                                          // The last point was transit center
+    if (2 * n - 1 > settings->maxpts) return ERR_MAX_PTS;
+    iErr = Mirror(settings, NULL, n - 1, n - 1, outputs, keepz, sym, arr);
+    if (iErr != ERR_NONE) return iErr;
+    n = 2 * n - 1;
+  }
+  
+  arr->nstart = 0;
+  arr->nend = n;
+  arr->outputs = outputs | OUT_FLUX | OUT_BFLX;
+  arr->computed = 1;
+  return ERR_NONE;
+}
+
+static int GradPass(const TRANSIT *transit, const SETTINGS *settings, ARRAYS *arr) {
+  /*
+      Differentiates the flux on the grid with respect to each of the NGRAD
+      parameters, by the chain rule: through the Kepler solve (implicitly,
+      so we don't iterate again), the sky projection and the occultation 
+      functions. This needs the true anomaly, the separation, and the real
+      impact parameter and `z` at every point, and the orbit mustn't have 
+      been mirrored, since the derivatives aren't symmetric. The derivatives
+      with respect to `esw` and `ecw` are given whichever way the orbit was
+      specified, and those with respect to the limb darkening are for `u1`
+      and `u2`.
+  */
+  const PARAMS *par = &arr->par;
+  double lambdae[FLUX_CHUNK], lambdad[FLUX_CHUNK], etad[FLUX_CHUNK];
+  double de[NGRAD] = {0}, dw[NGRAD] = {0}, di[NGRAD] = {0}, dMc[NGRAD] = {0};
+  double dM[NGRAD], df[NGRAD], dr[NGRAD], du[NGRAD], g[NGRAD];
+  double e = par->ecc, w = par->w - PI, aRs = par->aRs, RpRs = par->RpRs;
+  double n = 2. * PI / par->per, si = sin(par->inc), ci = cos(par->inc);
+  double u1 = par->u1, u2 = par->u2, omega = par->omega;
+  double sq = sqrt(1. - e * e), fc, qc, fM, fe, rhoe, rhof;
+  double t, f, r, q, S, C, dp, db, N;
+  size_t stride = arr->nalloc;
+  int i, j, k, m, iErr;
+  
+  iErr = GradWorkspace(arr);
+  if (iErr != ERR_NONE) return iErr;
+  
+  di[GRAD_BCIRC] = -1. / (aRs * si);                                                  // The inclination, from cos(inc) = bcirc / aRs
+  di[GRAD_ARS] = ci / (aRs * si);
+  if (e >= GRAD_ECC) {
+    de[GRAD_ESW] = sin(par->w);                                                       // The eccentricity and the longitude of pericenter
+    de[GRAD_ECW] = cos(par->w);
+    dw[GRAD_ESW] = cos(par->w) / e;
+    dw[GRAD_ECW] = -sin(par->w) / e;
+    fc = 1.5 * PI - w;                                                                // The mean anomaly at transit center, at fixed true anomaly `fc`
+    qc = 1. + e * cos(fc);
+    for (k = 0; k < NGRAD; k++)
+      dMc[k] = -sin(fc) * sq * (2. + e * cos(fc)) / (qc * qc) * de[k] - 
+               sq * sq * sq / (qc * qc) * dw[k];
+  }
+  
+  for (i = arr->nstart; i < arr->nend; i += FLUX_CHUNK) {
+    m = IMIN(arr->nend - i, FLUX_CHUNK);
+    iErr = Occultation(settings, arr->b + i, arr->z + i, m, RpRs, lambdae, lambdad, etad);
+    if (iErr != ERR_NONE) return iErr;
+    for (j = 0; j < m; j++) {
+      for (k = 0; k < NGRAD; k++) g[k] = 0.;
+      if ((arr->z[i + j] <= 0) && (arr->b[i + j] < 1. + RpRs)) {
       
-      if (!settings->fullorbit) {                                                     // We're only calculating stuff during transit
-        if ((arr->b[i] > 1. + RpRs) || (arr->z[i] > 0)) {                             // Check if we're done transiting, or if it's a secondary eclipse (which we ignore)
-          arr->flux[i] = 1.;                                                          // That's easy!
+        // The orbit
+        t = GridTime(arr, i + j);
+        f = arr->f[i + j];
+        r = arr->r[i + j];
+        for (k = 0; k < NGRAD; k++) dM[k] = df[k] = dr[k] = du[k] = 0.;
+        if (e >= GRAD_ECC) {
+          q = 1. + e * cos(f);
+          fM = q * q / (sq * sq * sq);                                                // The true anomaly at fixed eccentricity...
+          fe = sin(f) * (2. + e * cos(f)) / (sq * sq);                                // ...and at fixed mean anomaly
+          rhoe = (-2. * e * q - sq * sq * cos(f)) / (q * q);                          // The separation, in units of `aRs`
+          rhof = sq * sq * e * sin(f) / (q * q);
+          for (k = 0; k < NGRAD; k++) {
+            dM[k] = dMc[k];
+            if (k == GRAD_PER) dM[k] -= n * t / par->per;
+            else if (k == GRAD_T0) dM[k] -= n;
+            df[k] = fM * dM[k] + fe * de[k];
+            dr[k] = aRs * (rhoe * de[k] + rhof * df[k]);
+            du[k] = dw[k] + df[k];
+          }
+          dr[GRAD_ARS] += r / aRs;
+        } else {                                                                      // The circular limit, to first order in `esw` and `ecw`
+          du[GRAD_PER] = -n * t / par->per;
+          du[GRAD_T0] = -n;
+          du[GRAD_ESW] = 2. * sin(n * t);
+          du[GRAD_ECW] = 2. * (cos(n * t) - 1.);
+          dr[GRAD_ARS] = 1.;
+          dr[GRAD_ESW] = -aRs * cos(n * t);
+          dr[GRAD_ECW] = aRs * sin(n * t);
+        }
+        
+        // The impact parameter and the occultation functions
+        S = sin(w + f);
+        C = cos(w + f);
+        FluxGrad(arr->b[i + j], RpRs, u1, u2, omega, &dp, &db);
+        for (k = 0; k < NGRAD; k++)
+          g[k] = db * (r * dr[k] * (1. - SQR(S * si)) - 
+                 r * r * (S * C * si * si * du[k] + S * S * si * ci * di[k]));        // d(flux)/db times d(b^2)/2 over b
+        g[GRAD_RPRS] = dp;
+        
+        // The limb darkening
+        N = (1. - u1 - 2. * u2) * lambdae[j] + (u1 + 2. * u2) * lambdad[j] + u2 * etad[j];
+        g[GRAD_U1] = -((lambdad[j] - lambdae[j]) * omega + N / 3.) / (omega * omega);
+        g[GRAD_U2] = -((2. * lambdad[j] - 2. * lambdae[j] + etad[j]) * omega + N / 6.) / 
+                     (omega * omega);
+      }
+      if (!isnan(transit->rhos)) {                                                    // The semi-major axis came from the density and the period
+        g[GRAD_PER] += 2. * aRs / (3. * par->per) * g[GRAD_ARS];
+        g[GRAD_ARS] *= aRs / (3. * transit->rhos);
+      }
+      for (k = 0; k < NGRAD; k++) arr->grad[k * stride + i + j] = g[k];
+    }
+  }
+  return ERR_NONE;
+}
+
+static int ComputeGrid(const TRANSIT *transit, const LIMBDARK *limbdark, const SETTINGS *settings, int outputs, ARRAYS *arr){
+  /*
+      Compute the transit model on the grid, storing only the arrays in the
+      `outputs` bitmask (the time and flux arrays are always stored). The 
+      impact parameter is also used as scratch space for the flux 
+      calculation when neither `b` nor `z` are requested: points behind the
+      star get an infinite impact parameter, so the flux kernel doesn't 
+      need `z`.
+  */    
+  double per, RpRs, t;
+  double dt;
+  ORBIT o;
+  int keepz;
+  double tb[KEPLER_CHUNK];
+  ORBIT ob[KEPLER_CHUNK];
+  int eb[KEPLER_CHUNK];
+  KEPLER kep;
+  ORBITFN orbit;
+  int i, k, s, lo, hi, nb, jb, ahead, sym = 0;
+  const int fullorbit = settings->fullorbit, exppts = settings->exppts;               // Loop invariants, which the stores to `arr` would otherwise reload
+  int c = settings->maxpts/2;
+  int np = 0, nm = 0, npctr = 0, nmctr = 0;
+  int iErr = ERR_NONE;
+
+  arr->computed = 0;
+  arr->binned = 0;
+  arr->integrated = 0;
+  arr->nsym = 0;
+  arr->basis = 0;
+  arr->dt = 0.;                                                                       // Only uniform grids set this
+  memset(&arr->kep, 0, sizeof(KEPSTATS));
+  if (outputs == 0) outputs = OUT_ALL;                                                // Zero means everything
+  if (outputs & OUT_GRAD) outputs |= OUT_F | OUT_R | OUT_B | OUT_Z;                   // The gradients need these
+  keepz = outputs & (OUT_B | OUT_Z);                                                  // The flux kernel needs `z` if `b` is the real thing
+  iErr = Workspace(arr, settings->maxpts);                                            // Reuses the arena from the last call if it's big enough
+  if (iErr != ERR_NONE) return iErr;
+
+  if ((settings->gridmethod != ADAPTIVE) && (settings->exppts % 2)) 
+    return ERR_EXP_PTS;                                                               // Verify user input: Must be even!
+  
+  iErr = Setup(transit, limbdark, &arr->par);
+  if (iErr != ERR_NONE) return iErr;
+  if (settings->gridmethod == ADAPTIVE) {
+    return ComputeAdaptive(settings, outputs, keepz, arr);
+  }
+  iErr = BasisWorkspace(arr);
+  if (iErr != ERR_NONE) return iErr;
+  
+  if (settings->kepsolver == HALLEY) {
+    iErr = KeplerStarter(arr->par.ecc, &kep);
+    if (iErr != ERR_NONE) return iErr;
+  }
+  orbit = OrbitKernel(&arr->par, settings, &kep);                                     // Picked once for the whole grid
+  ahead = (orbit == OrbitHalley) || (orbit == OrbitCircular);                         // These gain from solving ahead: the rest go point by point
+  per = arr->par.per;
+  RpRs = arr->par.RpRs;
+  dt = settings->exptime / exppts;                                                    // The time step
+  arr->dt = dt;                                                                       // The grid is implicit: point `i` is at `(i - c) * dt`
+  
+  for (s = -1; s <= 1; s+=2) {                                                        // Sign: -1 or +1
+    if ((s == 1) && (nm > 0) && !(outputs & OUT_GRAD)) {                              // The gradients aren't symmetric
+      sym = Symmetric(&arr->par, settings, fullorbit ? per/2. : (c - nm) * dt);
+      if (sym) break;                                                                 // We'll mirror the left half instead
+    }
+    t = 0.;
+    nb = jb = 0;
+    for (i = c; ((i < settings->maxpts) && (i >= 0)) ; i+=s) {                        // Loop over all points. Start from transit center and go left, then right
+         
+      /*
+      --- ORBITAL SOLUTION ---
+      */
+      
+      if (jb == nb) {                                                                 // Solve for the next few points at once
+        nb = 1;
+        if (ahead)
+          nb = IMIN(IMAX(abs(i - c) / 2, FLUX_LANES), KEPLER_CHUNK);                  // The further we've come, the further we look ahead
+        tb[0] = t;
+        for (jb = 1; jb < nb; jb++) tb[jb] = (i + s * jb - c) * dt;
+        iErr = orbit(tb, nb, &arr->par, settings, &kep, &arr->kep, ob, eb);
+        if (iErr != ERR_NONE) return iErr;
+        jb = 0;
+      }
+      if (eb[jb] != ERR_NONE) return eb[jb];
+      o = ob[jb++];
+      StorePoint(arr, i, t, &o, outputs, keepz);
+      t = (i + s - c) * dt;                                                           // Increment the time
+      
+      if (!fullorbit) {                                                               // We're only calculating stuff during transit
+        if ((o.b > 1. + RpRs) || (o.z > 0)) {                                         // Check if we're done transiting, or if it's a secondary eclipse (which we ignore)
           if (s == -1) {
+            if (nmctr++ == exppts/2) break;                                           // We want to add exppts/2 points on each side of the transit since we'll need them for binning, plus one that's mirrored onto the right in symmetric mode
             nm = i;                                                                   // We're going to truncate the array at this index on the left
-            nmctr++;                                                                  // We want to add exppts/2 points on each side of the transit
-            if (nmctr == settings->exppts/2) break;                                   // since we'll eventually need those points for binning
           } 
           else if (s == 1) {
             np = i;                                                                   // We're going to truncate the array at this index on the right
             npctr++;
-            if (npctr == settings->exppts/2 + 1) break;                               // Note the + 1 on this line to ensure the same number of points on the left and on the right
+            if (npctr == exppts/2 + 1) break;                                         // Note the + 1 on this line to ensure the same number of points on the left and on the right
           }
-          continue;
         }
       } else {
         if (fabs(t) >= per/2.) {                                                      // We're going to calculate the full orbit, but we know the flux is 1.
           if (s == -1) nm = i + 1;
           else if (s == 1) np = i - 1;
           break;
-        } else {
-          if ((arr->b[i] > 1. + RpRs) || (arr->z[i] > 0)) {                           // Ignoring secondary eclipse
-            arr->flux[i] = 1.;
-            continue;
-          }
         }
-      
       }
 
-      /*
-      --- TRANSIT FLUX ---
-      */
-      
-      x1 = pow(RpRs - arr->b[i], 2.);                                                 // Set up some quantities to compute the transit flux
-      x2 = pow(RpRs + arr->b[i], 2.);                                                 // The following is adapted from Eric Agol's fortran routines
-      x3 = RpRs * RpRs - arr->b[i]*arr->b[i];
-      x4 = RpRs * RpRs + arr->b[i]*arr->b[i];
-      
-      // 1. Compute lambdae
-      if (RpRs >= 1. && arr->b[i] <= RpRs - 1.) {                                     // [ONE] Occulting object completely occults source
-        lambdae=1.;
-      } else if (arr->b[i] > 1. - RpRs) {                                             // [TWO] Occultor is crossing the limb. Equation (26)
-        kap1 = acos(fmin((1. - x3) / 2. / arr->b[i], 1.));
-        kap0 = acos(fmin((x4 - 1.) / 2 / RpRs / arr->b[i], 1.));
-        lambdae = RpRs * RpRs * kap0 + kap1;
-        lambdae -= 0.5*sqrt(fmax(4. * arr->b[i] * arr->b[i] - pow(1. - x3, 2.), 0.));
-        lambdae /= PI;
-      } else if (arr->b[i] <= 1. - RpRs) {                                            // [THREE] Occultor is crossing the star
-        lambdae = RpRs * RpRs;
-      }
-      
-      // 2. Compute lambdad and etad
-      if (RpRs >= 1. && arr->b[i] <= RpRs - 1.) {                                     // [ONE] Occulting object completely occults source
-        lambdad=1.;
-        etad=1.;
-      } else if ((arr->b[i] > 0.5 + fabs(RpRs - 0.5) && arr->b[i] < 1. + RpRs) || 
-                 (RpRs > 0.5 && arr->b[i] > fabs(1. - RpRs) * 
-                 1.0001 && arr->b[i] < RpRs)) {                                       // [TWO] The occultor partly occults the star and crosses the limb
-        n = 1./x1 - 1.;
-        
-        if (1. + n > RJ_BIG){
-          // When the impact parameter approaches RpRs, x1 tends to zero and
-          // n tends to infinity. The old approach was to set n = RJ_BIG - 1,
-          // but this introduces its own set of issues. Here instead we use the
-          // equations in Table 3, Case V.
-          // NOTE: TODO: Verify this section. Not yet tested.
-          if (RpRs == 0.5) {
-            lambdad = 1. / 3. - 4. / PI / 9.;
-            etad = 3. / 32.;
-          } else {
-            lam = 0.5 * PI;
-            q = 0.5 / RpRs;
-            Kk = ellk(q);
-            Ek = ellec(q);
-            lambdad = 1. / 3. + 16. * RpRs / 9. / PI * (2. * RpRs * RpRs - 1.) * Ek - 
-                      (32. * pow(RpRs, 4) - 20. * RpRs * RpRs + 3.) / 9. / PI / 
-                      RpRs * Kk;
-            etad = 1. / 2. / PI * (kap1 + RpRs * RpRs * (RpRs * RpRs + 2. * 
-                   arr->b[i] * arr->b[i]) * kap0 - (1. + 5. * RpRs * RpRs + 
-                   arr->b[i] * arr->b[i]) / 4. * sqrt((1. - x1) * (x2 - 1.)));
-          }
-        } else {
-          // Business as usual.
-          lam = 0.5 * PI;
-          q = sqrt((1. - x1)/ 4. / arr->b[i] / RpRs);
-          Kk = ellk(q);
-          Ek = ellec(q);
-          Pk = Kk - n / 3. * rj(0., 1. - q * q, 1., 1. + n, &iErr);
-          if (iErr != ERR_NONE) return iErr;
-          lambdad = 1. / 9. / PI / sqrt(RpRs * arr->b[i]) * (((1. - x2) * 
-                    (2. * x2 + x1 - 3.) - 3. * x3 * (x2 - 2.)) * Kk + 4. * 
-                    RpRs * arr->b[i] * ( arr->b[i] * arr->b[i] + 7. * RpRs * 
-                    RpRs - 4.) * Ek - 3. * x3 / x1 * Pk);                             // Equation (34), lambda_1
-          if (arr->b[i] < RpRs) lambdad += 2./3.;
-          etad = 1. / 2. / PI * (kap1 + RpRs * RpRs * 
-                (RpRs * RpRs + 2. * arr->b[i] * arr->b[i]) * kap0 - 
-                (1. + 5. * RpRs * RpRs + arr->b[i] * arr->b[i]) / 4. * 
-                sqrt((1. - x1) * (x2 - 1.)));                                         // Equation (34), eta_1
-        }
-      } else if (RpRs <= 1. && arr->b[i] <= (1. - RpRs) * 1.0001) {                   // [THREE] Occultor is crossing the star
-          n = x2 / x1 - 1.;
-          
-          if (1. + n > RJ_BIG) {
-            // When the impact parameter approaches RpRs, x1 tends to zero and
-            // n tends to infinity. The old approach was to set n = RJ_BIG - 1,
-            // but this introduces its own set of issues. Here instead we use the
-            // equations in Table 3, Case VI.
-            lam = 0.5 * PI;
-            q = 2. * RpRs;
-            Kk = ellk(q);
-            Ek = ellec(q);
-            lambdad = 1. / 3. + 2. / 9. / PI * (4. * (2. * RpRs * RpRs - 1.) * Ek + 
-                     (1. - 4. * RpRs * RpRs) * Kk);
-            etad = RpRs * RpRs / 2. * (RpRs * RpRs + 2. * arr->b[i] * arr->b[i]);
-          } else {
-            // Business as usual.
-            lam = 0.5 * PI;
-            q = sqrt((x2 - x1) / (1. - x1));
-            Kk = ellk(q);
-            Ek = ellec(q);
-            Pk = Kk - n / 3. * rj(0., 1. - q * q, 1., 1. + n, &iErr);
-            if (iErr != ERR_NONE) return iErr;
-            lambdad = 2. / 9. / PI / sqrt(1. - x1) * ((1. - 5. * arr->b[i] * 
-                      arr->b[i] + RpRs * RpRs + x3 * x3) * Kk + (1. - x1) * (arr->b[i] 
-                      * arr->b[i] + 7. * RpRs * RpRs - 4.) * Ek - 3. * x3 / x1 * Pk); // Equation (34), lambda_2   
-            if (arr->b[i] < RpRs) lambdad += 2./3.;
-            if (fabs(RpRs + arr->b[i] - 1.) <= 1.e-4)
-              lambdad = 2. / 3. / PI * acos(1. - 2. * RpRs) - 4. / 9. / PI * 
-                      sqrt(RpRs * (1. - RpRs)) * (3. + 2. * RpRs - 8. * RpRs * RpRs);
-            etad = RpRs * RpRs / 2. * (RpRs * RpRs + 2. * arr->b[i] * arr->b[i]);     // Equation (34), eta_2
-          }
-      }
-      
-      arr->flux[i] = 1. - ((1. - u1 - 2. * u2) * lambdae + (u1 + 2. * u2) * 
-                      lambdad + u2 * etad) / omega;                                   // Finally, the transit flux (baseline = 1.)
-
     }
   }
   
+  if (sym) {
+    np = fullorbit ? 2 * c - nm : 2 * c - nm + 1;                                     // The right edge of the unmirrored array
+    if (np >= settings->maxpts) return ERR_MAX_PTS;
+  }
   if ((nm == 0) || (np == 0)) return ERR_MAX_PTS;                                     // We didn't reach the edge of the transit within settings->maxpts
   if ((nm >= settings->maxpts/2 - settings->exppts/2 - 1) && 
       (np <= settings->maxpts/2 + settings->exppts/2 +  1)) 
     return ERR_NO_TRANSIT;                                                            // There's no transit!
+  
+  /*
+  --- TRANSIT FLUX ---
+  */
+  
+  lo = sym ? 2 * c - np : nm;                                                         // Only the left half in symmetric mode
+  hi = sym ? c : np;
+  for (i = lo; i <= hi; i += FLUX_CHUNK) {                                            // The flux kernel works on contiguous blocks of impact parameters
+    k = (hi + 1 - i < FLUX_CHUNK) ? hi + 1 - i : FLUX_CHUNK;
+    iErr = Occultation(settings, arr->b + i, keepz ? arr->z + i : NULL, k, RpRs, 
+                       arr->lame + i, arr->lamd + i, arr->etad + i);                  // Kept, so the flux can be recomposed for other limb darkening
+    if (iErr != ERR_NONE) return iErr;
+    if ((arr->par.c1 != 0.) || (arr->par.c3 != 0.)) {
+      iErr = HalfBasis(&arr->par, arr->b + i, keepz ? arr->z + i : NULL, k, 
+                       arr->lame + i, arr->lam1 + i, arr->lam3 + i);
+      if (iErr != ERR_NONE) return iErr;
+    }
+  }
+  arr->basis = ((arr->par.c1 != 0.) || (arr->par.c3 != 0.)) ? BASIS_HALF : BASIS_INT;
+  ComposeFlux(&arr->par, lo, hi, arr);
+  if (sym) {
+    iErr = Mirror(settings, &kep, c, np - c, outputs, keepz, sym, arr);
+    if (iErr != ERR_NONE) return iErr;
+  }
+  
   arr->nstart = nm;                                                                   // first index
   arr->nend = np + 1;                                                                 // one plus last index
-  settings->computed = 1;                                                             // Set the flag
+  arr->tstart = (nm - c) * dt;
+  arr->outputs = outputs | OUT_FLUX | OUT_BFLX;                                       // What's in the arrays (we can always bin)
+  arr->computed = 1;                                                                  // Set the flag
 	return iErr;
 }
 
-int Bin(TRANSIT *transit, LIMBDARK *limbdark, SETTINGS *settings, ARRAYS *arr) {
+static int ComputeOut(const TRANSIT *transit, const LIMBDARK *limbdark, const SETTINGS *settings, int outputs, ARRAYS *arr){
+  /*
+      Compute the transit model, storing only the arrays in the `outputs`
+      bitmask, and its derivatives if OUT_GRAD is set
+  */    
+  PROFSAVE saved = ProfBegin(arr, STAGE_COMPUTE);
+  int iErr;
+  
+  iErr = ComputeGrid(transit, limbdark, settings, outputs, arr);
+  if ((iErr == ERR_NONE) && (outputs & OUT_GRAD)) {
+    iErr = GradPass(transit, settings, arr);
+    if (iErr != ERR_NONE) arr->computed = 0;
+  }
+  if (iErr == ERR_NONE) GAUGE(gridpts, arr->nend - arr->nstart);
+  GAUGE(maxpts, settings->maxpts);
+  ProfEnd(saved);
+  return iErr;
+}
+
+int ComputeR(const TRANSIT *transit, const LIMBDARK *limbdark, const SETTINGS *settings, ARRAYS *arr){
+  /*
+      Compute the transit model. This is the reentrant version: the inputs
+      are never modified, and all of the state lives in `arr`. Only the
+      arrays in `settings->outputs` are stored.
+  */    
+  return ComputeOut(transit, limbdark, settings, settings->outputs, arr);
+}
+
+static void WriteBack(TRANSIT *transit, const PARAMS *par) {
+  /*
+      Writes the parameters derived by `Setup()` back into `transit`
+  */
+  if (isnan(transit->MpMs)) transit->MpMs = 0.;
+  if (!isnan(transit->rhos)) transit->aRs = par->aRs;
+  if (isnan(transit->esw) || isnan(transit->ecw)) {
+    if (transit->ecc == 0) transit->w = 0;
+  } else {
+    transit->ecc = par->ecc;
+    transit->w = par->w;
+  }
+}
+
+int Compute(TRANSIT *transit, LIMBDARK *limbdark, SETTINGS *settings, ARRAYS *arr){
+  /*
+      Compute the transit model. This is the original, non-reentrant interface:
+      it sets the `computed` flag in `settings` and writes the derived 
+      parameters back into `transit`.
+  */
+  int iErr;
+  
+  iErr = ComputeR(transit, limbdark, settings, arr);
+  if (iErr != ERR_NONE) return iErr;
+  
+  WriteBack(transit, &arr->par);
+  settings->computed = 1;
+  return iErr;
+}
+
+int Reuse(TRANSIT *transit, LIMBDARK *limbdark, SETTINGS *settings, ARRAYS *arr){
+  /*
+      Takes up the model computed (and maybe binned) earlier in `arr` with
+      the same shape parameters and settings, but perhaps a different `t0` 
+      or transit times. The grid is relative to transit center, so it 
+      doesn't depend on those: we only check them, then write the derived
+      parameters back and set the flags in `settings` like `Compute()` and
+      `Bin()` would have.
+  */
+  PARAMS par;
+  int iErr;
+  
+  if (!arr->computed) return ERR_NOT_COMPUTED;
+  iErr = Setup(transit, limbdark, &par);                                              // Validates the transit times
+  if (iErr != ERR_NONE) return iErr;
+  WriteBack(transit, &arr->par);
+  settings->computed = 1;
+  settings->binned = arr->binned;
+  return ERR_NONE;
+}
+
+int Recompose(TRANSIT *transit, LIMBDARK *limbdark, SETTINGS *settings, ARRAYS *arr){
+  /*
+      Recomposes the model computed earlier in `arr` for new limb darkening
+      coefficients, everything else being the same. The flux is a linear 
+      combination of the occultation functions, which only depend on the
+      geometry, and the uniform grid keeps them, so this is O(N): no Kepler
+      solves or elliptic integrals. Binning is linear, and just as cheap, 
+      so it's simply redone when it's next needed. Returns ERR_NOT_COMPUTED
+      if the model can't be recomposed (the grid is adaptive, so it depends
+      on the flux, or there are gradients, or the orbit is eccentric and
+      could be mirrored differently), and it must be computed from scratch.
+  */
+  PARAMS par;
+  const PARAMS *old = &arr->par;
+  int iErr, i, lo, hi;
+  
+  if (!(arr->computed && arr->basis) || (arr->outputs & OUT_GRAD)) return ERR_NOT_COMPUTED;
+  iErr = Setup(transit, limbdark, &par);
+  if (iErr != ERR_NONE) return iErr;
+  if ((par.per != old->per) || (par.RpRs != old->RpRs) || (par.MpMs != old->MpMs) || 
+      (par.aRs != old->aRs) || (par.inc != old->inc) || (par.ecc != old->ecc) || 
+      (par.w != old->w) || (par.tperi0 != old->tperi0)) return ERR_NOT_COMPUTED;      // Not the same geometry
+  if ((par.ecc != 0.) && (settings->symtol > 0)) return ERR_NOT_COMPUTED;             // Whether it's mirrored depends on the limb darkening
+  if (((par.c1 != 0.) || (par.c3 != 0.)) && (arr->basis != BASIS_HALF)) 
+    return ERR_NOT_COMPUTED;                                                          // We don't have the half-integer terms
+  
+  arr->par = par;
+  lo = arr->nsym ? 2 * arr->nsym - (arr->nend - 1) : arr->nstart;                     // Only the left half was computed in symmetric mode
+  hi = arr->nsym ? arr->nsym : arr->nend - 1;
+  ComposeFlux(&arr->par, lo, hi, arr);
+  for (i = hi + 1; arr->nsym && (i < arr->nend); i++)
+    arr->flux[i] = arr->flux[2 * arr->nsym - i];
+  arr->binned = 0;
+  arr->integrated = 0;
+  WriteBack(transit, &arr->par);
+  settings->computed = 1;
+  settings->binned = 0;
+  return ERR_NONE;
+}
+
+static int Locate(const double *x, int n, double t) {
+  /*
+      Binary search for the index `j` such that `x[j] <= t < x[j + 1]` in
+      the sorted array `x`, clamped to [0, n - 2]
+  */
+  int lo = 0, hi = n - 1, mid;
+  while (hi - lo > 1) {
+    COUNT(search, 1);
+    mid = (lo + hi) / 2;
+    if (x[mid] <= t) lo = mid;
+    else hi = mid;
+  }
+  return lo;
+}
+
+static inline int GridIndex(const ARRAYS *arr, double t) {
+  /*
+      The index `j`, relative to `nstart`, of the grid interval bracketing
+      the time `t`, clamped to the grid. On a uniform grid this is a single
+      multiply, whether or not the times we're looking up are sorted.
+  */
+  int n = arr->nend - arr->nstart, j;
+  double x;
+  
+  if (!arr->dt) return Locate(arr->time + arr->nstart, n, t);
+  x = (t - arr->tstart) / arr->dt;
+  if (!(x > 0)) return 0;
+  j = (x < n - 2) ? (int)x : n - 2;                                                   // Truncation is the floor for positive `x`
+  return j;
+}
+
+typedef struct {
+  const double *y;                                                                    // The values on the grid
+  const double *c1;                                                                   // The running integrals of `base - y`, built by `Integrate`
+  const double *c2;
+  double base;                                                                        // The value off the grid
+} SERIES;
+
+static inline SERIES Series(const ARRAYS *arr, int k) {
+  /*
+      The flux if `k` is negative, otherwise its derivative with respect
+      to parameter `k`
+  */
+  SERIES s;
+  size_t off = (size_t)k * arr->nalloc;
+  
+  if (k < 0) {
+    s.y = arr->flux;
+    s.c1 = arr->cflx;
+    s.c2 = arr->cfl2;
+    s.base = 1.;
+  } else {
+    s.y = arr->grad + off;
+    s.c1 = arr->cgrd + off;
+    s.c2 = arr->cgr2 + off;
+    s.base = 0.;
+  }
+  return s;
+}
+
+static void Cumulate(const ARRAYS *arr, const double *y, double base, double *c1, double *c2) {
+  /*
+      Builds the first and second running integrals of `base - y` over the
+      grid in `c1` and `c2`, both exact for piecewise linear `y`
+  */
+  int i;
+  double h, d0, d1;
+  
+  c1[arr->nstart] = 0.;
+  c2[arr->nstart] = 0.;
+  for (i = arr->nstart + 1; i < arr->nend; i++) {
+    h = arr->dt ? arr->dt : arr->time[i] - arr->time[i - 1];
+    d0 = base - y[i - 1];
+    d1 = base - y[i];
+    c1[i] = c1[i - 1] + 0.5 * h * (d0 + d1);
+    c2[i] = c2[i - 1] + h * c1[i - 1] + h * h * (2. * d0 + d1) / 6.;
+  }
+}
+
+static void Integrate(ARRAYS *arr) {
+  /*
+      Builds the running integrals of the flux deficit `1 - flux` over the
+      grid, once per model: `cflx` holds the first integral and `cfl2` the
+      second. Since the deficit vanishes off the transit, they stay small, 
+      so differences of them don't lose precision. The gradients, if we 
+      have them, are integrated the same way.
+  */
+  size_t off;
+  int k;
+  
+  if (arr->integrated) return;
+  Cumulate(arr, arr->flux, 1., arr->cflx, arr->cfl2);
+  for (k = 0; (arr->outputs & OUT_GRAD) && (k < NGRAD); k++) {
+    off = (size_t)k * arr->nalloc;
+    Cumulate(arr, arr->grad + off, 0., arr->cgrd + off, arr->cgr2 + off);
+  }
+  arr->integrated = 1;
+}
+
+static double Deficit(const ARRAYS *arr, const SERIES *ser, double t, double *D, double *D2) {
+  /*
+      Evaluates the integrals of the deficit `base - y` of the series `ser`
+      at the time `t`, storing them in `D` and `D2`, and returns the 
+      deficit itself. The series is `base` off either end of the grid.
+  */
+  const double *y = ser->y + arr->nstart;
+  const double *c1 = ser->c1 + arr->nstart;
+  const double *c2 = ser->c2 + arr->nstart;
+  int n = arr->nend - arr->nstart, j;
+  double dt, d0, s, t0, t1;
+  
+  if (t <= GridTime(arr, arr->nstart)) {
+    *D = *D2 = 0.;
+    return 0.;
+  }
+  t1 = GridTime(arr, arr->nend - 1);
+  if (t >= t1) {
+    *D = c1[n - 1];
+    *D2 = c2[n - 1] + c1[n - 1] * (t - t1);
+    return 0.;
+  }
+  j = GridIndex(arr, t);
+  t0 = GridTime(arr, arr->nstart + j);
+  t1 = GridTime(arr, arr->nstart + j + 1);
+  dt = t - t0;
+  d0 = ser->base - y[j];
+  s = (y[j] - y[j + 1]) / (t1 - t0);                                                  // Slope of the deficit
+  *D = c1[j] + dt * (d0 + 0.5 * s * dt);
+  *D2 = c2[j] + dt * (c1[j] + dt * (0.5 * d0 + s * dt / 6.));
+  return d0 + s * dt;
+}
+
+static double BoxAverage(const ARRAYS *arr, const SERIES *ser, double t, double h) {
+  /*
+      The exact average of the piecewise linear series `ser` over 
+      [t - h, t + h], for `h > 0`
+  */
+  double Da, Db, D2;
+  
+  Deficit(arr, ser, t - h, &Da, &D2);
+  Deficit(arr, ser, t + h, &Db, &D2);
+  return ser->base - (Db - Da) / (2. * h);
+}
+
+static double KernelAverage(const ARRAYS *arr, const SERIES *ser, double t, double w, const double *kt, const double *kv, int nk, double area) {
+  /*
+      The exact average of the piecewise linear series `ser` over the 
+      exposure kernel with knots `t + w * kt` and values `kv`, where `area`
+      is the integral of the kernel over `kt`. Integrating by parts twice, 
+      each segment of the kernel only needs the integrals of the deficit at
+      its ends, so this costs the same for any exposure time.
+  */
+  double Da, D2a, Db, D2b, h, sum = 0.;
+  int k;
+  
+  if (w <= 0) return ser->base - Deficit(arr, ser, t, &Da, &D2a);                     // Instantaneous exposure
+  Deficit(arr, ser, t + w * kt[0], &Da, &D2a);
+  for (k = 0; k < nk - 1; k++) {
+    Deficit(arr, ser, t + w * kt[k + 1], &Db, &D2b);
+    h = w * (kt[k + 1] - kt[k]);
+    if (h > 0)                                                                        // Zero-width segments are just jumps in the kernel
+      sum += kv[k + 1] * Db - kv[k] * Da - (kv[k + 1] - kv[k]) / h * (D2b - D2a);
+    Da = Db;
+    D2a = D2b;
+  }
+  return ser->base - sum / (w * area);
+}
+
+static void MirrorBins(ARRAYS *arr, int end) {
+  /*
+      Reflects the binned flux in the left half of a symmetric light curve,
+      up to and including transit center at `end - 1`, onto the right half.
+      The bin that mirrors onto the last point lies entirely outside the
+      transit, so it's unity.
+  */
+  int i, m;
+  
+  if (!arr->nsym) return;
+  for (i = end; i < arr->nend; i++) {
+    m = 2 * arr->nsym - i;
+    arr->bflx[i] = (m >= arr->nstart) ? arr->bflx[m] : 1.;
+  }
+}
+
+static void BinSeries(const SETTINGS *settings, const ARRAYS *arr, const double *y, double base, double *by, int end) {
+  /*
+      Bins the series `y` on the uniform grid to the exposure time with 
+      `binmethod`, storing it in `by`, up to (but not including) `end`. 
+      The series is `base` off the grid.
+  */
+  int i;
+  int ep = settings->exppts;                                                          // Shortcut for exppts
+  int hx = ep/2;                                                                      // The number of extra points on each side of the transit
+  int nb = ep + 1;                                                                    // Actual number of points in bin must be odd, but user doesn't need to know this!
+  
+  if (settings->binmethod == RIEMANN) {
+    by[arr->nstart] = (y[arr->nstart + hx] + ep * base) / nb;                         // Set the leftmost bin
+  
+    for (i = arr->nstart + 1; i < IMIN(arr->nstart + hx + 1, end); i++)               // For these guys, the left edge of the exposure window starts prior to where we've
+      by[i] = by[i - 1] + (y[i + hx] - base) / nb;                                    // calculated flux values, but we know that the flux is all `base` out here
+  
+    for (i = arr->nstart + hx + 1; i < IMIN(arr->nend - hx, end); i++)                // Intelligent summation to compute bins
+      by[i] = by[i - 1] + (y[i + hx] - y[i - 1 - hx]) / nb;
+  
+    for (i = arr->nend - hx; i < end; i++)                                            // Again, deal with edge effects
+      by[i] = by[i - 1] + (base - y[i - 1 - hx]) / nb;
+  
+  } else {
+    by[arr->nstart] = base + 0.5 / ep * (y[arr->nstart + hx] - base);                 // Set the leftmost bin
+
+    for (i = arr->nstart + 1; i < IMIN(arr->nstart + hx + 1, end); i++)
+      by[i] = by[i - 1] + 1. / (2 * ep) * (y[i + hx] + y[i + hx - 1] - 2. * base);
+  
+    for (i = arr->nstart + hx + 1; i < IMIN(arr->nend - hx, end); i++)
+      by[i] = by[i - 1] + 1. / (2 * ep) * (y[i + hx] + y[i + hx - 1] - 
+              y[i - hx] - y[i - hx -1]);                                              // We're essentially doing the same intelligent summation as above
+  
+    for (i = arr->nend - hx; i < end; i++)
+      by[i] = by[i - 1] + 1. / (2 * ep) * (2. * base - y[i - hx] - y[i - hx -1]);
+  }
+}
+
+static int BinModel(const SETTINGS *settings, ARRAYS *arr) {
+  /*
+      The body of `BinR()`
+  */
   int iErr = ERR_NONE;
-  int i, j, ep, nb, hx; 
-  double sum;
+  int i, j, k, ep, nb, hx, end; 
+  int ngrad = (arr->outputs & OUT_GRAD) ? NGRAD : 0;
+  size_t off;
+  double sum, *by, exptime = settings->exptime;                                       // Not reloaded after every store to `by`
+  SERIES ser;
 
-  arr->bflx = malloc(settings->maxpts*sizeof(double)); 
-  arr->balloc = 1;
+  if (!arr->computed) return ERR_NOT_COMPUTED;                                        // Must compute first!
+  end = arr->nsym ? arr->nsym + 1 : arr->nend;                                        // If the light curve is symmetric, only bin the left half and mirror it
+  
+  if (settings->gridmethod == ADAPTIVE) {                                             // Integrate the piecewise linear flux exactly
+    Integrate(arr);
+    for (k = -1; k < ngrad; k++) {                                                    // The flux, then the gradients
+      ser = Series(arr, k);
+      by = (k < 0) ? arr->bflx : arr->bgrad + (size_t)k * arr->nalloc;
+      if (exptime > 0)
+        for (i = arr->nstart; i < end; i++)
+          by[i] = BoxAverage(arr, &ser, arr->time[i], 0.5 * exptime);
+      else
+        for (i = arr->nstart; i < end; i++)
+          by[i] = ser.y[i];
+    }
+    MirrorBins(arr, end);
+    arr->binned = 1;
+    return iErr;
+  }
   
-  if (!settings->computed) return ERR_NOT_COMPUTED;                                   // Must compute first!
   ep = settings->exppts;                                                              // Shortcut for exppts
   hx = ep/2;                                                                          // The number of extra points on each side of the transit
   nb = ep + 1;                                                                        // Actual number of points in bin must be odd, but user doesn't need to know this!
   
-  if (settings->binmethod == RIEMANN) {
-    arr->bflx[arr->nstart] = (arr->flux[arr->nstart + hx] + ep) / nb;                 // Set the leftmost bin
+  if ((settings->binmethod == RIEMANN) || (settings->binmethod == TRAPEZOID)) {
+    BinSeries(settings, arr, arr->flux, 1., arr->bflx, end);
+    for (k = 0; k < ngrad; k++) {
+      off = (size_t)k * arr->nalloc;
+      BinSeries(settings, arr, arr->grad + off, 0., arr->bgrad + off, end);
+    }
+    
+  } else if (settings->binmethod == -1) {                                             // DEBUG: This is the old trapezoid routine. Use for testing only
+    if (ngrad) return ERR_NOT_IMPLEMENTED;
+    arr->bflx[arr->nstart] = 1. + 0.5 / ep * (arr->flux[arr->nstart + hx] - 1.);      // Set the leftmost bin
+
+    for (i = arr->nstart + 1; i < arr->nstart + hx + 1; i++) {
+      sum = 0;
+      for (j = i - hx + 1; j < i + hx; j++) {
+        if (j >= 0) sum += arr->flux[j];
+        else sum += 1.;
+      }
+      arr->bflx[i] = 1. / (nb - 1) * (0.5 * (1. + arr->flux[i + hx]) + sum);
+    }
+    
+    for (i = arr->nstart + hx + 1; i < arr->nend - hx; i++) {
+      sum = 0;
+      for (j = i - hx + 1; j < i + hx; j++) sum += arr->flux[j];
+      arr->bflx[i] = 1. / (nb - 1) * (0.5 * (arr->flux[i - hx] + 
+                                      arr->flux[i + hx]) + sum);
+    } 
+  
+    for (i = arr->nend - hx; i < arr->nend; i++) {
+      sum = 0;
+      for (j = i - hx + 1; j < i + hx; j++) {
+        if (j < arr->nend - arr->nstart) sum += arr->flux[j];                         // TODO: Verify this line (are we off by 1?)
+        else sum += 1.;
+      }
+      arr->bflx[i] = 1. / (nb - 1) * (0.5 * (arr->flux[i - hx] + 1.) + sum);
+    }
+  
+  } else {
+	  return ERR_NOT_IMPLEMENTED;
+	}
+  MirrorBins(arr, end);
+  
+  arr->binned = 1;                                                                    // Set the flag
+  return iErr;
+
+
+}
+
+int BinR(const TRANSIT *transit, const LIMBDARK *limbdark, const SETTINGS *settings, ARRAYS *arr) {
+  /*
+      Bin the transit model to the exposure time. This is the reentrant 
+      version. The gradients, if we have them, are binned the same way.
+  */
+  PROFSAVE saved = ProfBegin(arr, STAGE_BIN);
+  int iErr;
+  
+  (void)transit;                                                                      // Binning only needs the model and the settings
+  (void)limbdark;
+  iErr = BinModel(settings, arr);
+  ProfEnd(saved);
+  return iErr;
+}
+
+int Bin(TRANSIT *transit, LIMBDARK *limbdark, SETTINGS *settings, ARRAYS *arr) {
+  /*
+      Bin the transit model to the exposure time. This is the original, 
+      non-reentrant interface, which uses the flags in `settings`.
+  */
+  int iErr;
+  
+  if (!settings->computed) return ERR_NOT_COMPUTED;                                   // Must compute first!
+  iErr = BinR(transit, limbdark, settings, arr);
+  if (iErr != ERR_NONE) return iErr;
+  settings->binned = 1;
+  return iErr;
+}
+
+static inline int NearestEpoch(const double *tN, int n, int j, double t) {
+  /*
+      Is transit `j` of the `n` sorted transit times `tN` the nearest one 
+      to the time `t`? Ties go to the later transit.
+  */
+  if ((j > 0) && (t - tN[j - 1] < tN[j] - t)) return 0;
+  if ((j < n - 1) && (t - tN[j] >= tN[j + 1] - t)) return 0;
+  return 1;
+}
+
+static inline double Fold(const TRANSIT *transit, double t, int *nt) {
+  /*
+      The time since the center of the nearest transit. When the transit
+      times are given, `nt` is set to the index of the nearest one. On input,
+      it's a guess: if it (or the next one) is right, as it usually is for
+      sorted times, that's all it costs. Otherwise we guess again from the
+      mean period, and search for it if that fails too, so the times don't
+      need to be sorted.
+  */
+  const double *tN = transit->tN;
+  int n = transit->ntrans, j = *nt;
+  double x;
+  
+  if (!n)
+    return modulus(t - transit->t0 - transit->per/2., transit->per) - transit->per/2.; // Find the folded time, assuming strict periodicity
+  if ((j < 0) || (j >= n)) j = 0;
+  if (!NearestEpoch(tN, n, j, t)) {
+    if ((j < n - 1) && NearestEpoch(tN, n, j + 1, t)) j++;                            // We've moved on to the next transit
+    else {
+      x = (n > 1) ? (t - tN[0]) * (n - 1) / (tN[n - 1] - tN[0]) + 0.5 : 0.;           // Guess from the mean period, since TTVs are small
+      j = (x > 0) ? ((x < n - 1) ? (int)x : n - 1) : 0;
+      if (!NearestEpoch(tN, n, j, t)) {
+        j = Locate(tN, n, t);                                                         // Binary search: tN[j] <= t < tN[j + 1], clamped
+        if ((j < n - 1) && (t - tN[j] >= tN[j + 1] - t)) j++;
+      }
+    }
+  }
+  *nt = j;
+  return t - tN[j];
+}
+
+static inline double EpochDur(const TRANSIT *transit, int nt) {
+  /*
+      The duration of transit `nt` relative to the model
+  */
+  return (transit->ntrans && transit->dur) ? transit->dur[nt] : 1.;
+}
+
+static inline double EpochDep(const TRANSIT *transit, int nt) {
+  /*
+      The depth of transit `nt` relative to the model
+  */
+  return (transit->ntrans && transit->dep) ? transit->dep[nt] : 1.;
+}
+
+static int UseDirect(const double *t, int ipts, int array, const TRANSIT *transit, const SETTINGS *settings, ARRAYS *arr) {
+  /*
+      Should we evaluate the model directly at the requested times rather 
+      than on a grid? In AUTO mode, we compare the number of model 
+      evaluations each approach needs. `arr->par` must be set up.
+  */
+  const PARAMS *par = &arr->par;
+  double x, T14, ngrid, ndirect, half, ti;
+  int i, nt = 0;
+  
+  if (settings->evalmethod == DIRECT) return 1;
+  if (settings->evalmethod != AUTO) return 0;
+  if (arr->computed && (arr->outputs & (1 << array))) return 0;                       // The grid is already there, so it's free
   
-    for (i = arr->nstart + 1; i < arr->nstart + hx + 1; i++)                          // For these guys, the left edge of the exposure window starts prior to where we've
-      arr->bflx[i] = arr->bflx[i - 1] + (arr->flux[i + hx] - 1.) / nb;                // calculated flux values, but we know that the flux is all 1.0 out here
+  x = sqrt(fmax(SQR(1. + par->RpRs) - SQR(par->aRs * cos(par->inc)), 0.)) / 
+      (par->aRs * sin(par->inc));
+  T14 = par->per / PI * asin(fmin(x, 1.)) * sqrt(1. - par->ecc * par->ecc) / 
+        (1. + par->ecc * sin(par->w));                                                // Approximate transit duration
+  if (settings->gridmethod == ADAPTIVE) {
+    ngrid = DIRECT_ADAPTIVE_PTS / sqrt(settings->fluxtol) + 4 * DIRECT_CONTACT_PTS;   // Roughly what the adaptive grid needs
+    if (settings->fullorbit) ngrid += 2. * PI / sqrt(2. * settings->orbtol);          // Twice the points of a circle's chords, since we keep the midpoints
+  } else
+    ngrid = ((settings->fullorbit ? par->per : T14) + settings->exptime) * 
+            settings->exppts / settings->exptime;
+  if ((array != ARR_FLUX) && (array != ARR_BFLX)) return ipts < ngrid;
   
-    for (i = arr->nstart + hx + 1; i < arr->nend - hx; i++)                           // Intelligent summation to compute bins
-      arr->bflx[i] = arr->bflx[i - 1] + 
-                    (arr->flux[i + hx] - arr->flux[i - 1 - hx]) / nb;
+  half = 0.5 * DIRECT_MARGIN * T14 + ((array == ARR_BFLX) ? 0.5 * settings->exptime : 0.);
+  ndirect = 2 * DIRECT_CONTACT_PTS;                                                   // Finding the contact points
+  for (i = 0; (i < ipts) && (ndirect < ngrid); i++) {                                 // Only the points in transit cost anything
+    ti = Fold(transit, t[i], &nt);
+    if (fabs(ti) < half * EpochDur(transit, nt)) 
+      ndirect += ((array == ARR_BFLX) && (settings->exptime > 0)) ? settings->exppts + 1 : 1;
+  }
+  return ndirect < ngrid;
+}
+
+static int FlushDirect(const double *ts, const double *wt, const int *idx, int m, const PARAMS *par, const SETTINGS *settings, ORBITFN orbit, const KEPLER *kep, KEPSTATS *stats, double *out) {
+  /*
+      Solves for the orbit at `m` sample times `ts` with the kernel 
+      `orbit`, then computes the flux with the vectorized kernel (or the 
+      lookup table) and adds it, times the weights `wt`, to the outputs 
+      `out[idx]`
+  */
+  double lambdae[FLUX_CHUNK], lambdad[FLUX_CHUNK], etad[FLUX_CHUNK], half[FLUX_CHUNK];
+  double b[FLUX_CHUNK], z[FLUX_CHUNK];
+  ORBIT o[FLUX_CHUNK];
+  int err[FLUX_CHUNK];
+  int j, iErr;
   
-    for (i = arr->nend - hx; i < arr->nend; i++)                                      // Again, deal with edge effects
-      arr->bflx[i] = arr->bflx[i - 1] + (1. - arr->flux[i - 1 - hx]) / nb;
+  iErr = orbit(ts, m, par, settings, kep, stats, o, err);
+  if (iErr != ERR_NONE) return iErr;
+  for (j = 0; j < m; j++) {
+    if (err[j] != ERR_NONE) return err[j];
+    b[j] = o[j].b;
+    z[j] = o[j].z;
+  }
+  iErr = Occultation(settings, b, z, m, par->RpRs, lambdae, lambdad, etad);
+  if (iErr != ERR_NONE) return iErr;
+  iErr = HalfTerms(par, b, z, m, lambdae, half);
+  if (iErr != ERR_NONE) return iErr;
+  for (j = 0; j < m; j++)
+    out[idx[j]] += wt[j] * (1. - ((1. - par->u1 - 2. * par->u2) * lambdae[j] + 
+                   (par->u1 + 2. * par->u2) * lambdad[j] + par->u2 * etad[j] + half[j]) / par->omega);
+  return ERR_NONE;
+}
+
+static int FlushOrbit(const double *ts, const int *idx, int m, int array, const PARAMS *par, const SETTINGS *settings, ORBITFN orbit, const KEPLER *kep, KEPSTATS *stats, double *out) {
+  /*
+      Solves for the orbit at `m` times `ts` with the kernel `orbit`, and
+      stores `array` in the outputs `out[idx]`
+  */
+  ORBIT o[FLUX_CHUNK];
+  int err[FLUX_CHUNK];
+  double x, y;
+  int j, iErr;
   
-  } else if (settings->binmethod == TRAPEZOID) {
-    arr->bflx[arr->nstart] = 1. + 0.5 / ep * (arr->flux[arr->nstart + hx] - 1.);      // Set the leftmost bin
+  iErr = orbit(ts, m, par, settings, kep, stats, o, err);
+  if (iErr != ERR_NONE) return iErr;
+  for (j = 0; j < m; j++) {
+    if (err[j] != ERR_NONE) return err[j];
+    if (array == ARR_M) out[idx[j]] = o[j].M;
+    else if (array == ARR_E) out[idx[j]] = o[j].E;
+    else if (array == ARR_F) out[idx[j]] = o[j].f;
+    else if (array == ARR_R) out[idx[j]] = o[j].r;
+    else if (array == ARR_Z) out[idx[j]] = o[j].z;
+    else if (array == ARR_B) out[idx[j]] = o[j].b;
+    else if ((array == ARR_X) || (array == ARR_Y)) {
+      SkyXY(&o[j], par->w - PI, &x, &y);
+      out[idx[j]] = (array == ARR_X) ? x : y;
+    } else return ERR_NOT_IMPLEMENTED;
+  }
+  return ERR_NONE;
+}
 
-    for (i = arr->nstart + 1; i < arr->nstart + hx + 1; i++)
-      arr->bflx[i] = arr->bflx[i - 1] + 1. / (2 * ep) * (arr->flux[i + hx] + 
-                     arr->flux[i + hx - 1] - 2.);                                     
+static int InterpolateDirect(const double *t, int ipts, int array, const TRANSIT *transit, const SETTINGS *settings, ARRAYS *arr, double *out, int *ntp) {
+  /*
+      Evaluates the model directly at the times `t`, without a grid. For 
+      the binned flux, each exposure is sampled at `exppts + 1` points and
+      integrated with `binmethod`, just as on the grid, so the two agree 
+      up to the interpolation error of the grid. We find the first and last
+      contacts beforehand, so samples out of transit cost nothing. This is
+      much faster when there are only a few data points in transit. `ntp`
+      is the transit number hint for `Fold()`, updated on return.
+  */
+  const PARAMS *par = &arr->par;
+  double ts[FLUX_CHUNK], wt[FLUX_CHUNK], ti, tk, w, s, t1, t4, dt = 0.;
+  double wend = 1., wmid = 1.;                                                        // The weights of the samples at the ends of an exposure, and between them
+  int idx[FLUX_CHUNK];
+  int i, k, m = 0, nt = *ntp, ns = 1, ep = settings->exppts;
+  int iErr = ERR_NONE;
+  KEPLER kep;
+  ORBIT o;
+  ORBITFN orbit;
   
-    for (i = arr->nstart + hx + 1; i < arr->nend - hx; i++)
-      arr->bflx[i] = arr->bflx[i - 1] + 1. / (2 * ep) * (arr->flux[i + hx] + 
-                     arr->flux[i + hx - 1] - arr->flux[i - hx] - 
-                     arr->flux[i - hx -1]);                                           // We're essentially doing the same intelligent summation as above
+  memset(&arr->kep, 0, sizeof(KEPSTATS));
+  if (settings->kepsolver == HALLEY) {
+    iErr = KeplerStarter(par->ecc, &kep);
+    if (iErr != ERR_NONE) return iErr;
+  }
+  orbit = OrbitKernel(par, settings, &kep);
+  if ((array == ARR_BFLX) && (settings->exptime > 0)) {                               // Sample the exposure
+    if ((settings->binmethod != RIEMANN) && (settings->binmethod != TRAPEZOID))
+      return ERR_NOT_IMPLEMENTED;
+    if (ep < 1) return ERR_EXP_PTS;
+    ns = ep + 1;
+    dt = settings->exptime / ep;
+    wend = (settings->binmethod == RIEMANN) ? 1. / ns : 0.5 / ep;                     // Chosen once, rather than for every sample
+    wmid = (settings->binmethod == RIEMANN) ? 1. / ns : 1. / ep;
+  }
+  if ((array == ARR_FLUX) || (array == ARR_BFLX)) {
+    iErr = OrbitPoint(0., par, settings, &o);                                         // Transit center
+    if (iErr != ERR_NONE) return iErr;
+    if ((o.b > 1. + par->RpRs) || (o.z > 0)) return ERR_NO_TRANSIT;                   // There's no transit!
+    iErr = Edge(-1, par, settings, &t1);
+    if (iErr != ERR_NONE) return iErr;
+    iErr = Edge(1, par, settings, &t4);
+    if (iErr != ERR_NONE) return iErr;
+  }
   
-    for (i = arr->nend - hx; i < arr->nend; i++)
-      arr->bflx[i] = arr->bflx[i - 1] + 1. / (2 * ep) * (2. - 
-                     arr->flux[i - hx] - arr->flux[i - hx -1]);
-    
-  } else if (settings->binmethod == -1) {                                             // DEBUG: This is the old trapezoid routine. Use for testing only
-    arr->bflx[arr->nstart] = 1. + 0.5 / ep * (arr->flux[arr->nstart + hx] - 1.);      // Set the leftmost bin
-
-    for (i = arr->nstart + 1; i < arr->nstart + hx + 1; i++) {
-      sum = 0;
-      for (j = i - hx + 1; j < i + hx; j++) {
-        if (j >= 0) sum += arr->flux[j];
-        else sum += 1.;
+  for (i = 0; i < ipts; i++) {
+    ti = Fold(transit, t[i], &nt);
+    if ((array == ARR_FLUX) || (array == ARR_BFLX)) {
+      s = EpochDur(transit, nt);                                                      // Stretch this transit in time
+      out[i] = 0.;
+      for (k = 0; k < ns; k++) {
+        w = ((k == 0) || (k == ep)) ? wend : wmid;
+        tk = (ti + (k - ep / 2) * dt) / s;
+        if ((tk <= t1) || (tk >= t4)) {                                               // Out of transit
+          out[i] += w;
+          continue;
+        }
+        ts[m] = tk;
+        wt[m] = w;
+        idx[m++] = i;
+        if (m == FLUX_CHUNK) {
+          iErr = FlushDirect(ts, wt, idx, m, par, settings, orbit, &kep, &arr->kep, out);
+          if (iErr != ERR_NONE) return iErr;
+          m = 0;
+        }
       }
-      arr->bflx[i] = 1. / (nb - 1) * (0.5 * (1. + arr->flux[i + hx]) + sum);
-    }
-    
-    for (i = arr->nstart + hx + 1; i < arr->nend - hx; i++) {
-      sum = 0;
-      for (j = i - hx + 1; j < i + hx; j++) sum += arr->flux[j];
-      arr->bflx[i] = 1. / (nb - 1) * (0.5 * (arr->flux[i - hx] + 
-                                      arr->flux[i + hx]) + sum);
-    } 
-  
-    for (i = arr->nend - hx; i < arr->nend; i++) {
-      sum = 0;
-      for (j = i - hx + 1; j < i + hx; j++) {
-        if (j < arr->nend - arr->nstart) sum += arr->flux[j];                         // TODO: Verify this line (are we off by 1?)
-        else sum += 1.;
+    } else {
+      ts[m] = ti;
+      idx[m++] = i;
+      if (m == FLUX_CHUNK) {
+        iErr = FlushOrbit(ts, idx, m, array, par, settings, orbit, &kep, &arr->kep, out);
+        if (iErr != ERR_NONE) return iErr;
+        m = 0;
       }
-      arr->bflx[i] = 1. / (nb - 1) * (0.5 * (arr->flux[i - hx] + 1.) + sum);
     }
+  }
+  *ntp = nt;
+  if ((array != ARR_FLUX) && (array != ARR_BFLX))
+    return m ? FlushOrbit(ts, idx, m, array, par, settings, orbit, &kep, &arr->kep, out) : ERR_NONE;
+  if (m) {
+    iErr = FlushDirect(ts, wt, idx, m, par, settings, orbit, &kep, &arr->kep, out);
+    if (iErr != ERR_NONE) return iErr;
+  }
+  if (transit->ntrans && transit->dep) {                                              // Scale the depth of each transit
+    for (i = 0; i < ipts; i++) {
+      Fold(transit, t[i], &nt);
+      out[i] = 1. - EpochDep(transit, nt) * (1. - out[i]);
+    }
+  }
+  return ERR_NONE;
+}
+
+static inline double GridValue(double t, const double *f, double fill_value, const SERIES *fs, const TRANSIT *transit, double exptime, const ARRAYS *arr, int *nt, const int flux, const int box) {
+  /*
+      The model array `f` at the time `t`, interpolated from the grid, or
+      `fill_value` off the grid. The `flux` is stretched and scaled for the
+      transit it falls in, whose index `nt` is updated (see `Fold()`). The
+      binned flux of stretched transits (`box` is BOX_STRETCHED), or all of
+      it (BOX_ALWAYS, on the adaptive grid), is averaged over the exposure
+      exactly instead, which needs the running integrals in `fs`. See
+      `GridBox()`; the two flags are constants in `GridLoop()`.
+  */
+  double f1, f0, t1, t0, s, ti, v;
+  int j;
   
-  } else {
-	  return ERR_NOT_IMPLEMENTED;
-	}
+  ti = Fold(transit, t, nt);
+  s = flux ? EpochDur(transit, *nt) : 1.;
+  ti /= s;                                                                            // Stretch this transit in time
   
-  settings->binned = 1;                                                               // Set the flag
-  return iErr;
+  if ((box == BOX_ALWAYS) || ((box == BOX_STRETCHED) && (s != 1.))) {
+    v = BoxAverage(arr, fs, ti, 0.5 * exptime / s);                                   // We can do better than interpolating here, even off the grid
+  } else if ((ti < GridTime(arr, arr->nstart)) || 
+             (ti >= GridTime(arr, arr->nend-1))) {                                    // The case ti == arr->time[arr->nend-1] is pathological,
+    return fill_value;                                                                // but we're technically overestimating the flux slightly
+  } else {                                                                            // in the zero-probability event that this does occur
+    j = GridIndex(arr, ti);                                                           // The interval [j, j + 1] bounding the data point: O(1) on a uniform grid
+    t0 = GridTime(arr, arr->nstart + j);                                              // Interpolation bounds
+    t1 = GridTime(arr, arr->nstart + j + 1);
+    f0 = f[arr->nstart + j];
+    f1 = f[arr->nstart + j + 1];
+    v = f0 + (f1 - f0) * (ti - t0) / (t1 - t0);                                       // A simple linear interpolation
+  }
+  if (flux) v = 1. - EpochDep(transit, *nt) * (1. - v);                               // Scale the depth of this transit
+  return v;
+}
 
+static inline int GridBox(int array, const SETTINGS *settings) {
+  /*
+      When `GridValue()` averages `array` over the exposure exactly
+  */
+  if ((array != ARR_BFLX) || !(settings->exptime > 0)) return BOX_NEVER;
+  return (settings->gridmethod == ADAPTIVE) ? BOX_ALWAYS : BOX_STRETCHED;
+}
 
+static inline void GridLoop(const double *t, int ipts, const double *f, double fill_value, const SERIES *fs, const TRANSIT *transit, double exptime, const ARRAYS *arr, double *out, int *nt, const int flux, const int box) {
+  /*
+      `GridValue()` at each of the `ipts` times `t`
+  */
+  int i;
+  
+  for (i = 0; i < ipts; i++)
+    out[i] = GridValue(t[i], f, fill_value, fs, transit, exptime, arr, nt, flux, box);
 }
 
-int Interpolate(double *t, int ipts, int array, TRANSIT *transit, LIMBDARK *limbdark, SETTINGS *settings, ARRAYS *arr) {
+static void GridValues(const double *t, int ipts, int array, const double *f, double fill_value, const SERIES *fs, const TRANSIT *transit, const SETTINGS *settings, const ARRAYS *arr, double *out, int *nt) {
+  /*
+      `GridValue()` of `array` at each of the `ipts` times `t`, with the
+      loop specialized for the kind of array, so it doesn't check on every 
+      point
+  */
+  double exptime = settings->exptime;
   
-  double f1, f0, t1, t0, ti;
-  int i, j, nt;
+  switch (((array == ARR_FLUX) || (array == ARR_BFLX)) ? GridBox(array, settings) : -1) {
+    case BOX_NEVER:
+      GridLoop(t, ipts, f, fill_value, fs, transit, exptime, arr, out, nt, 1, BOX_NEVER);
+      break;
+    case BOX_STRETCHED:
+      GridLoop(t, ipts, f, fill_value, fs, transit, exptime, arr, out, nt, 1, BOX_STRETCHED);
+      break;
+    case BOX_ALWAYS:
+      GridLoop(t, ipts, f, fill_value, fs, transit, exptime, arr, out, nt, 1, BOX_ALWAYS);
+      break;
+    default:                                                                          // The orbital arrays
+      GridLoop(t, ipts, f, fill_value, fs, transit, exptime, arr, out, nt, 0, BOX_NEVER);
+  }
+}
+
+static int InterpolateModel(const double *t, int ipts, int array, const TRANSIT *transit, const LIMBDARK *limbdark, const SETTINGS *settings, ARRAYS *arr, double *out, int *nt) {
+  /*
+      The body of `InterpolateR()` and `InterpolateStream()`. `nt` is the
+      transit number hint for `Fold()`, updated on return.
+  */
   int iErr = ERR_NONE;
   double *f;
   double fill_value;
+  SERIES fs;
 
   if (!(transit->ntrans))
     if (isnan(transit->t0)) return ERR_T0;                                            // User didn't specify t0!
   
-  arr->iarr = malloc(ipts*sizeof(double));                                            // The interpolated array 
-  arr->ialloc = 1;
+  if ((settings->evalmethod == DIRECT) || (settings->evalmethod == AUTO)) {
+    iErr = Setup(transit, limbdark, &arr->par);
+    if (iErr != ERR_NONE) return iErr;
+    if (UseDirect(t, ipts, array, transit, settings, arr))
+      return InterpolateDirect(t, ipts, array, transit, settings, arr, out, nt);      // Skip the grid altogether
+  }
   
-  if (!settings->computed) {
-    iErr = Compute(transit, limbdark, settings, arr);                                 // Compute the raw transit model if necessary
+  if ((!arr->computed) || !(arr->outputs & (1 << array))) {
+    iErr = ComputeOut(transit, limbdark, settings, (settings->outputs ? 
+                      settings->outputs : OUT_ALL) | (1 << array), arr);              // Compute the raw transit model if necessary
     if (iErr != ERR_NONE) return iErr;
   } 
-  if ((array == ARR_BFLX) && (!settings->binned)) {
-    iErr = Bin(transit, limbdark, settings, arr);                                     // Bin the transit if necessary
+  if ((array == ARR_BFLX) && (!arr->binned)) {
+    iErr = BinR(transit, limbdark, settings, arr);                                    // Bin the transit if necessary
     if (iErr != ERR_NONE) return iErr;
   }
   
@@ -683,62 +2951,492 @@ int Interpolate(double *t, int ipts, int array, TRANSIT *transit, LIMBDARK *limb
   } else
     return ERR_NOT_IMPLEMENTED;
   
-  j = 0;                                                                              // The interpolation index
-  nt = 0;                                                                             // The transit number
-  transit->tN[transit->ntrans] = 99999999999999999;                                                // A bit of a hack, but essential to get the last transit right below
+  if ((settings->gridmethod != ADAPTIVE) && (settings->intmethod != SMARTINT) && 
+      (settings->intmethod != SLOWINT)) return ERR_NOT_IMPLEMENTED;                   // Both are the same now; the times needn't be sorted
+  if ((array == ARR_BFLX) && transit->ntrans && transit->dur) Integrate(arr);         // Stretched transits are binned exactly
+  fs = Series(arr, -1);
     
+  GridValues(t, ipts, array, f, fill_value, &fs, transit, settings, arr, out, nt);
+  return iErr;
+
+}
+
+int InterpolateR(const double *t, int ipts, int array, const TRANSIT *transit, const LIMBDARK *limbdark, const SETTINGS *settings, ARRAYS *arr, double *out) {
+  /*
+      Interpolate the transit model onto the `ipts` times `t`, storing the
+      result in `out`. This is the reentrant version: the model is computed
+      and binned in `arr` as needed, and nothing else is modified.
+  */
+  PROFSAVE saved = ProfBegin(arr, STAGE_INTERPOLATE);
+  int iErr, nt = 0;
+  
+  COUNT(lookups, ipts);
+  iErr = InterpolateModel(t, ipts, array, transit, limbdark, settings, arr, out, &nt);
+  ProfEnd(saved);
+  return iErr;
+}
+
+static int ExposeModel(const double *t, const double *texp, int ipts, const double *kt, const double *kv, int nk, const TRANSIT *transit, const LIMBDARK *limbdark, const SETTINGS *settings, ARRAYS *arr, double *out) {
+  /*
+      The body of `Expose()`
+  */
+  static const double box_t[2] = {-0.5, 0.5}, box_v[2] = {1., 1.};
+  double area = 0., w, ti, s;
+  int i, k, nt = 0;
+  int iErr = ERR_NONE;
+  SERIES fs;
+  
+  if (kt == NULL) {
+    kt = box_t;
+    kv = box_v;
+    nk = 2;
+  }
+  if (nk < 2) return ERR_KERNEL;
+  for (k = 0; k < nk - 1; k++) {
+    if (!(kt[k + 1] >= kt[k])) return ERR_KERNEL;                                     // Knots must be sorted
+    area += 0.5 * (kv[k] + kv[k + 1]) * (kt[k + 1] - kt[k]);
+  }
+  if (!(area > 0)) return ERR_KERNEL;
+  if (!(transit->ntrans))
+    if (isnan(transit->t0)) return ERR_T0;                                            // User didn't specify t0!
+  
+  if ((!arr->computed) || !(arr->outputs & OUT_FLUX)) {
+    iErr = ComputeOut(transit, limbdark, settings, (settings->outputs ? 
+                      settings->outputs : OUT_ALL) | OUT_FLUX, arr);                  // Always on the grid, whatever the `evalmethod`
+    if (iErr != ERR_NONE) return iErr;
+  }
+  Integrate(arr);
+  fs = Series(arr, -1);
+  
+  for (i = 0; i < ipts; i++) {
+    w = texp ? texp[i] : settings->exptime;
+    ti = Fold(transit, t[i], &nt);
+    s = EpochDur(transit, nt);
+    out[i] = KernelAverage(arr, &fs, ti / s, w / s, kt, kv, nk, area);
+    out[i] = 1. - EpochDep(transit, nt) * (1. - out[i]);
+  }
+  return iErr;
+}
+
+int Expose(const double *t, const double *texp, int ipts, const double *kt, const double *kv, int nk, const TRANSIT *transit, const LIMBDARK *limbdark, const SETTINGS *settings, ARRAYS *arr, double *out) {
+  /*
+      Averages the transit model over an exposure at each of the `ipts` 
+      times `t`, storing the result in `out`. Exposure `i` lasts `texp[i]`
+      (or `settings->exptime` for all of them if `texp` is NULL), and is 
+      weighted by the piecewise linear kernel with `nk` knots `kt`, in 
+      units of the exposure time relative to `t[i]`, and values `kv` (a 
+      boxcar over [-0.5, 0.5] if `kt` is NULL). The model is computed once
+      on the grid and integrated twice, after which every exposure costs 
+      the same regardless of its length, so one model serves data from 
+      any mix of instruments. This is reentrant, like `InterpolateR`.
+  */
+  PROFSAVE saved = ProfBegin(arr, STAGE_INTERPOLATE);
+  int iErr;
+  
+  COUNT(lookups, ipts);
+  iErr = ExposeModel(t, texp, ipts, kt, kv, nk, transit, limbdark, settings, arr, out);
+  ProfEnd(saved);
+  return iErr;
+}
+
+static int GradModel(const double *t, int ipts, int array, const TRANSIT *transit, const LIMBDARK *limbdark, const SETTINGS *settings, ARRAYS *arr, double *out, double *grad) {
+  /*
+      The body of `InterpolateGrad()`
+  */
+  double t0, t1, x = 0., s, dep, ti, v, N;
+  int i, j = 0, k, nt = 0, box, off, binned;
+  int iErr = ERR_NONE;
+  int outputs = OUT_GRAD | (1 << array);
+  size_t stride;
+  const double *y;
+  SERIES ser;
+  
+  if (!(transit->ntrans))
+    if (isnan(transit->t0)) return ERR_T0;                                            // User didn't specify t0!
+  if ((array != ARR_FLUX) && (array != ARR_BFLX)) return ERR_NOT_IMPLEMENTED;
+  if ((settings->gridmethod != ADAPTIVE) && (settings->intmethod != SMARTINT) && 
+      (settings->intmethod != SLOWINT)) return ERR_NOT_IMPLEMENTED;
+  if (limbdark->ldmodel == NONLINEAR) return ERR_NOT_IMPLEMENTED;                     // The gradients are for the quadratic law
+  
+  if ((!arr->computed) || ((arr->outputs & outputs) != outputs)) {
+    iErr = ComputeOut(transit, limbdark, settings, (settings->outputs ? 
+                      settings->outputs : OUT_ALL) | outputs, arr);                   // Compute the model and its gradients if necessary
+    if (iErr != ERR_NONE) return iErr;
+  } 
+  if ((array == ARR_BFLX) && (!arr->binned)) {
+    iErr = BinR(transit, limbdark, settings, arr);                                    // Bin them if necessary
+    if (iErr != ERR_NONE) return iErr;
+  }
+  binned = (array == ARR_BFLX) && (settings->exptime > 0);
+  if (binned && ((settings->gridmethod == ADAPTIVE) || 
+      (transit->ntrans && transit->dur))) Integrate(arr);
+  stride = arr->nalloc;
+  
   for (i = 0; i < ipts; i++) {
     
-    if (!(transit->ntrans))
-      ti = modulus(t[i]-transit->t0-transit->per/2., transit->per) - transit->per/2.; // Find the folded time, assuming strict periodicity
-    else {
-      for (; nt < transit->ntrans; nt++) {                                            // Find the folded time given all of the transit times
-        if (fabs(t[i] - transit->tN[nt]) < fabs(t[i] - transit->tN[nt + 1])) {
-          ti = t[i] - transit->tN[nt];
-          break;
-        }
-      }
-    }
+    ti = Fold(transit, t[i], &nt);
+    N = transit->ntrans ? 0. : rint((t[i] - transit->t0 - ti) / transit->per);        // The transit number, since the period also shifts this transit
+    s = EpochDur(transit, nt);
+    dep = EpochDep(transit, nt);
+    ti /= s;                                                                          // Stretch this transit in time
     
-    if ((ti < arr->time[arr->nstart]) || (ti >= arr->time[arr->nend-1])) {            // The case ti == arr->time[arr->nend-1] is pathological,
-      arr->iarr[i] = fill_value;                                                      // but we're technically overestimating the flux slightly
-      continue;                                                                       // in the zero-probability event that this does occur
+    box = binned && ((settings->gridmethod == ADAPTIVE) || (s != 1.));
+    off = (ti < GridTime(arr, arr->nstart)) || (ti >= GridTime(arr, arr->nend-1));
+    if (!box && !off) {
+      j = arr->nstart + GridIndex(arr, ti);                                           // The interval [j, j + 1] bounding the data point
+      t0 = GridTime(arr, j);
+      t1 = GridTime(arr, j + 1);
+      x = (ti - t0) / (t1 - t0);
     }
-                                                                                              
-    // Now we find [j, j + 1], the indices bounding the data point
     
-    if (settings->intmethod == SMARTINT) {                                            // Increment j intelligently. NOTE: time array must be sorted!
-      if (j > 0) j += settings->exppts * (t[i] - t[i - 1])/settings->exptime;         
-      j = j % (arr->nend - arr->nstart);
-      
-      if (arr->time[arr->nstart + j + 1] <= ti) {                                     // We undershot; let's loop until we get the right index
-        for (; j < arr->nend - arr->nstart - 1; j++) {
-          if (arr->time[arr->nstart + j + 1] > ti) break;
-        }
-      } else {                                                                        // We either overshot or got it right
-        for (; j >= 0; j--) {
-          if (arr->time[arr->nstart + j] < ti) break;
-        }
-      }
-    } else if (settings->intmethod == SLOWINT) {                                      // Brain-dead slow interpolation, useful if time array isn't sorted
-      for (j = 0; j < arr->nend - arr->nstart - 1; j++) {
-        if (arr->time[arr->nstart + j + 1] > ti) break;
+    for (k = -1; k < NGRAD; k++) {                                                    // The flux, then the gradients
+      ser = Series(arr, k);
+      if (box) 
+        v = BoxAverage(arr, &ser, ti, 0.5 * settings->exptime / s);
+      else if (off) 
+        v = ser.base;
+      else {
+        if (array == ARR_BFLX) y = (k < 0) ? arr->bflx : arr->bgrad + k * stride;
+        else y = ser.y;
+        v = y[j] + (y[j + 1] - y[j]) * x;                                             // A simple linear interpolation
       }
-    } else {
-      return ERR_NOT_IMPLEMENTED;
+      if (k < 0) out[i] = 1. - dep * (1. - v);                                        // Scale the depth of this transit
+      else grad[k * ipts + i] = dep * v;
     }
+    grad[GRAD_T0 * ipts + i] /= s;
+    grad[GRAD_PER * ipts + i] += N * grad[GRAD_T0 * ipts + i];
     
-    t0 = arr->time[arr->nstart + j];                                                  // Interpolation bounds
-    t1 = arr->time[arr->nstart + j + 1];
-    f0 = f[arr->nstart + j];
-    f1 = f[arr->nstart + j + 1];
+  }
   
-    arr->iarr[i] = f0 + (f1 - f0) * (ti - t0) / (t1 - t0);                            // A simple linear interpolation
-    
+  return iErr;
+}
+
+int InterpolateGrad(const double *t, int ipts, int array, const TRANSIT *transit, const LIMBDARK *limbdark, const SETTINGS *settings, ARRAYS *arr, double *out, double *grad) {
+  /*
+      Interpolates the flux (`array` is ARR_FLUX) or the binned flux 
+      (ARR_BFLX) onto the `ipts` times `t`, like `InterpolateR`, storing it
+      in `out`, along with its derivatives with respect to each of the 
+      NGRAD parameters (see GRAD_PER and friends) in the NGRAD x `ipts` 
+      row-major array `grad`. The derivatives are computed analytically 
+      alongside the flux on the grid, then binned and interpolated exactly
+      like it, so they're those of the model we return. This is always done
+      on the grid, whatever the `evalmethod`, and is reentrant.
+  */
+  PROFSAVE saved = ProfBegin(arr, STAGE_INTERPOLATE);
+  int iErr;
+  
+  COUNT(lookups, ipts);
+  iErr = GradModel(t, ipts, array, transit, limbdark, settings, arr, out, grad);
+  ProfEnd(saved);
+  return iErr;
+}
+
+int InterpolateStream(const double *t, int ipts, int array, TRANSIT *transit, LIMBDARK *limbdark, SETTINGS *settings, ARRAYS *arr, double *out, int *nt) {
+  /*
+      Interpolate the transit model onto the `ipts` times `t`, one chunk of
+      a longer time series, storing the result in the caller's buffer `out`.
+      The model is computed on the first chunk and reused for the rest; `nt`
+      carries the transit we're in from one chunk to the next (start it at
+      zero), so the series can be streamed through in pieces of any size at 
+      the same cost per point as in one go. Memory use doesn't grow with 
+      the length of the series. If the model is evaluated directly (see
+      `UseDirect()`), the grid isn't computed at all.
+  */
+  PROFSAVE saved;
+  int iErr = ERR_NONE;
+  int direct = 0;
+
+  if (!(transit->ntrans))
+    if (isnan(transit->t0)) return ERR_T0;                                            // User didn't specify t0!
+  
+  if ((settings->evalmethod == DIRECT) || (settings->evalmethod == AUTO)) {
+    iErr = Setup(transit, limbdark, &arr->par);
+    if (iErr != ERR_NONE) return iErr;
+    direct = UseDirect(t, ipts, array, transit, settings, arr);
+  }
+  if (direct) {
+    WriteBack(transit, &arr->par);                                                    // As `Compute()` would have
+  } else if ((!settings->computed) || (!arr->computed)) {
+    iErr = Compute(transit, limbdark, settings, arr);                                 // Compute the raw transit model if necessary
+    if (iErr != ERR_NONE) return iErr;
+  } 
+  if (!direct && (array == ARR_BFLX) && ((!settings->binned) || (!arr->binned))) {
+    iErr = Bin(transit, limbdark, settings, arr);                                     // Bin the transit if necessary
+    if (iErr != ERR_NONE) return iErr;
   }
   
-  arr->ipts = ipts;
+  saved = ProfBegin(arr, STAGE_INTERPOLATE);
+  COUNT(lookups, ipts);
+  iErr = InterpolateModel(t, ipts, array, transit, limbdark, settings, arr, out, nt);
+  ProfEnd(saved);
+  return iErr;
+}
+
+int InterpolateStreamFloat(const double *t, int ipts, int array, TRANSIT *transit, LIMBDARK *limbdark, SETTINGS *settings, ARRAYS *arr, float *out, int *nt) {
+  /*
+      Same as `InterpolateStream()`, but stores the model as float, which
+      halves the memory (and bandwidth) of the output for long time series.
+      Only the output is rounded: we interpolate STREAM_BLOCK points at a
+      time in double precision into a small buffer, then convert them.
+  */
+  double buf[STREAM_BLOCK];
+  int i, j, m, iErr;
+
+  for (i = 0; i < ipts; i += STREAM_BLOCK) {
+    m = IMIN(ipts - i, STREAM_BLOCK);
+    iErr = InterpolateStream(t + i, m, array, transit, limbdark, settings, arr, buf, nt);
+    if (iErr != ERR_NONE) return iErr;
+    for (j = 0; j < m; j++) out[i + j] = (float)buf[j];
+  }
+  return ERR_NONE;
+}
+
+int InterpolateInto(double *t, int ipts, int array, TRANSIT *transit, LIMBDARK *limbdark, SETTINGS *settings, ARRAYS *arr, double *out) {
+  /*
+      Interpolate the transit model onto the `ipts` times `t`, storing the
+      result in the caller's buffer `out`. Like `Interpolate`, this uses 
+      the flags in `settings` and writes the derived parameters back into
+      `transit`, but it doesn't allocate anything once the workspace in 
+      `arr` is big enough.
+  */
+  int nt = 0;
+  
+  return InterpolateStream(t, ipts, array, transit, limbdark, settings, arr, out, &nt);
+}
+
+int Interpolate(double *t, int ipts, int array, TRANSIT *transit, LIMBDARK *limbdark, SETTINGS *settings, ARRAYS *arr) {
+  /*
+      Interpolate the transit model onto the `ipts` times `t`, storing the
+      result in `arr->iarr`. This is the original, non-reentrant interface.
+      The `iarr` buffer belongs to `arr` and is reused across calls.
+  */
+  int iErr = ERR_NONE;
+  double *iarr;
+
+  if (ipts > arr->ialloc) {                                                           // Grow the interpolated array if needed
+    iarr = ArenaAlloc((size_t)ipts);
+    if (iarr == NULL) return ERR_ALLOC;
+    ArenaRelease(arr->iarr);
+    arr->iarr = iarr;
+    arr->ialloc = ipts;
+  }
   
+  iErr = InterpolateInto(t, ipts, array, transit, limbdark, settings, arr, arr->iarr);
+  arr->ipts = ipts;
   return iErr;
+}
+
+typedef struct {
+  const double *t;
+  int ipts;
+  int array;
+  const TRANSIT *transit;
+  const LIMBDARK *limbdark;
+  const SETTINGS *settings;
+  double *out;
+  int *err;
+} BATCH;
+
+static void BatchTask(int k, void *data) {
+  /*
+      Computes the model for a single member of a batch. The parameters
+      are shared and read-only; each task gets its own workspace.
+  */
+  BATCH *batch = (BATCH *)data;
+  ARRAYS arr = {0};
+  double *out = batch->out + (size_t)k * batch->ipts;
+  int i;
+  
+  batch->err[k] = InterpolateR(batch->t, batch->ipts, batch->array, 
+                               &batch->transit[k], &batch->limbdark[k], 
+                               batch->settings, &arr, out);
+  if (batch->err[k] != ERR_NONE) {
+    for (i = 0; i < batch->ipts; i++) out[i] = NAN;                                   // This walker failed, but the rest of the batch goes on
+  }
+  FreeArrays(&arr);
+}
+
+int ComputeBatch(double *t, int ipts, int array, int nbatch, TRANSIT *transit, LIMBDARK *limbdark, SETTINGS *settings, double *out, int *err, int nthreads) {
+  /*
+      Evaluates `nbatch` transit models (one per element of the `transit` and
+      `limbdark` arrays) on the same time array, in parallel. The results go
+      in the `nbatch` x `ipts` row-major array `out` and the error code of each
+      model in `err`. Returns the first nonzero error code, if any.
+  */
+  BATCH batch;
+  int i, k, iErr;
+  
+  batch.t = t;
+  batch.ipts = ipts;
+  batch.array = array;
+  batch.transit = transit;
+  batch.limbdark = limbdark;
+  batch.settings = settings;
+  batch.out = out;
+  batch.err = err;
+  iErr = PoolRun(nbatch, BatchTask, &batch, nthreads);
+  if (iErr != ERR_NONE) {                                                             // None of the walkers ran
+    for (k = 0; k < nbatch; k++) {
+      err[k] = iErr;
+      for (i = 0; i < ipts; i++) out[(size_t)k * ipts + i] = NAN;
+    }
+    return iErr;
+  }
+  
+  for (k = 0; k < nbatch; k++)
+    if (err[k] != ERR_NONE) return err[k];
+  return ERR_NONE;
+}
 
+/*
+    --- PLANETARY SYSTEMS ---
+    
+    Several planets transiting the same star, with the same limb darkening
+    and settings. Each planet's model is computed (and binned) on its own
+    grid, in parallel, and kept in its own workspace; then a single pass 
+    over the times adds up the flux deficits of all of them, chunk by chunk,
+    also in parallel, skipping the times outside each planet's transits. 
+    Since the deficits simply add, overlapping transits
+    (one planet occulting another) aren't modeled.
+*/
+
+#define SYSTEM_CHUNK            4096                                                  // Times per task in the pass over the times
+
+typedef struct {
+  const double *t;
+  int ipts;
+  int array;
+  int nplanets;
+  const TRANSIT *transit;
+  const LIMBDARK *limbdark;
+  const SETTINGS *settings;
+  ARRAYS *arr;
+  double *out;
+  int *err;
+} SYSTEM;
+
+static void PlanetTask(int k, void *data) {
+  /*
+      Computes and bins the model of planet `k` on its grid, if it isn't
+      already, and integrates it if we'll need that to bin it
+  */
+  SYSTEM *sys = (SYSTEM *)data;
+  const TRANSIT *transit = &sys->transit[k];
+  const SETTINGS *settings = sys->settings;
+  ARRAYS *arr = &sys->arr[k];
+  int outputs = (settings->outputs ? settings->outputs : OUT_ALL) | (1 << sys->array);
+  int iErr = ERR_NONE;
+  
+  if ((!(transit->ntrans)) && isnan(transit->t0)) iErr = ERR_T0;
+  if ((iErr == ERR_NONE) && ((!arr->computed) || !(arr->outputs & (1 << sys->array))))
+    iErr = ComputeOut(transit, sys->limbdark, settings, outputs, arr);                // Always on the grid, whatever the `evalmethod`
+  if ((iErr == ERR_NONE) && (sys->array == ARR_BFLX) && (!arr->binned))
+    iErr = BinR(transit, sys->limbdark, settings, arr);
+  if ((iErr == ERR_NONE) && (sys->array == ARR_BFLX) && (settings->exptime > 0) && 
+      ((settings->gridmethod == ADAPTIVE) || (transit->ntrans && transit->dur)))
+    Integrate(arr);                                                                   // Now, so the pass over the times only reads the workspace
+  sys->err[k] = iErr;
+}
+
+static inline int Skip(const double *t, int i, int hi, double next) {
+  /*
+      The index of the first of the sorted times `t[i + 1]`, ..., `t[hi - 1]` 
+      that's at least `next`, or `hi` if there isn't one
+  */
+  int lo = i + 1, mid;
+  
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (t[mid] < next) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+static void SystemTask(int c, void *data) {
+  /*
+      Adds up the flux deficits of all the planets for chunk `c` of the 
+      times. If they're sorted, we jump from one transit window to the 
+      next, so times that no planet is transiting cost nothing but the 
+      initial copy. Otherwise we visit every time, which is still cheap:
+      off the grid, it's a fold and a comparison.
+  */
+  SYSTEM *sys = (SYSTEM *)data;
+  const double *t = sys->t;
+  const TRANSIT *transit;
+  const ARRAYS *arr;
+  int lo = c * SYSTEM_CHUNK, hi = IMIN(lo + SYSTEM_CHUNK, sys->ipts);
+  int i, k, nt, sorted = 1, box = GridBox(sys->array, sys->settings);
+  double w0, w1, ti, s, margin, next;
+  const double *f;
+  SERIES fs;
+  
+  for (i = lo; i < hi; i++) {
+    sys->out[i] = 1.;
+    if ((i > lo) && !(t[i] >= t[i - 1])) sorted = 0;
+  }
+  margin = (sys->array == ARR_BFLX) ? DMAX(0.5 * sys->settings->exptime, 0.) : 0.;    // The exposures reach this far off the grid
+  
+  for (k = 0; k < sys->nplanets; k++) {                                               // Planet by planet, so each one's grid stays in cache
+    transit = &sys->transit[k];
+    arr = &sys->arr[k];
+    f = (sys->array == ARR_BFLX) ? arr->bflx : arr->flux;
+    fs = Series(arr, -1);
+    w0 = GridTime(arr, arr->nstart);                                                  // The transit window
+    w1 = GridTime(arr, arr->nend - 1);
+    nt = 0;
+    for (i = lo; i < hi; ) {
+      ti = Fold(transit, t[i], &nt);
+      s = EpochDur(transit, nt);
+      if (sorted && (ti > w1 * s + margin)) {                                         // Past this transit: on to the next one
+        if (!(transit->ntrans)) 
+          next = t[i] - ti + transit->per + w0 - margin;
+        else if (nt < transit->ntrans - 1) 
+          next = transit->tN[nt + 1] + w0 * EpochDur(transit, nt + 1) - margin;
+        else break;
+        i = Skip(t, i, hi, next);
+      } else if (sorted && (ti < w0 * s - margin)) {                                  // Not there yet
+        i = Skip(t, i, hi, t[i] - ti + w0 * s - margin);
+      } else {
+        sys->out[i] -= 1. - GridValue(t[i], f, 1., &fs, transit, sys->settings->exptime,
+                                      arr, &nt, 1, box);
+        i++;
+      }
+    }
+  }
+}
+
+int ComputeSystem(const double *t, int ipts, int array, int nplanets, const TRANSIT *transit, const LIMBDARK *limbdark, const SETTINGS *settings, ARRAYS *arr, double *out, int *err, int nthreads) {
+  /*
+      The combined flux (`array` is ARR_FLUX) or binned flux (ARR_BFLX) of 
+      the `nplanets` planets in the `transit` array, which share the star,
+      the limb darkening and the settings, at the `ipts` times `t`. Each 
+      planet gets its own workspace in the `arr` array, and is only 
+      recomputed if its `computed` flag was cleared. The error code of each
+      planet goes in `err`; if any of them failed, we return the first one 
+      and `out` is left alone. This is reentrant, like `InterpolateR`.
+  */
+  SYSTEM sys;
+  int k, iErr;
+  
+  if ((array != ARR_FLUX) && (array != ARR_BFLX)) return ERR_NOT_IMPLEMENTED;
+  if ((settings->gridmethod != ADAPTIVE) && (settings->intmethod != SMARTINT) && 
+      (settings->intmethod != SLOWINT)) return ERR_NOT_IMPLEMENTED;
+  
+  sys.t = t;
+  sys.ipts = ipts;
+  sys.array = array;
+  sys.nplanets = nplanets;
+  sys.transit = transit;
+  sys.limbdark = limbdark;
+  sys.settings = settings;
+  sys.arr = arr;
+  sys.out = out;
+  sys.err = err;
+  iErr = PoolRun(nplanets, PlanetTask, &sys, nthreads);
+  if (iErr != ERR_NONE) return iErr;
+  for (k = 0; k < nplanets; k++)
+    if (err[k] != ERR_NONE) return err[k];
+  
+  return PoolRun((ipts + SYSTEM_CHUNK - 1) / SYSTEM_CHUNK, SystemTask, &sys, nthreads);
 }
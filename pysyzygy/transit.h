@@ -11,6 +11,14 @@
 #define SLOWINT                 8
 #define MDFAST                  9
 #define NEWTON                  10
+#define UNIFORM                 11
+#define ADAPTIVE                12
+#define GRID                    13
+#define DIRECT                  14
+#define AUTO                    15
+#define ANALYTIC                16
+#define TABLE                   17
+#define HALLEY                  18
 
 // Errors
 #define ERR_NONE                0                                                     // We're good!
@@ -32,6 +40,10 @@
 #define ERR_ECC_W               16                                                    // Bad eccentricity/omega
 #define ERR_LD                  17                                                    // Bad limb darkening coeffs
 #define ERR_T0                  18                                                    // Bad t0
+#define ERR_ALLOC               19                                                    // Out of memory
+#define ERR_TABLE               20                                                    // Unable to read or write the flux lookup table
+#define ERR_KERNEL              21                                                    // Bad exposure kernel
+#define ERR_EPOCH               22                                                    // Bad per-transit duration scaling
 
 // Arrays
 #define ARR_FLUX                0
@@ -44,16 +56,51 @@
 #define ARR_Y                   7
 #define ARR_Z                   8
 #define ARR_B                   9
+#define OUT_FLUX                (1 << ARR_FLUX)                                       // Bits for the `outputs` mask in SETTINGS
+#define OUT_BFLX                (1 << ARR_BFLX)
+#define OUT_M                   (1 << ARR_M)
+#define OUT_E                   (1 << ARR_E)
+#define OUT_F                   (1 << ARR_F)
+#define OUT_R                   (1 << ARR_R)
+#define OUT_X                   (1 << ARR_X)
+#define OUT_Y                   (1 << ARR_Y)
+#define OUT_Z                   (1 << ARR_Z)
+#define OUT_B                   (1 << ARR_B)
+#define OUT_ALL                 ((1 << (ARR_B + 1)) - 1)
+#define OUT_GRAD                (1 << 10)                                             // Also the derivatives of the flux with respect to the parameters (not part of OUT_ALL)
+#define ARENA_ARRAYS            13                                                    // Arrays sharing the workspace arena: time, flux, bflx, M, E, f, r, x, y, z, b, cflx, cfl2
+
+// Gradients
+#define GRAD_PER                0                                                     // The parameters we differentiate the flux with respect to
+#define GRAD_RPRS               1
+#define GRAD_BCIRC              2
+#define GRAD_ARS                3                                                     // Or `rhos`, if that's what was given
+#define GRAD_ESW                4
+#define GRAD_ECW                5
+#define GRAD_T0                 6
+#define GRAD_U1                 7
+#define GRAD_U2                 8
+#define NGRAD                   9
+#define BASIS_ARRAYS            5                                                     // Arrays in the occultation function arena: lame, lamd, etad, lam1 and lam3
+#define BASIS_INT               1                                                     // The basis holds the integer terms...
+#define BASIS_HALF              2                                                     // ...and the half-integer ones of the nonlinear law too
+#define GRAD_ARRAYS             (4 * NGRAD)                                           // Arrays in the gradient arena: grad, bgrad, cgrd and cgr2 for each parameter
 
 // Numerical
-static double sqrarg;
-#define SQR(a) ((sqrarg=(a)) == 0.0 ? 0.0 : sqrarg*sqrarg)
-static double dmaxarg1, dmaxarg2;
-#define DMAX(a,b) (dmaxarg1=(a),dmaxarg2=(b),(dmaxarg1) > (dmaxarg2) ?\
-                  (dmaxarg1) : (dmaxarg2))
-static double dminarg1, dminarg2;
-#define DMIN(a,b) (dminarg1=(a),dminarg2=(b),(dminarg1) < (dminarg2) ?\
-                  (dminarg1) : (dminarg2))
+static inline double SQR(double a) { return a * a; }
+static inline double DMAX(double a, double b) { return (a > b) ? a : b; }
+static inline double DMIN(double a, double b) { return (a < b) ? a : b; }
+static inline int IMIN(int a, int b) { return (a < b) ? a : b; }
+static inline int IMAX(int a, int b) { return (a > b) ? a : b; }
+#if defined(__AVX512F__)
+#define FLUX_LANES 8                                                                  // Width of the vectorized flux kernel
+#else
+#define FLUX_LANES 4                                                                  // AVX2, or pairs of SSE2 registers in the portable build
+#endif
+#define LANES _Pragma("omp simd")                                                     // Vectorize the loop over lanes (needs -fopenmp-simd)
+#define LANES_ANY _Pragma("omp simd reduction(|:more)")                                  // Same, for loops that also check if any lane is still going
+#define FLUX_CHUNK 256                                                                // Points classified at a time by the flux kernel
+#define STREAM_BLOCK 2048                                                             // Points interpolated at a time into a float output
 #define RC_ERRTOL 0.04   
 #define RC_TINY 1.69e-38   
 #define RC_SQRTNY 1.3e-19   
@@ -66,6 +113,8 @@ static double dminarg1, dminarg2;
 #define RC_C2 (1.0/7.0)   
 #define RC_C3 0.375   
 #define RC_C4 (9.0/22.0)
+#define ELLPIC_TOL 1.e-8                                                              // Bulirsch's cel converges quadratically, so this gives ~1e-16
+#define ELLPIC_MAXIT 50
 #define RJ_ERRTOL 0.05   
 #define RJ_TINY 2.5e-13   
 #define RJ_BIG 9.0e11   
@@ -94,7 +143,36 @@ static double dminarg1, dminarg2;
 #define KEPLONGCAD              (1800./86400.)
 #define KEPSHRTEXP              (58.89/86400.)
 #define KEPSHRTCAD              (60./86400.)
-#define MAXTRANSITS             500
+
+#define ADAPTIVE_SEEDS          8                                                     // Initial number of pieces between contact points
+#define ADAPTIVE_MAXDEPTH       30                                                    // Maximum number of times we bisect those
+#define ADAPTIVE_MAXITER        200                                                   // Maximum number of iterations when bisecting for the contact points
+#define ADAPTIVE_TTOL           1.e-13                                                // Tolerance on the contact points, in units of the period
+#define ADAPTIVE_DT0            1.e-5                                                 // First step when looking for the contact points, in units of the period
+#define DIRECT_ADAPTIVE_PTS     0.5                                                   // The adaptive grid has about this many points over sqrt(fluxtol)...
+#define DIRECT_CONTACT_PTS      50                                                    // ...plus this many per contact point, for the purposes of AUTO mode
+#define DIRECT_MARGIN           1.2                                                   // Safety factor on the estimated transit duration in AUTO mode
+#define SYM_PROBES              16                                                    // Points either side of transit center where we check for symmetry
+#define SYM_APPROX              1                                                     // Symmetric to within `symtol`
+#define SYM_EXACT               2                                                     // Exactly symmetric (circular orbits)
+#define BOX_NEVER               0                                                     // Interpolate the binned flux on the grid...
+#define BOX_STRETCHED           1                                                     // ...except for stretched transits, which are averaged over the exposure...
+#define BOX_ALWAYS              2                                                     // ...or average all of it (the adaptive grid)
+#define TABLE_NU                64                                                    // Nodes per impact parameter segment in the flux lookup table
+#define TABLE_NP                128                                                   // Nodes in the radius ratio
+#define TABLE_PMIN              0.001                                                 // Range of RpRs covered by the flux lookup table
+#define TABLE_PMAX              0.5
+#define KEPLER_NODES            64                                                    // Intervals in the starter table of the batch Kepler solver (a power of two)
+#define KEPLER_ITER             3                                                     // Halley steps in lock-step before the batch Kepler solver gives up on a lane
+#define KEPLER_CHUNK            FLUX_CHUNK                                            // Most points the batch Kepler solver is handed at a time
+#define GRAD_ECC                1.e-8                                                 // Below this eccentricity, the gradients use the circular limit
+#define GRAD_SERIES             0.1                                                   // Below this elliptic parameter, the limb gradient is summed as a series
+
+// Instrumentation (only recorded when compiled with -DINSTRUMENT)
+#define STAGE_COMPUTE           0
+#define STAGE_BIN               1
+#define STAGE_INTERPOLATE       2
+#define NSTAGES                 3
 
 // Structs
 typedef struct {
@@ -110,7 +188,9 @@ typedef struct {
   double w;
   double aRs;
   int ntrans;
-  double tN[MAXTRANSITS];
+  double *tN;                                                                         // The `ntrans` transit times, sorted, or NULL if strictly periodic
+  double *dur;                                                                        // Optional duration of each transit relative to the model, or NULL
+  double *dep;                                                                        // Optional depth of each transit relative to the model, or NULL
 } TRANSIT;
 
 typedef struct {
@@ -125,13 +205,67 @@ typedef struct {
   double c4;
 } LIMBDARK;
 
+typedef struct {
+  double per;
+  double RpRs;
+  double MpMs;
+  double aRs;
+  double inc;
+  double ecc;
+  double w;
+  double tperi0;
+  double u1;
+  double u2;
+  double omega;
+  double c1;                                                                          // The coefficients of mu^(1/2) and mu^(3/2) in the nonlinear law, or zero
+  double c3;
+} PARAMS;
+
+typedef struct {
+  double ecc;
+  double M[KEPLER_NODES + 1];
+  double E[KEPLER_NODES + 1];
+  double dE[KEPLER_NODES + 1];
+} KEPLER;
+
+typedef struct {
+  int batches;                                                                        // Calls to the batch Kepler solver
+  int solves;                                                                         // Mean anomalies solved for
+  int blocks;                                                                         // Chunks of up to KEPLER_CHUNK points solved in lock-step
+  int iter;                                                                           // Halley steps, summed over chunks
+  int maxiter;                                                                        // Most Halley steps taken by any chunk
+  int fallback;                                                                       // Lanes finished by the scalar solver
+} KEPSTATS;
+
+typedef struct {
+  double time[NSTAGES];                                                               // Seconds spent in each stage, not counting the stages it called
+  long calls[NSTAGES];                                                                // Times each stage was entered
+  long kepsolves;                                                                     // Calls to the scalar Kepler solvers
+  long kepiter;                                                                       // Their iterations, plus those of the batch solver's fallback
+  long outside;                                                                       // Points the flux kernel found not to be occulted...
+  long limb;                                                                          // ...crossing the limb...
+  long inside;                                                                        // ...inside the stellar disk...
+  long special;                                                                       // ...or handed to the scalar code (rare cases and unconverged lanes)
+  long fluxpoint;                                                                     // Calls to the scalar occultation code
+  long rjbig;                                                                         // How many of those took the `1 + n > RJ_BIG` branches
+  long contact;                                                                       // And how many the limits at the inner contact point
+  long ellpic;                                                                        // Calls to the scalar elliptic integral of the third kind...
+  long ellpicit;                                                                      // ...and its iterations
+  long piblocks;                                                                      // Blocks of FLUX_LANES of them computed in lock-step...
+  long piblockit;                                                                     // ...and their iterations
+  long gridpts;                                                                       // Points on the grid the last time it was computed...
+  long maxpts;                                                                        // ...and the most it could have had
+  long lookups;                                                                       // Times interpolated onto
+  long search;                                                                        // Binary search steps on non-uniform grids (and among the transit times)
+} COUNTERS;
+
 typedef struct {
   int nstart;
   int nend;
   int ipts;
-  int calloc;
-  int balloc;
+  int nalloc;
   int ialloc;
+  double *arena;
   double *time;
   double *flux;
   double *bflx;
@@ -143,7 +277,33 @@ typedef struct {
   double *y;
   double *z;
   double *b;
+  double *cflx;
+  double *cfl2;
   double *iarr;  
+  double *garena;                                                                     // A separate arena for the gradients, allocated when they're first asked for
+  double *grad;                                                                       // d(flux)/d(parameter k) is at `grad + k * nalloc`
+  double *bgrad;                                                                      // Same for the binned flux
+  double *cgrd;                                                                       // Running integrals of the gradients, like `cflx` and `cfl2`
+  double *cgr2;
+  int galloc;
+  double *larena;                                                                     // A separate arena for the occultation functions on the uniform grid
+  double *lame;                                                                       // lambdae, lambdad and etad of Mandel and Agol (2002)
+  double *lamd;
+  double *etad;
+  double *lam1;                                                                       // The half-integer terms of the nonlinear law, less lambdae
+  double *lam3;
+  int lalloc;
+  int basis;                                                                          // Which of them hold the current model: none, BASIS_INT or BASIS_HALF
+  int computed;
+  int binned;
+  int integrated;
+  int outputs;
+  int nsym;
+  double tstart;                                                                      // Time at `nstart` on a uniform grid
+  double dt;                                                                          // Its step, or zero if the grid isn't uniform and `time` holds it instead
+  PARAMS par;
+  KEPSTATS kep;
+  COUNTERS prof;                                                                      // Only updated when compiled with -DINSTRUMENT
 } ARRAYS;
 
 typedef struct {
@@ -158,6 +318,13 @@ typedef struct {
   int computed;
   int binned;
   int kepsolver;
+  int outputs;
+  int gridmethod;
+  double fluxtol;
+  int evalmethod;
+  double symtol;
+  int fluxmethod;
+  double orbtol;                                                                      // Relative tolerance on the orbit between points of the adaptive grid, in full orbit mode
 } SETTINGS;
 
 // Functions
@@ -165,12 +332,44 @@ double ellec(double k);
 double ellk(double k);
 double rc(double x, double y, int *err);
 double rj(double x, double y, double z, double p, int *err);
+double ellpic(double n, double k, int *err);
 double rf(double x, double y, double z, int *err);
 double sgn(double x);
 double TrueAnomaly(double E, double ecc);
 double EccentricAnomalyFast(double dMeanA, double dEcc, double tol, int maxiter);
 double EccentricAnomaly(double dMeanA, double dEcc, double tol, int maxiter);
+int KeplerStarter(double ecc, KEPLER *kep);
+int EccentricAnomalyBatch(const double *M, int n, const KEPLER *kep, double tol, int maxiter, double *E, KEPSTATS *stats);
+int FluxPoint(double b, double RpRs, double *lambdae, double *lambdad, double *etad);
+int FluxKernel(const double *b, const double *z, int n, double RpRs, double *lambdae, double *lambdad, double *etad);
+int FluxTableKernel(const double *b, const double *z, int n, double RpRs, double *lambdae, double *lambdad, double *etad);
+double FluxTableError(double u1, double u2);
+void NonlinearPoint(double b, double p, double *lambda1, double *lambda3);
+int NonlinearKernel(const double *b, const double *z, int n, double RpRs, double *lambda1, double *lambda3);
+double NonlinearTableError(double c1, double c2, double c3, double c4);
+int SaveFluxTable(const char *path);
+int LoadFluxTable(const char *path);
+int Setup(const TRANSIT *transit, const LIMBDARK *limbdark, PARAMS *par);
+int ComputeR(const TRANSIT *transit, const LIMBDARK *limbdark, const SETTINGS *settings, ARRAYS *arr);
+int BinR(const TRANSIT *transit, const LIMBDARK *limbdark, const SETTINGS *settings, ARRAYS *arr);
+int InterpolateR(const double *t, int ipts, int array, const TRANSIT *transit, const LIMBDARK *limbdark, const SETTINGS *settings, ARRAYS *arr, double *out);
+int Expose(const double *t, const double *texp, int ipts, const double *kt, const double *kv, int nk, const TRANSIT *transit, const LIMBDARK *limbdark, const SETTINGS *settings, ARRAYS *arr, double *out);
+int InterpolateGrad(const double *t, int ipts, int array, const TRANSIT *transit, const LIMBDARK *limbdark, const SETTINGS *settings, ARRAYS *arr, double *out, double *grad);
 int Compute(TRANSIT *transit, LIMBDARK *limbdark, SETTINGS *settings, ARRAYS *arr);
 int Bin(TRANSIT *transit, LIMBDARK *limbdark, SETTINGS *settings, ARRAYS *arr);
+int Recompose(TRANSIT *transit, LIMBDARK *limbdark, SETTINGS *settings, ARRAYS *arr);
+int Reuse(TRANSIT *transit, LIMBDARK *limbdark, SETTINGS *settings, ARRAYS *arr);
+int InterpolateStream(const double *t, int ipts, int array, TRANSIT *transit, LIMBDARK *limbdark, SETTINGS *settings, ARRAYS *arr, double *out, int *nt);
+int InterpolateStreamFloat(const double *t, int ipts, int array, TRANSIT *transit, LIMBDARK *limbdark, SETTINGS *settings, ARRAYS *arr, float *out, int *nt);
+int InterpolateInto(double *t, int ipts, int array, TRANSIT *transit, LIMBDARK *limbdark, SETTINGS *settings, ARRAYS *arr, double *out);
 int Interpolate(double *t, int ipts, int array, TRANSIT *transit, LIMBDARK *limbdark, SETTINGS *settings, ARRAYS *arr);
-void dbl_free(double *ptr);
\ No newline at end of file
+int ComputeBatch(double *t, int ipts, int array, int nbatch, TRANSIT *transit, LIMBDARK *limbdark, SETTINGS *settings, double *out, int *err, int nthreads);
+int ComputeSystem(const double *t, int ipts, int array, int nplanets, const TRANSIT *transit, const LIMBDARK *limbdark, const SETTINGS *settings, ARRAYS *arr, double *out, int *err, int nthreads);
+void ArenaRetain(double *arena);
+void ArenaRelease(double *arena);
+void FreeArrays(ARRAYS *arr);
+int Instrumented(void);
+int Workspace(ARRAYS *arr, int npts);
+void dbl_free(double *ptr);
+int PoolThreads(int nthreads);
+int PoolRun(int ntasks, void (*fn)(int, void *), void *data, int nthreads);
\ No newline at end of file
@@ -12,7 +12,6 @@ transit model
              watch out for a possible offset of :math:`\pi` from what you're used to.
 
 .. todo::
-   - Add nonlinear limb darkening
    - Add secondary eclipses
    
 '''
@@ -21,6 +20,7 @@ from __future__ import division, print_function, absolute_import, unicode_litera
 import ctypes
 import numpy as np
 import os
+from collections import OrderedDict
 from numpy.ctypeslib import ndpointer, as_ctypes
 
 # Define errors
@@ -43,6 +43,10 @@ _ERR_RHOS             =   15
 _ERR_ECC_W            =   16                                                          # Bad eccentricity/omega
 _ERR_LD               =   17                                                          # Bad limb darkening coeffs
 _ERR_T0               =   18                                                          # Bad t0
+_ERR_ALLOC            =   19                                                          # Out of memory
+_ERR_TABLE            =   20                                                          # Unable to read or write the flux lookup table
+_ERR_KERNEL           =   21                                                          # Bad exposure kernel
+_ERR_EPOCH            =   22                                                          # Bad per-transit duration scaling
 
 # Define models
 QUADRATIC  =              0
@@ -54,6 +58,14 @@ SMARTINT   =              7
 SLOWINT    =              8
 MDFAST     =              9
 NEWTON     =              10
+UNIFORM    =              11
+ADAPTIVE   =              12
+GRID       =              13
+DIRECT     =              14
+AUTO       =              15
+ANALYTIC   =              16
+TABLE      =              17
+HALLEY     =              18
 
 # Cadences
 KEPLONGEXP =              (1765.5/86400.)
@@ -73,9 +85,21 @@ _ARR_Y       =             7
 _ARR_Z       =             8
 _ARR_B       =             9
 
+# Gradients
+GRADPARAMS  =             ['per', 'RpRs', 'bcirc', 'aRs', 'esw', 'ecw', 't0', 'u1', 'u2']
+_NGRAD      =             len(GRADPARAMS)
+
+# The inputs that don't change the model grid
+_NOTSHAPE   =             ['t0', 'ntrans', '_tN', '_dur', '_dep', 'computed', 'binned']
+
+# Instrumentation
+STAGES      =             ['compute', 'bin', 'interpolate']
+
 # Other
-MAXTRANSITS =             500
-TRANSITSARR =             ctypes.c_double * MAXTRANSITS
+KEPLER_NODES =            64
+KEPLERARR   =             ctypes.c_double * (KEPLER_NODES + 1)
+STREAM_CHUNK =            65536
+CACHE_SIZE  =             8
 G           =             6.672e-8
 DAYSEC      =             86400.
 
@@ -97,12 +121,15 @@ class TRANSIT(ctypes.Structure):
                   ("w", ctypes.c_double),
                   ("aRs", ctypes.c_double),
                   ("ntrans", ctypes.c_int),
-                  ("_tN", TRANSITSARR)]
+                  ("_tN", ctypes.POINTER(ctypes.c_double)),
+                  ("_dur", ctypes.POINTER(ctypes.c_double)),
+                  ("_dep", ctypes.POINTER(ctypes.c_double))]
       
       def __init__(self, **kwargs):
         self._tN_p = []
-        self._tN = TRANSITSARR(*self._tN_p)
-        self.ntrans = len(self._tN_p)     
+        self._durscale = None
+        self._depscale = None
+        self._Epochs()
         self.update(**kwargs)
         
       def update(self, **kwargs):
@@ -134,11 +161,35 @@ class TRANSIT(ctypes.Structure):
                 
         self.t0 = kwargs.pop('t0', 0.)                                                # User may specify either ``t0`` or ``times``
         tN = kwargs.pop('times', None)
+        durscale = kwargs.pop('durscale', None)
+        depscale = kwargs.pop('depscale', None)
         if tN is not None:
           self.t0 = np.nan
-          self._tN_p = tN                                                             # The transit times. NOTE: Must be sorted!
-          self._tN = TRANSITSARR(*self._tN_p)
-          self.ntrans = len(self._tN_p)                                               # Number of transits; only used if tN is set (i.e., for TTVs)
+          self._tN_p = tN                                                             # The transit times, in any order
+        if (tN is not None) or (durscale is not None) or (depscale is not None):
+          self._durscale = durscale                                                   # Optional duration and depth of each transit relative to the model
+          self._depscale = depscale
+          self._Epochs()
+      
+      def _Epochs(self):
+        '''
+        Sorts the transit times (and the per-transit scalings along with them) into
+        the arrays that get passed to C, which must stay alive as long as we do
+        
+        '''
+        
+        tN = np.array(self._tN_p, dtype = 'float64').reshape(-1)
+        order = np.argsort(tN, kind = 'mergesort')
+        self.ntrans = len(tN)                                                         # Number of transits; only used if tN is set (i.e., for TTVs)
+        self._epochs = []
+        for field, value in [('_tN', tN), ('_dur', self._durscale), ('_dep', self._depscale)]:
+          if value is None:
+            setattr(self, field, None)
+            continue
+          arr = np.ascontiguousarray(np.broadcast_to(np.asarray(value, dtype = 'float64'), 
+                                                     tN.shape)[order])
+          self._epochs.append(arr)
+          setattr(self, field, arr.ctypes.data_as(ctypes.POINTER(ctypes.c_double)))
       
       @property
       def times(self):
@@ -147,8 +198,7 @@ class TRANSIT(ctypes.Structure):
       @times.setter
       def times(self, value):
         self._tN_p = value
-        self.ntrans = len(self._tN_p)
-        self._tN = TRANSITSARR(*self._tN_p)                                           # The pointer version that gets passed to C
+        self._Epochs()
       
       @property
       def duration(self):
@@ -206,6 +256,93 @@ class LIMBDARK(ctypes.Structure):
           self.u1 = np.nan
           self.u2 = np.nan 
                   
+class PARAMS(ctypes.Structure):
+      '''
+      The derived (validated) orbital and limb darkening parameters
+      
+      '''
+      
+      _fields_ = [("per", ctypes.c_double),
+                  ("RpRs", ctypes.c_double),
+                  ("MpMs", ctypes.c_double),
+                  ("aRs", ctypes.c_double),
+                  ("inc", ctypes.c_double),
+                  ("ecc", ctypes.c_double),
+                  ("w", ctypes.c_double),
+                  ("tperi0", ctypes.c_double),
+                  ("u1", ctypes.c_double),
+                  ("u2", ctypes.c_double),
+                  ("omega", ctypes.c_double),
+                  ("c1", ctypes.c_double),
+                  ("c3", ctypes.c_double)]
+
+class KEPSTATS(ctypes.Structure):
+      '''
+      Iteration statistics of the batch Kepler solver (`kepsolver = ps.HALLEY`)
+      for the last model computed
+      
+      '''
+      
+      _fields_ = [("batches", ctypes.c_int),
+                  ("solves", ctypes.c_int),
+                  ("blocks", ctypes.c_int),
+                  ("iter", ctypes.c_int),
+                  ("maxiter", ctypes.c_int),
+                  ("fallback", ctypes.c_int)]
+
+class COUNTERS(ctypes.Structure):
+      '''
+      Hot path counters and per-stage timings, recorded only when the library
+      was compiled with `make INSTRUMENT=1`
+      
+      '''
+      
+      _fields_ = [("time", ctypes.c_double * len(STAGES)),
+                  ("calls", ctypes.c_long * len(STAGES)),
+                  ("kepsolves", ctypes.c_long),
+                  ("kepiter", ctypes.c_long),
+                  ("outside", ctypes.c_long),
+                  ("limb", ctypes.c_long),
+                  ("inside", ctypes.c_long),
+                  ("special", ctypes.c_long),
+                  ("fluxpoint", ctypes.c_long),
+                  ("rjbig", ctypes.c_long),
+                  ("contact", ctypes.c_long),
+                  ("ellpic", ctypes.c_long),
+                  ("ellpicit", ctypes.c_long),
+                  ("piblocks", ctypes.c_long),
+                  ("piblockit", ctypes.c_long),
+                  ("gridpts", ctypes.c_long),
+                  ("maxpts", ctypes.c_long),
+                  ("lookups", ctypes.c_long),
+                  ("search", ctypes.c_long)]
+
+class KEPLER(ctypes.Structure):
+      '''
+      The starter table of the batch Kepler solver
+      
+      '''
+      
+      _fields_ = [("ecc", ctypes.c_double),
+                  ("M", KEPLERARR),
+                  ("E", KEPLERARR),
+                  ("dE", KEPLERARR)]
+                  
+class _ArenaRef(object):
+      '''
+      A reference to a C arena, given up when this goes away. The NumPy views of
+      the arrays in it hold one each.
+      
+      '''
+      
+      def __init__(self, arena):
+        self.arena = ctypes.cast(arena, ctypes.c_void_p)
+        _ArenaRetain(self.arena)
+      
+      def __del__(self):
+        if _ArenaRelease is not None:
+          _ArenaRelease(self.arena)
+
 class ARRAYS(ctypes.Structure):
       '''
       The class that stores the input and output arrays
@@ -215,9 +352,9 @@ class ARRAYS(ctypes.Structure):
       _fields_ = [("nstart", ctypes.c_int),
                   ("nend", ctypes.c_int),
                   ("ipts", ctypes.c_int),
-                  ("_calloc", ctypes.c_int),
-                  ("_balloc", ctypes.c_int),
+                  ("_nalloc", ctypes.c_int),
                   ("_ialloc", ctypes.c_int),
+                  ("_arena", ctypes.POINTER(ctypes.c_double)),
                   ("_time", ctypes.POINTER(ctypes.c_double)),
                   ("_flux", ctypes.POINTER(ctypes.c_double)),
                   ("_bflx", ctypes.POINTER(ctypes.c_double)),
@@ -229,63 +366,145 @@ class ARRAYS(ctypes.Structure):
                   ("_y", ctypes.POINTER(ctypes.c_double)),
                   ("_z", ctypes.POINTER(ctypes.c_double)),
                   ("_b", ctypes.POINTER(ctypes.c_double)),
-                  ("_iarr", ctypes.POINTER(ctypes.c_double))]
+                  ("_cflx", ctypes.POINTER(ctypes.c_double)),
+                  ("_cfl2", ctypes.POINTER(ctypes.c_double)),
+                  ("_iarr", ctypes.POINTER(ctypes.c_double)),
+                  ("_garena", ctypes.POINTER(ctypes.c_double)),
+                  ("_grad", ctypes.POINTER(ctypes.c_double)),
+                  ("_bgrad", ctypes.POINTER(ctypes.c_double)),
+                  ("_cgrd", ctypes.POINTER(ctypes.c_double)),
+                  ("_cgr2", ctypes.POINTER(ctypes.c_double)),
+                  ("_galloc", ctypes.c_int),
+                  ("_larena", ctypes.POINTER(ctypes.c_double)),
+                  ("_lame", ctypes.POINTER(ctypes.c_double)),
+                  ("_lamd", ctypes.POINTER(ctypes.c_double)),
+                  ("_etad", ctypes.POINTER(ctypes.c_double)),
+                  ("_lam1", ctypes.POINTER(ctypes.c_double)),
+                  ("_lam3", ctypes.POINTER(ctypes.c_double)),
+                  ("_lalloc", ctypes.c_int),
+                  ("basis", ctypes.c_int),
+                  ("computed", ctypes.c_int),
+                  ("binned", ctypes.c_int),
+                  ("integrated", ctypes.c_int),
+                  ("outputs", ctypes.c_int),
+                  ("nsym", ctypes.c_int),
+                  ("tstart", ctypes.c_double),
+                  ("dt", ctypes.c_double),
+                  ("par", PARAMS),
+                  ("kep", KEPSTATS),
+                  ("prof", COUNTERS)]
                   
       def __init__(self, **kwargs):                
         self.nstart = 0
         self.nend = 0
         self.ipts = 0
-        self._calloc = 0
-        self._balloc = 0
+        self._nalloc = 0
         self._ialloc = 0
+        self._galloc = 0
+        self._lalloc = 0
+        self.basis = 0
+        self.computed = 0
+        self.binned = 0
+        self.integrated = 0
+        self.outputs = 0
+        self.nsym = 0
+        self.tstart = 0.
+        self.dt = 0.
+      
+      def __del__(self):
+        '''
+        The C arrays are freed when this structure goes away, or, if there are
+        NumPy views of them handed out by the properties below, when the last
+        of those does
+        
+        '''
+        
+        if self._b_needsfree_ and (_FreeArrays is not None):                          # Not if we're an element of an array of ARRAYS
+          _FreeArrays(self)
+      
+      def _View(self, arena, ptr, shape, index):
+        '''
+        A read-only NumPy view of the `shape`-shaped C array at `ptr`, which lies
+        in `arena`, indexed by `index`. No data is copied. The view holds a 
+        reference to the arena, so the memory stays valid for as long as the view
+        is around, even once the workspace is freed with :py:meth:`Transit.Free` 
+        or regrown because `maxpts` grew. While the workspace still uses it, the
+        view reflects the current model, and is overwritten when the model is 
+        recomputed; copy it to keep it.
+        
+        '''
+        
+        if not ptr:
+          return np.empty(shape)[index]
+        buf = (ctypes.c_double * int(np.prod(shape))).from_address(ctypes.addressof(ptr.contents))
+        buf._owner = _ArenaRef(arena)
+        view = np.frombuffer(buf, dtype = 'float64').reshape(shape)[index]
+        view.flags.writeable = False
+        return view
+      
+      def _Array(self, ptr):
+        return self._View(self._arena, ptr, (self._nalloc,), slice(self.nstart, self.nend))
+      
+      def _Grad(self, ptr):
+        return self._View(self._garena, ptr, (_NGRAD, self._galloc), (slice(None), slice(self.nstart, self.nend)))
       
       @property
       def time(self):
-        return np.array([self._time[i] for i in range(self.nstart, self.nend)])
+        if self.dt:                                                                   # Uniform grids are implicit
+          return self.tstart + self.dt * np.arange(self.nend - self.nstart)
+        return self._Array(self._time)
       
       @property
       def flux(self):
-        return np.array([self._flux[i] for i in range(self.nstart, self.nend)])
+        return self._Array(self._flux)
         
       @property
       def bflx(self):
-        return np.array([self._bflx[i] for i in range(self.nstart, self.nend)])
+        return self._Array(self._bflx)
 
       @property
       def M(self):
-        return np.array([self._M[i] for i in range(self.nstart, self.nend)])
+        return self._Array(self._M)
         
       @property
       def E(self):
-        return np.array([self._E[i] for i in range(self.nstart, self.nend)])
+        return self._Array(self._E)
         
       @property
       def f(self):
-        return np.array([self._f[i] for i in range(self.nstart, self.nend)])
+        return self._Array(self._f)
         
       @property
       def r(self):
-        return np.array([self._r[i] for i in range(self.nstart, self.nend)])
+        return self._Array(self._r)
       
       @property
       def x(self):
-        return np.array([self._x[i] for i in range(self.nstart, self.nend)])
+        return self._Array(self._x)
         
       @property
       def y(self):
-        return np.array([self._y[i] for i in range(self.nstart, self.nend)])
+        return self._Array(self._y)
       
       @property
       def z(self):
-        return np.array([self._z[i] for i in range(self.nstart, self.nend)])
+        return self._Array(self._z)
       
       @property
       def b(self):
-        return np.array([self._b[i] for i in range(self.nstart, self.nend)])
+        return self._Array(self._b)
+      
+      @property
+      def grad(self):
+        return self._Grad(self._grad)
+      
+      @property
+      def bgrad(self):
+        return self._Grad(self._bgrad)
       
       @property
       def iarr(self):
-        return np.array([self._iarr[i] for i in range(self.ipts)])
+        return self._View(self._iarr, self._iarr, (self.ipts,), slice(None))
              
 class SETTINGS(ctypes.Structure):
       '''
@@ -302,7 +521,14 @@ class SETTINGS(ctypes.Structure):
                   ("maxkepiter", ctypes.c_int),
                   ("computed", ctypes.c_int),
                   ("binned", ctypes.c_int),
-                  ("kepsolver", ctypes.c_int)]
+                  ("kepsolver", ctypes.c_int),
+                  ("outputs", ctypes.c_int),
+                  ("gridmethod", ctypes.c_int),
+                  ("fluxtol", ctypes.c_double),
+                  ("evalmethod", ctypes.c_int),
+                  ("symtol", ctypes.c_double),
+                  ("fluxmethod", ctypes.c_int),
+                  ("orbtol", ctypes.c_double)]
       
       def __init__(self, **kwargs):
         self.exptime = KEPLONGEXP
@@ -314,6 +540,13 @@ class SETTINGS(ctypes.Structure):
         self.keptol = 1.e-15
         self.maxkepiter = 100
         self.kepsolver = NEWTON
+        self.outputs = 0
+        self.gridmethod = UNIFORM
+        self.fluxtol = 1.e-6
+        self.evalmethod = GRID
+        self.symtol = 0.
+        self.fluxmethod = ANALYTIC
+        self.orbtol = 1.e-6
         self.update(**kwargs)
       
       def update(self, **kwargs):
@@ -330,6 +563,13 @@ class SETTINGS(ctypes.Structure):
         self.keptol = kwargs.pop('keptol', self.keptol)                               # Kepler solver tolerance
         self.maxkepiter = kwargs.pop('maxkepiter', self.maxkepiter)                   # Maximum number of iterations in Kepler solver
         self.kepsolver = kwargs.pop('kepsolver', self.kepsolver)                      # Newton solver or fast M&D solver?
+        self.outputs = _Outputs(kwargs.pop('outputs', self.outputs))                  # Which arrays to store (zero means all of them)
+        self.gridmethod = kwargs.pop('gridmethod', self.gridmethod)                   # Uniform or adaptive time grid?
+        self.fluxtol = kwargs.pop('fluxtol', self.fluxtol)                            # Flux tolerance for the adaptive grid
+        self.evalmethod = kwargs.pop('evalmethod', self.evalmethod)                   # Evaluate on a grid, directly, or pick automatically?
+        self.symtol = kwargs.pop('symtol', self.symtol)                               # Mirror the light curve about transit center if it's this symmetric
+        self.fluxmethod = kwargs.pop('fluxmethod', self.fluxmethod)                   # Compute the occultation functions exactly, or interpolate them?
+        self.orbtol = kwargs.pop('orbtol', self.orbtol)                               # Relative tolerance on the orbit for the adaptive grid in full orbit mode
         self.computed = 0
         self.binned = 0
 
@@ -350,6 +590,16 @@ _Bin.restype = ctypes.c_int
 _Bin.argtypes = [ctypes.POINTER(TRANSIT), ctypes.POINTER(LIMBDARK), 
                 ctypes.POINTER(SETTINGS), ctypes.POINTER(ARRAYS)]
 
+_Reuse = lib.Reuse
+_Reuse.restype = ctypes.c_int
+_Reuse.argtypes = [ctypes.POINTER(TRANSIT), ctypes.POINTER(LIMBDARK), 
+                  ctypes.POINTER(SETTINGS), ctypes.POINTER(ARRAYS)]
+
+_Recompose = lib.Recompose
+_Recompose.restype = ctypes.c_int
+_Recompose.argtypes = [ctypes.POINTER(TRANSIT), ctypes.POINTER(LIMBDARK), 
+                      ctypes.POINTER(SETTINGS), ctypes.POINTER(ARRAYS)]
+
 _Interpolate = lib.Interpolate
 _Interpolate.restype = ctypes.c_int
 _Interpolate.argtypes = [ndpointer(dtype=ctypes.c_double),
@@ -359,6 +609,129 @@ _Interpolate.argtypes = [ndpointer(dtype=ctypes.c_double),
                         ctypes.POINTER(LIMBDARK), ctypes.POINTER(SETTINGS), 
                         ctypes.POINTER(ARRAYS)]
 
+_InterpolateInto = lib.InterpolateInto
+_InterpolateInto.restype = ctypes.c_int
+_InterpolateInto.argtypes = [ndpointer(dtype=ctypes.c_double),
+                            ctypes.c_int, ctypes.c_int,
+                            ctypes.POINTER(TRANSIT), ctypes.POINTER(LIMBDARK),
+                            ctypes.POINTER(SETTINGS), ctypes.POINTER(ARRAYS),
+                            ndpointer(dtype=ctypes.c_double)]
+
+_InterpolateStream = lib.InterpolateStream
+_InterpolateStream.restype = ctypes.c_int
+_InterpolateStream.argtypes = [ndpointer(dtype=ctypes.c_double, flags='C_CONTIGUOUS'),
+                              ctypes.c_int, ctypes.c_int,
+                              ctypes.POINTER(TRANSIT), ctypes.POINTER(LIMBDARK),
+                              ctypes.POINTER(SETTINGS), ctypes.POINTER(ARRAYS),
+                              ndpointer(dtype=ctypes.c_double, flags='C_CONTIGUOUS'),
+                              ctypes.POINTER(ctypes.c_int)]
+
+_InterpolateStreamFloat = lib.InterpolateStreamFloat
+_InterpolateStreamFloat.restype = ctypes.c_int
+_InterpolateStreamFloat.argtypes = [ndpointer(dtype=ctypes.c_double, flags='C_CONTIGUOUS'),
+                                    ctypes.c_int, ctypes.c_int,
+                                    ctypes.POINTER(TRANSIT), ctypes.POINTER(LIMBDARK),
+                                    ctypes.POINTER(SETTINGS), ctypes.POINTER(ARRAYS),
+                                    ndpointer(dtype=ctypes.c_float, flags='C_CONTIGUOUS'),
+                                    ctypes.POINTER(ctypes.c_int)]
+
+_InterpolateR = lib.InterpolateR
+_InterpolateR.restype = ctypes.c_int
+_InterpolateR.argtypes = [ndpointer(dtype=ctypes.c_double),
+                         ctypes.c_int,
+                         ctypes.c_int,
+                         ctypes.POINTER(TRANSIT), 
+                         ctypes.POINTER(LIMBDARK), ctypes.POINTER(SETTINGS), 
+                         ctypes.POINTER(ARRAYS),
+                         ndpointer(dtype=ctypes.c_double, flags='C_CONTIGUOUS')]
+
+_Expose = lib.Expose
+_Expose.restype = ctypes.c_int
+_Expose.argtypes = [ndpointer(dtype=ctypes.c_double, flags='C_CONTIGUOUS'),
+                   ctypes.c_void_p, ctypes.c_int,
+                   ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int,
+                   ctypes.POINTER(TRANSIT), 
+                   ctypes.POINTER(LIMBDARK), ctypes.POINTER(SETTINGS), 
+                   ctypes.POINTER(ARRAYS),
+                   ndpointer(dtype=ctypes.c_double, flags='C_CONTIGUOUS')]
+
+_InterpolateGrad = lib.InterpolateGrad
+_InterpolateGrad.restype = ctypes.c_int
+_InterpolateGrad.argtypes = [ndpointer(dtype=ctypes.c_double, flags='C_CONTIGUOUS'),
+                            ctypes.c_int,
+                            ctypes.c_int,
+                            ctypes.POINTER(TRANSIT), 
+                            ctypes.POINTER(LIMBDARK), ctypes.POINTER(SETTINGS), 
+                            ctypes.POINTER(ARRAYS),
+                            ndpointer(dtype=ctypes.c_double, flags='C_CONTIGUOUS'),
+                            ndpointer(dtype=ctypes.c_double, flags='C_CONTIGUOUS')]
+
+_FreeArrays = lib.FreeArrays
+_FreeArrays.argtypes = [ctypes.POINTER(ARRAYS)]
+
+_ArenaRetain = lib.ArenaRetain
+_ArenaRetain.argtypes = [ctypes.c_void_p]
+
+_ArenaRelease = lib.ArenaRelease
+_ArenaRelease.argtypes = [ctypes.c_void_p]
+
+_ComputeSystem = lib.ComputeSystem
+_ComputeSystem.restype = ctypes.c_int
+_ComputeSystem.argtypes = [ndpointer(dtype=ctypes.c_double, flags='C_CONTIGUOUS'),
+                          ctypes.c_int,
+                          ctypes.c_int,
+                          ctypes.c_int,
+                          ctypes.POINTER(TRANSIT), 
+                          ctypes.POINTER(LIMBDARK), ctypes.POINTER(SETTINGS),
+                          ctypes.POINTER(ARRAYS),
+                          ndpointer(dtype=ctypes.c_double, flags='C_CONTIGUOUS'),
+                          ndpointer(dtype=ctypes.c_int, flags='C_CONTIGUOUS'),
+                          ctypes.c_int]
+
+_Instrumented = lib.Instrumented
+_Instrumented.restype = ctypes.c_int
+_Instrumented.argtypes = []
+
+_ComputeBatch = lib.ComputeBatch
+_ComputeBatch.restype = ctypes.c_int
+_ComputeBatch.argtypes = [ndpointer(dtype=ctypes.c_double),
+                         ctypes.c_int,
+                         ctypes.c_int,
+                         ctypes.c_int,
+                         ctypes.POINTER(TRANSIT), 
+                         ctypes.POINTER(LIMBDARK), ctypes.POINTER(SETTINGS),
+                         ndpointer(dtype=ctypes.c_double, flags='C_CONTIGUOUS'),
+                         ndpointer(dtype=ctypes.c_int, flags='C_CONTIGUOUS'),
+                         ctypes.c_int]
+
+_SaveFluxTable = lib.SaveFluxTable
+_SaveFluxTable.restype = ctypes.c_int
+_SaveFluxTable.argtypes = [ctypes.c_char_p]
+
+_LoadFluxTable = lib.LoadFluxTable
+_LoadFluxTable.restype = ctypes.c_int
+_LoadFluxTable.argtypes = [ctypes.c_char_p]
+
+_FluxTableError = lib.FluxTableError
+_FluxTableError.restype = ctypes.c_double
+_FluxTableError.argtypes = [ctypes.c_double, ctypes.c_double]
+
+_NonlinearTableError = lib.NonlinearTableError
+_NonlinearTableError.restype = ctypes.c_double
+_NonlinearTableError.argtypes = [ctypes.c_double, ctypes.c_double, ctypes.c_double, ctypes.c_double]
+
+_KeplerStarter = lib.KeplerStarter
+_KeplerStarter.restype = ctypes.c_int
+_KeplerStarter.argtypes = [ctypes.c_double, ctypes.POINTER(KEPLER)]
+
+_EccentricAnomalyBatch = lib.EccentricAnomalyBatch
+_EccentricAnomalyBatch.restype = ctypes.c_int
+_EccentricAnomalyBatch.argtypes = [ndpointer(dtype=ctypes.c_double, flags='C_CONTIGUOUS'),
+                                  ctypes.c_int, ctypes.POINTER(KEPLER),
+                                  ctypes.c_double, ctypes.c_int,
+                                  ndpointer(dtype=ctypes.c_double, flags='C_CONTIGUOUS'),
+                                  ctypes.POINTER(KEPSTATS)]
+
 _dbl_free = lib.dbl_free
 _dbl_free.argtypes = [ctypes.POINTER(ctypes.c_double)]
 
@@ -400,11 +773,209 @@ def RaiseError(err):
     raise Exception("Bad value for the limb darkening coefficients.") 
   elif (err == _ERR_T0):
     raise Exception("Bad value for ``t0``.")
+  elif (err == _ERR_ALLOC):
+    raise Exception("Unable to allocate memory for the model arrays.")
+  elif (err == _ERR_TABLE):
+    raise Exception("Unable to read or write the flux lookup table.")
+  elif (err == _ERR_KERNEL):
+    raise Exception("Bad exposure kernel.")
+  elif (err == _ERR_EPOCH):
+    raise Exception("Bad value for ``durscale``.")
   elif (err == _ERR_KEPLER):
     raise Exception("Error in Kepler solver.")
   else:
     raise Exception("Error in transit computation (%d)." % err)
 
+def SaveFluxTable(path):
+  '''
+  Saves the flux lookup table used by `fluxmethod = ps.TABLE` to `path`, building it
+  first if needed, so that other processes can load it instead of building it
+  
+  '''
+  
+  err = _SaveFluxTable(path.encode('utf-8'))
+  if err != _ERR_NONE: RaiseError(err)
+
+def LoadFluxTable(path):
+  '''
+  Loads a flux lookup table saved with :py:func:`SaveFluxTable`
+  
+  '''
+  
+  err = _LoadFluxTable(path.encode('utf-8'))
+  if err != _ERR_NONE: RaiseError(err)
+
+def FluxTableError(u1 = 0.40, u2 = 0.26):
+  '''
+  Returns an estimate of the largest error in the (normalized) flux computed with
+  `fluxmethod = ps.TABLE`, for the quadratic limb darkening coefficients `u1` and `u2`
+  
+  '''
+  
+  return _FluxTableError(u1, u2)
+
+def NonlinearTableError(c1, c2, c3, c4):
+  '''
+  Returns an estimate of the largest error in the (normalized) flux due to the
+  lookup table of the half-integer terms of the nonlinear limb darkening law,
+  for the coefficients `c1` through `c4`. The first call takes a few seconds.
+  
+  '''
+  
+  return _NonlinearTableError(c1, c2, c3, c4)
+
+def EccentricAnomaly(M, ecc, keptol = 1.e-15, maxkepiter = 100):
+  '''
+  Solves Kepler's equation for an array of mean anomalies `M` at once with the
+  batch solver used by `kepsolver = ps.HALLEY`
+  
+  :returns: A tuple `(E, stats)`, where `E` is the array of eccentric anomalies and \
+            `stats` is a :py:class:`KEPSTATS` instance with the iteration statistics
+  
+  '''
+  
+  M = np.ascontiguousarray(M, dtype = 'float64')
+  E = np.empty_like(M)
+  kep = KEPLER()
+  stats = KEPSTATS()
+  err = _KeplerStarter(ecc, kep)
+  if err != _ERR_NONE: RaiseError(err)
+  err = _EccentricAnomalyBatch(M, len(M), kep, keptol, maxkepiter, E, stats)
+  if err != _ERR_NONE: RaiseError(err)
+  return E, stats
+
+def TrapezoidKernel(ramp):
+  '''
+  An exposure kernel for a shutter that takes `ramp` (in units of the exposure
+  time) to open and to close, for use with the `kernel` argument of :py:class:`Transit`.
+  The effective exposure time is unchanged.
+  
+  '''
+  
+  return ([-0.5 - 0.5 * ramp, -0.5 + 0.5 * ramp, 0.5 - 0.5 * ramp, 0.5 + 0.5 * ramp],
+          [0., 1., 1., 0.])
+
+def SmearKernel(readout, fraction):
+  '''
+  An exposure kernel for a frame that keeps collecting light while it's read out
+  for `readout` (in units of the exposure time) after the exposure ends, so that a
+  `fraction` of the signal is smeared over the readout, for use with the `kernel`
+  argument of :py:class:`Transit`
+  
+  '''
+  
+  level = fraction / ((1. - fraction) * readout)
+  return ([-0.5, 0.5, 0.5, 0.5 + readout], [1., 1., level, level])
+
+def _ArrayID(param):
+  '''
+  Returns the C array ID corresponding to the user-facing name `param`
+  
+  '''
+  
+  arrays = {'binned': _ARR_BFLX, 'unbinned': _ARR_FLUX, 'M': _ARR_M, 'E': _ARR_E,
+            'f': _ARR_F, 'r': _ARR_R, 'x': _ARR_X, 'y': _ARR_Y, 'z': _ARR_Z, 
+            'b': _ARR_B}
+  if param not in arrays:
+    RaiseError(_ERR_NOT_IMPLEMENTED)
+  return arrays[param]
+
+def _Outputs(outputs):
+  '''
+  Returns the bitmask of arrays to compute for `outputs`, which may be
+  either a bitmask or a list of array names (e.g., `['binned']`)
+  
+  '''
+  
+  if isinstance(outputs, (int, np.integer)):
+    return int(outputs)
+  mask = 0
+  for param in outputs:
+    mask |= 1 << _ArrayID(param)
+  return mask
+
+def _Output(out, shape, dtype = 'float64'):
+  '''
+  Returns `out` if it's a buffer the C code can write `shape` values of type
+  `dtype` into directly, or a new one if it's `None`
+  
+  '''
+  
+  if out is None:
+    return np.empty(shape, dtype = dtype)
+  if (not isinstance(out, np.ndarray)) or (out.dtype != np.dtype(dtype)) or (out.shape != shape) or \
+     (not out.flags.c_contiguous) or (not out.flags.writeable):
+    raise ValueError("The output array must be a writeable, C-contiguous %s array of shape %s." % (dtype, shape))
+  return out
+
+def _MapFile(path, n = None, dtype = 'float64'):
+  '''
+  Memory-maps the float64 array in the file at `path`, which is either a `.npy`
+  file or a raw binary one in native byte order. If `n` is given, the file is
+  created (or overwritten) to hold `n` values of type `dtype` instead.
+  
+  '''
+  
+  if path.endswith('.npy'):
+    if n is None:
+      return np.load(path, mmap_mode = 'r')
+    return np.lib.format.open_memmap(path, mode = 'w+', dtype = dtype, shape = (n,))
+  if n is None:
+    return np.memmap(path, dtype = 'float64', mode = 'r')
+  return np.memmap(path, dtype = dtype, mode = 'w+', shape = (n,))
+
+def _ShapeKey(*structs):
+  '''
+  The values of the fields of the `structs` that change the model grid (all but
+  `_NOTSHAPE`), with NaN, which isn't equal to itself, as `None`
+  
+  '''
+  
+  return tuple(None if v != v else v for x in structs
+               for v in [getattr(x, y[0]) for y in x._fields_ if y[0] not in _NOTSHAPE])
+
+def _LDModel(kwargs):
+  '''
+  Infers the limb darkening model from the coefficients the user specified
+  
+  '''
+  
+  if ('q1' in kwargs.keys()) and ('q2' in kwargs.keys()):
+    kwargs.update({'ldmodel': KIPPING})
+  elif ('c1' in kwargs.keys()) and ('c2' in kwargs.keys()) and \
+       ('c3' in kwargs.keys()) and ('c4' in kwargs.keys()):
+    kwargs.update({'ldmodel': NONLINEAR})
+  return kwargs
+
+_ALTERNATIVES = [[('b',), ('bcirc',)],                                               # Different ways of giving the same parameters
+                 [('rhos',), ('aRs',)],
+                 [('ecc', 'w'), ('esw', 'ecw')],
+                 [('t0',), ('times', 'durscale', 'depscale')],
+                 [('u1', 'u2'), ('q1', 'q2'), ('c1', 'c2', 'c3', 'c4')]]
+_LDCOEFFS = ['u1', 'u2', 'q1', 'q2', 'c1', 'c2', 'c3', 'c4']
+
+def _Merge(base, kwargs):
+  '''
+  The keyword arguments `base`, overridden by `kwargs`. If `kwargs` gives a 
+  parameter in a different way than `base` did (e.g., `rhos` instead of `aRs`, or
+  `u1` and `u2` instead of `q1` and `q2`), the way `base` gave it is dropped, 
+  and so is its limb darkening model, which is inferred again from the result
+  
+  '''
+  
+  merged = dict(base)
+  for group in _ALTERNATIVES:
+    for alt in group:
+      if any(k in kwargs for k in alt):
+        for other in group:
+          if other is not alt:
+            for k in other:
+              merged.pop(k, None)
+  if any(k in kwargs for k in _LDCOEFFS):
+    merged.pop('ldmodel', None)
+  merged.update(kwargs)
+  return _LDModel(merged)
+
 class Transit():
   '''
   A user-friendly wrapper around the :py:class:`ctypes` routines.
@@ -420,24 +991,94 @@ class Transit():
     - **ecc** and **w** or **esw** and **ecw** - The eccentricity and the longitude of pericenter in radians, \
                                                  or the two eccentricity vectors. Default is `ecc = 0.` and `w = 0.`
     - **t0** or **times** - The time of first transit, or the time of each of the transits (in case \
-                            they are not periodic) in days. Default is `t0 = 0.`
+                            they are not periodic) in days. Any number of transit times may be given, \
+                            in any order, and the nearest one is found by bisection, so the \
+                            observation times needn't be sorted either. Default is `t0 = 0.`
+    - **durscale** and **depscale** - Optionally, the duration and the depth of each of the `times` \
+                                      transits relative to the model, to fit for duration and depth \
+                                      variations without recomputing the model for each transit. \
+                                      Default `None` (no variations)
   
-    - **ldmodel** - The limb darkening model. Default `ps.QUADRATIC` (only option for now!)
+    - **ldmodel** - The limb darkening model. Default `ps.QUADRATIC`
     - **u1** and **u2** or **q1** and **q2** - The quadratic limb darkening parameters (u1, u2) or the \
                                                modified quadratic limb darkening parameters (q1, q2) \
                                                from `Kipping (2013) <http://dx.doi.org/10.1093/mnras/stt1435>`_. \
                                                Default is `u1 = 0.40` and `u2 = 0.26`
+    - **c1**, **c2**, **c3** and **c4** - The nonlinear limb darkening parameters of \
+                                          `Claret (2000) <http://adsabs.harvard.edu/abs/2000A%26A...363.1081C>`_. \
+                                          The terms in integer powers of mu are exact, and the others are \
+                                          interpolated from a lookup table that's built on first use, \
+                                          to better than `1.e-6` in the flux (see :py:func:`NonlinearTableError`). \
+                                          Radius ratios outside `[0.001, 0.5]` are integrated numerically \
+                                          instead, which is much slower. Each point costs the quadratic \
+                                          law's exact terms plus two table lookups, so computing the \
+                                          model takes about 15% longer than with `u1` and `u2` \
+                                          (`make bench`: 53 against 46 ns per grid point). Gradients \
+                                          aren't available
     
     - **exptime** - The exposure time in days for binning the model. Default `ps.KEPLONGEXP`
     - **fullorbit** - Compute the orbital parameters for the entire orbit? Only useful if \
-                      you're interested in the full arrays of orbital parameters. Default `False`
+                      you're interested in the full arrays of orbital parameters. On the uniform \
+                      grid, this steps the whole orbit every `exptime / exppts`, which needs a \
+                      large `maxpts` for long periods; use `gridmethod = ps.ADAPTIVE` for a grid \
+                      that's fine in transit and coarse elsewhere, and needs no tuning. Default `False`
     - **maxpts** - Maximum number of points in the model. Increase this if you're getting errors. Default `10,000`
     - **exppts** - The number of exposure points per cadence when binning the model. Default `50`
     - **binmethod** - The binning method. Default `ps.RIEMANN` (recommended)
-    - **intmethod** - The integration method. Default `ps.SMARTINT` (recommended)
+    - **intmethod** - The interpolation method. The uniform grid is stored implicitly, so both \
+                      `ps.SMARTINT` and `ps.SLOWINT` find each point in constant time, and \
+                      the times needn't be sorted. Default `ps.SMARTINT`
     - **keptol** - The tolerance of the Kepler solver. Default `1.e-15`
     - **maxkepiter** - Maximum number of iterations in the Kepler solver. Default `100`
-    - **kepsolver** - The Kepler solver to use. Default `ps.NEWTON` (recommended)
+    - **kepsolver** - The Kepler solver to use. `ps.HALLEY` solves for many points at once, \
+                      vectorized, starting from an interpolated table of E(M), which is \
+                      several times faster than `ps.NEWTON` (and much faster at high \
+                      eccentricity). Iteration statistics end up in `arrays.kep`. \
+                      Default `ps.NEWTON` (recommended)
+    - **outputs** - The arrays to compute and store, e.g. `['binned']` when fitting. Arrays that \
+                    aren't listed are computed on demand when requested. Default is all of them
+    - **gridmethod** - The time grid. `ps.UNIFORM` samples the orbit every `exptime / exppts`; \
+                       `ps.ADAPTIVE` refines the grid near the contact points until the flux is \
+                       accurate to `fluxtol`, and bins it exactly; with `fullorbit`, it also \
+                       follows the rest of the orbit, to within `orbtol`. Default `ps.UNIFORM`
+    - **fluxtol** - The flux tolerance of the adaptive grid. Default `1.e-6`
+    - **orbtol** - The tolerance on the position of the planet on the adaptive grid in full orbit \
+                   mode, relative to its distance from the star. Default `1.e-6`
+    - **evalmethod** - `ps.GRID` computes the model on a grid and interpolates it onto the \
+                       requested times; `ps.DIRECT` evaluates it at the requested times only \
+                       (and the exposure sub-samples, when binning), which is much faster for \
+                       sparse data; `ps.AUTO` picks whichever needs fewer evaluations. \
+                       Default `ps.GRID`
+    - **symtol** - Light curves of circular orbits are symmetric about transit center, so \
+                   only the first half is computed, and then mirrored. Set this to a positive \
+                   flux tolerance to do the same for eccentric orbits whose light curves are \
+                   that symmetric (the orbital arrays are still solved for exactly), or to \
+                   a negative number to never mirror. Default `0.`
+    - **fluxmethod** - `ps.ANALYTIC` computes the occultation functions exactly; `ps.TABLE` \
+                       interpolates them from a lookup table that's built once per process \
+                       (in a few milliseconds), which is several times faster, and accurate to \
+                       better than `1.e-6` in the flux (see :py:func:`FluxTableError`). Radius \
+                       ratios outside `[0.001, 0.5]` are always computed exactly. Default `ps.ANALYTIC`
+    - **dtype** - The type of the model returned by calling it, :py:meth:`Stream` and \
+                  :py:meth:`Chunks`. `'float32'` halves the memory and bandwidth of the \
+                  output for long time series. It's only the output: the model itself (the \
+                  times, the Kepler solver, the occultation functions, the grid, the binning \
+                  sums and the gradients) is always computed in double precision, and just \
+                  rounded at the end, which adds at most `6.e-8` to the error of the flux. \
+                  Computing it in float doesn't pay off: a float flux kernel is about twice \
+                  as fast, but it's off by up to `2.e-5` in the flux for small planets, \
+                  and by `1.e-3` where `b` is close to `RpRs`, while a float grid is no \
+                  faster to interpolate, since it fits in the cache either way (run \
+                  `./bench -a` after `make bench` for the figures). Default `'float64'`
+  
+  The computed (and binned) grids of the last `cachesize` models are kept, keyed on 
+  everything but `t0`, the transit `times`, their `durscale` and `depscale` and the 
+  output `dtype`, none of which change the grid: updating only those (as when refining an ephemeris or fitting 
+  for TTVs), or going back to a model evaluated recently, costs just the interpolation. 
+  Updating only the limb darkening recomposes the most recent model with the same
+  geometry from its occultation functions, with no Kepler solves or elliptic integrals 
+  (on the uniform grid, unless gradients are requested or an eccentric orbit is being
+  mirrored with `symtol`). Default `ps.CACHE_SIZE`; `0` recomputes the model after every update.
 
   Once a :py:class:`Transit` model is instantiated, it may be called as follows:
   
@@ -454,10 +1095,36 @@ class Transit():
       
       # Obtain the actual model, evaluated on the time array
       model = trn(time)
+      
+      # Bin it to other exposure times instead (a scalar, or one per data point),
+      # optionally with a non-boxcar exposure kernel. The model is computed once
+      # and serves any mix of cadences
+      model = trn(time, exptime = ps.KEPSHRTEXP, kernel = ps.TrapezoidKernel(0.1))
+      
+      # The model and its Jacobian, whose rows are the derivatives with respect
+      # to each of `trn.gradparams`, computed analytically in a single pass
+      model, jac = trn(time, grad = True)
+      
+      # Write the model into an existing array instead of allocating a new one
+      trn(time, out = model)
+      
+      # The arrays on the model grid are read-only views of the C arrays, so
+      # they're free to get, but are overwritten when the model is recomputed
+      flux = trn.arrays.flux.copy()
+      
+      # Stream a time series too long to fit in memory from one file to another,
+      # or model one that arrives in pieces, in constant memory
+      trn.Stream('time.npy', out = 'flux.npy')
+      for flux in trn.Chunks(pieces):
+        pass
   
   '''
   
-  def __init__(self, **kwargs):
+  def __init__(self, cachesize = CACHE_SIZE, **kwargs):
+    self._kwargs = {}
+    self._cache = OrderedDict()
+    self.cachesize = cachesize
+    self.dtype = np.dtype('float64')
     self.arrays = ARRAYS()
     self.limbdark = LIMBDARK()
     self.transit = TRANSIT()
@@ -472,59 +1139,276 @@ class Transit():
     
     if kwargs.get('verify_kwargs', True):
       valid = [y[0] for x in [TRANSIT, LIMBDARK, SETTINGS] for y in x._fields_]       # List of valid kwargs
-      valid += ['b', 'times']                                                         # These are special!
+      valid += ['b', 'times', 'durscale', 'depscale', 'dtype']                        # These are special!
       for k in kwargs.keys():
         if k not in valid:
           raise Exception("Invalid kwarg '%s'." % k)  
   
-    if ('q1' in kwargs.keys()) and ('q2' in kwargs.keys()):
-      kwargs.update({'ldmodel': KIPPING})
-    elif ('c1' in kwargs.keys()) and ('c2' in kwargs.keys()) and \
-         ('c3' in kwargs.keys()) and ('c4' in kwargs.keys()):
-      kwargs.update({'ldmodel': NONLINEAR})
-    
+    kwargs = dict(kwargs)
+    self.dtype = np.dtype(kwargs.pop('dtype', self.dtype))                            # The output type isn't a C setting
+    if self.dtype not in (np.float64, np.float32):
+      raise ValueError("The output `dtype` must be 'float64' or 'float32'.")
+    kwargs = _LDModel(kwargs)
+    self._kwargs = dict(kwargs)                                                       # Remember these for `Batch()`
     self.limbdark.update(**kwargs)
     self.transit.update(**kwargs)
     self.settings.update(**kwargs)
+    self.arrays = self._Cached()
   
-  def __call__(self, t, param = 'binned'):
-    if param == 'binned':
-      array = _ARR_BFLX
-    elif param == 'unbinned':
-      array = _ARR_FLUX
-    elif param == 'M':
-      array = _ARR_M
-    elif param == 'E':
-      array = _ARR_E
-    elif param == 'f':
-      array = _ARR_F
-    elif param == 'r':
-      array = _ARR_R
-    elif param == 'x':
-      array = _ARR_X
-    elif param == 'y':
-      array = _ARR_Y
-    elif param == 'z':
-      array = _ARR_Z
-    elif param == 'b':
-      array = _ARR_B
+  def _Cached(self):
+    '''
+    Returns the arrays holding the model with the current shape parameters and 
+    settings, taking up the grid already computed for them if it's cached, 
+    recomposing the most recent one with the same geometry if only the limb
+    darkening changed, and recycling the workspace of the least recently used 
+    model otherwise
+    
+    '''
+    
+    if not self.cachesize:
+      self.arrays.computed = 0                                                        # The reentrant routines only look at this flag
+      return self.arrays
+    key = (_ShapeKey(self.transit, self.settings), _ShapeKey(self.limbdark))
+    same = [k for k in self._cache if k[0] == key[0]]                                 # The same geometry, with any limb darkening
+    arrays = self._cache.pop(key, None)
+    if arrays is not None:
+      if _Reuse(self.transit, self.limbdark, self.settings, arrays) != _ERR_NONE:
+        arrays.computed = 0                                                           # Recompute it, and raise the error then
+    elif len(same):
+      arrays = self._cache.pop(same[-1])
+      if _Recompose(self.transit, self.limbdark, self.settings, arrays) != _ERR_NONE:
+        arrays.computed = 0
+    elif len(self._cache) >= self.cachesize:
+      arrays = self._cache.popitem(last = False)[1]
+      arrays.computed = 0
     else:
-      RaiseError(_ERR_NOT_IMPLEMENTED)
+      arrays = ARRAYS()
+    self._cache[key] = arrays
+    return arrays
+  
+  @property
+  def gradparams(self):
+    '''
+    The names of the parameters in the rows of the Jacobian returned when calling
+    the model with `grad = True`. The fourth is `rhos` if the stellar density was
+    given, and `aRs` otherwise.
+    
+    '''
+    
+    names = list(GRADPARAMS)
+    if not np.isnan(self.transit.rhos):
+      names[3] = 'rhos'
+    return names
+  
+  @property
+  def counters(self):
+    '''
+    The hot path counters of this model, accumulated since it was created (or since
+    :py:meth:`ResetCounters`): for each of the `compute`, `bin` and `interpolate` 
+    stages, the time spent in it (not counting the stages it called, in seconds) and
+    the number of calls, plus the Kepler solves and iterations, the points per
+    occultation case, the elliptic integrals of the third kind (one at a time, and
+    in blocks of lanes) and their iterations, the grid size versus `maxpts`, and the
+    interpolation lookups and search steps. These are summed over the workspaces of
+    all the cached models, except for the grid size and `maxpts`, which are those of
+    the current one. Models evaluated by :py:meth:`Batch` aren't included. This is 
+    `None` unless the library was compiled with `make INSTRUMENT=1`.
+    
+    '''
+    
+    if not _Instrumented():
+      return None
+    res = {}
+    for prof in [x.prof for x in self._Workspaces()]:
+      for k, stage in enumerate(STAGES):
+        res['time_' + stage] = res.get('time_' + stage, 0) + prof.time[k]
+        res['calls_' + stage] = res.get('calls_' + stage, 0) + prof.calls[k]
+      for name, _ in COUNTERS._fields_[2:]:
+        res[name] = res.get(name, 0) + getattr(prof, name)
+    for name in ['gridpts', 'maxpts']:                                                # Not counters, so not summed
+      res[name] = getattr(self.arrays.prof, name)
+    return res
+  
+  def _Workspaces(self):
+    '''
+    The workspaces of the current model and of the cached ones
+    
+    '''
+    
+    return [self.arrays] + [x for x in self._cache.values() if x is not self.arrays]
+  
+  def ResetCounters(self):
+    '''
+    Zeroes the hot path counters (see :py:attr:`counters`)
+    
+    '''
+    
+    for arrays in self._Workspaces():
+      arrays.prof = COUNTERS()
+  
+  def __call__(self, t, param = 'binned', exptime = None, kernel = None, grad = False, out = None, jac = None):
+    array = _ArrayID(param)
     
-    # Ensure the time is a float array
-    if not (type(t) is np.ndarray):
-      t = np.array(t, dtype = 'float64')
-    elif t.dtype != 'float64':
-      t = np.array(t, dtype = 'float64')
+    # Ensure the time is a contiguous float array
+    t = np.ascontiguousarray(t, dtype = 'float64')
     
-    err = _Interpolate(t, len(t), array, self.transit, self.limbdark, self.settings, 
-                       self.arrays)
+    single = (self.dtype == np.float32) and not grad                                  # The gradients are always in double precision
+    res = _Output(out, (len(t),), 'float32' if single else 'float64')                 # The caller's buffers, if any, are filled in place
+    if grad:
+      if (exptime is not None) or (kernel is not None): RaiseError(_ERR_NOT_IMPLEMENTED)
+      jac = _Output(jac, (_NGRAD, len(t)))
+      err = _InterpolateGrad(t, len(t), array, self.transit, self.limbdark, self.settings, 
+                             self.arrays, res, jac)
+      if err != _ERR_NONE: RaiseError(err)
+      return res, jac
+    if (array == _ARR_BFLX) and ((exptime is not None) or (kernel is not None)):
+      if single:
+        res[:] = self._Expose(t, exptime, kernel, np.empty(len(t)))
+        return res
+      return self._Expose(t, exptime, kernel, res)
+    if single:
+      return self._Chunk(t, res, array, ctypes.c_int(0))
+    err = _InterpolateInto(t, len(t), array, self.transit, self.limbdark, self.settings, 
+                           self.arrays, res)
     if err != _ERR_NONE: RaiseError(err)
-    res = self.arrays.iarr
-    _dbl_free(self.arrays._iarr)
-    self.arrays._ialloc = 0
     return res
   
+  def _Expose(self, t, exptime, kernel, res):
+    '''
+    Bins the model to the exposure times `exptime` (a scalar, or one per time) with
+    the exposure `kernel` by integrating it once
+    
+    '''
+    
+    t = np.ascontiguousarray(t)
+    if exptime is None:
+      exptime = self.settings.exptime
+    texp = np.ascontiguousarray(np.broadcast_to(exptime, t.shape), dtype = 'float64')
+    if kernel is None:
+      kt = kv = None
+      nk = 0
+    else:
+      kt = np.ascontiguousarray(kernel[0], dtype = 'float64')
+      kv = np.ascontiguousarray(kernel[1], dtype = 'float64')
+      if len(kt) != len(kv): RaiseError(_ERR_KERNEL)
+      nk = len(kt)
+    err = _Expose(t, texp.ctypes.data, len(t), 
+                  None if kt is None else kt.ctypes.data,
+                  None if kv is None else kv.ctypes.data, nk,
+                  self.transit, self.limbdark, self.settings, self.arrays, res)
+    if err != _ERR_NONE: RaiseError(err)
+    return res
+  
+  def Stream(self, t, out = None, param = 'binned', chunk = STREAM_CHUNK):
+    '''
+    Evaluates the model on a long time series `chunk` points at a time, so 
+    the memory it takes beyond the inputs and outputs doesn't grow with the
+    length of the series. When those are memory-mapped files, the whole 
+    thing runs in constant memory, as fast as the data can be read and written.
+    
+    :param t: The observation times: an array (such as a `np.memmap`), or the path \
+              of a `.npy` file or a raw binary file of native float64 times, which \
+              is memory-mapped
+    :param out: Where to write the model: a C-contiguous float64 array as long as \
+                `t`, the path of a `.npy` or raw binary file to create, or `None` \
+                for a new array. Default `None`
+    :param str param: The array to evaluate. Default `'binned'`
+    :param int chunk: The number of points per chunk. Default `ps.STREAM_CHUNK`
+    
+    :returns: `out`, memory-mapped if it was a path
+    
+    '''
+    
+    if isinstance(t, str):
+      t = _MapFile(t)
+    if isinstance(out, str):
+      out = _MapFile(out, len(t), self.dtype.name)
+    out = _Output(out, (len(t),), self.dtype.name)
+    array = _ArrayID(param)
+    nt = ctypes.c_int(0)
+    for i in range(0, len(t), chunk):
+      self._Chunk(t[i:i + chunk], out[i:i + chunk], array, nt)
+    if isinstance(out, np.memmap):
+      out.flush()
+    return out
+  
+  def Chunks(self, chunks, param = 'binned'):
+    '''
+    Evaluates the model on a time series that arrives in pieces, yielding the
+    model of each in turn. The model is computed once, and where we are in it
+    is kept from one piece to the next, so this costs the same as evaluating
+    the whole series in one go.
+    
+    :param chunks: An iterable of time arrays, or of `(t, out)` pairs to write \
+                   the model of each into the caller's buffer `out`
+    :param str param: The array to evaluate. Default `'binned'`
+    
+    '''
+    
+    array = _ArrayID(param)
+    nt = ctypes.c_int(0)
+    for c in chunks:
+      t, out = c if isinstance(c, tuple) else (c, None)
+      yield self._Chunk(t, out, array, nt)
+  
+  def _Chunk(self, t, out, array, nt):
+    '''
+    Interpolates the model `array` onto one chunk `t` of a time series, into
+    `out`. The transit we're in is carried over to the next chunk in `nt`.
+    
+    '''
+    
+    t = np.ascontiguousarray(t, dtype = 'float64')
+    if self.dtype == np.float32:
+      res = _Output(out, (len(t),), 'float32')
+      err = _InterpolateStreamFloat(t, len(t), array, self.transit, self.limbdark, self.settings, 
+                                    self.arrays, res, ctypes.byref(nt))
+    else:
+      res = _Output(out, (len(t),))
+      err = _InterpolateStream(t, len(t), array, self.transit, self.limbdark, self.settings, 
+                               self.arrays, res, ctypes.byref(nt))
+    if err != _ERR_NONE: RaiseError(err)
+    return res
+  
+  def Batch(self, t, params, param = 'binned', nthreads = 0):
+    '''
+    Evaluates many models at once on the same time array, in parallel. 
+    Useful for evaluating all the walkers of an MCMC ensemble in one go.
+    
+    :param ndarray t: The observation times
+    :param list params: A list of dictionaries, one per model, with the \
+                        :py:class:`TRANSIT` and :py:class:`LIMBDARK` keyword arguments \
+                        that differ from the ones this instance was created with. A parameter \
+                        given another way (e.g., `rhos` where the instance has `aRs`, or `u1` and \
+                        `u2` where it has `q1` and `q2`) replaces the instance's
+    :param str param: The array to evaluate. Default `'binned'`
+    :param int nthreads: The number of threads. Default `0` (all of them)
+    
+    :returns: A tuple `(res, err)`, where `res` is the `len(params)` x `len(t)` array \
+              of models and `err` is the array of error codes. Rows for which the \
+              computation failed are set to `nan`.
+    
+    '''
+    
+    array = _ArrayID(param)
+    t = np.ascontiguousarray(t, dtype = 'float64')
+    
+    n = len(params)
+    transits = (TRANSIT * n)()
+    limbdarks = (LIMBDARK * n)()
+    keep = []                                                                         # The transit time arrays must outlive the copies
+    for k, p in enumerate(params):
+      kwargs = _Merge(self._kwargs, p)
+      keep.append(TRANSIT(**kwargs))
+      transits[k] = keep[-1]
+      limbdarks[k] = LIMBDARK(**kwargs)
+    
+    res = np.empty((n, len(t)), dtype = 'float64')
+    err = np.zeros(n, dtype = ctypes.c_int)
+    _ComputeBatch(t, len(t), array, n, transits, limbdarks, self.settings, 
+                  res, err, nthreads)
+    return res, err
+  
   def Compute(self):
     '''
     Computes the light curve model
@@ -545,32 +1429,137 @@ class Transit():
   
   def Free(self):
     '''
-    Frees the memory used by all of the dynamically allocated C arrays.
-    
-    '''
-
-    if self.arrays._calloc:
-      _dbl_free(self.arrays._time)
-      _dbl_free(self.arrays._flux)
-      _dbl_free(self.arrays._bflx)
-      _dbl_free(self.arrays._M)
-      _dbl_free(self.arrays._E)
-      _dbl_free(self.arrays._f)
-      _dbl_free(self.arrays._r)
-      _dbl_free(self.arrays._x)
-      _dbl_free(self.arrays._y)
-      _dbl_free(self.arrays._z)
-      self.arrays._calloc = 0
-    if self.arrays._balloc:  
-      _dbl_free(self.arrays._b)
-      self.arrays._balloc = 0
-    if self.arrays._ialloc:
-      _dbl_free(self.arrays._iarr)
-      self.arrays._ialloc = 0
+    Frees the memory used by all of the dynamically allocated C arrays now, 
+    cached models included, rather than when the last reference to them goes
+    out of scope. Views of them obtained from `arrays` keep their own memory until
+    they go away.
+    
+    '''
+
+    for arrays in self._Workspaces():
+      _FreeArrays(arrays)
+
+class System():
+  '''
+  Several planets transiting the same star. The combined light curve is computed
+  in a single pass over the observation times, which is much faster than calling
+  one :py:class:`Transit` per planet and multiplying the results: each planet's
+  model is computed on its own grid (in parallel, and only when its parameters
+  change), and the flux deficits of all of them are added up as we go. Mutual
+  events (one planet passing in front of another) aren't modeled.
+  
+  :param list planets: A list of dictionaries, one per planet, with its :py:class:`TRANSIT` \
+                       keyword arguments (e.g., `per`, `RpRs`, `bcirc`, `t0` or `times`)
+  :param int nthreads: The number of threads. Default `0` (all of them)
+  :param kwargs: The keyword arguments shared by all the planets: the limb darkening and \
+                 the settings (see :py:class:`Transit`), and any :py:class:`TRANSIT` ones \
+                 the planets don't override, such as the stellar density `rhos`
+  
+  .. code-block::python
+      
+      sys = ps.System([dict(per = 3., RpRs = 0.1, t0 = 0.5), 
+                       dict(per = 7.2, RpRs = 0.05, t0 = 2.1)], rhos = 1.2, u1 = 0.5)
+      model = sys(time)
+  
+  '''
+  
+  def __init__(self, planets, nthreads = 0, **kwargs):
+    self.nthreads = nthreads
+    self.limbdark = LIMBDARK()
+    self.settings = SETTINGS()
+    self._kwargs = {}
+    self._planets = []
+    self._keys = []                                                                   # What each planet's grid was computed for
+    self.arrays = (ARRAYS * 0)()
+    self.update(planets = planets, **kwargs)
+  
+  def update(self, planets = None, **kwargs):
+    '''
+    Update the shared keyword arguments, and/or replace the list of `planets`
+    
+    '''
+    
+    valid = [y[0] for x in [TRANSIT, LIMBDARK, SETTINGS] for y in x._fields_]         # List of valid kwargs
+    valid += ['b', 'times', 'durscale', 'depscale']
+    for p in ([kwargs] + list(planets or [])):
+      for k in p.keys():
+        if k not in valid:
+          raise Exception("Invalid kwarg '%s'." % k)  
+    
+    self._kwargs = _Merge(self._kwargs, kwargs)                                       # Unlike `Transit.update()`, these add to the ones we had
+    self.limbdark.update(**self._kwargs)
+    self.settings.update(**kwargs)
+    if planets is not None:
+      self._planets = [dict(p) for p in planets]
+      if len(self._planets) != len(self.arrays):
+        self._Workspaces(len(self._planets))
+    self._transits = [TRANSIT(**_Merge(self._kwargs, p)) for p in self._planets]      # These own the transit time arrays...
+    self.transits = (TRANSIT * len(self._planets))(*self._transits)                   # ...which must outlive the copies
+    shared = _ShapeKey(self.limbdark, self.settings)
+    keys = [(_ShapeKey(x), shared) for x in self._transits]
+    for k in range(len(keys)):
+      if (k >= len(self._keys)) or (keys[k] != self._keys[k]):                        # Only recompute the planets that changed
+        self.arrays[k].computed = 0
+    self._keys = keys
+  
+  def _Workspaces(self, n):
+    '''
+    Resizes the array of workspaces to `n` planets, handing the existing ones
+    over to the first of them and freeing the rest
+    
+    '''
+    
+    old = self.arrays
+    self.arrays = (ARRAYS * n)()                                                      # One workspace per planet, kept across calls
+    for k in range(len(old)):
+      if k < n:
+        ctypes.memmove(ctypes.byref(self.arrays[k]), ctypes.byref(old[k]), ctypes.sizeof(ARRAYS))
+        ctypes.memset(ctypes.byref(old[k]), 0, ctypes.sizeof(ARRAYS))                 # The new one owns it now
+      else:
+        _FreeArrays(old[k])
+  
+  @property
+  def nplanets(self):
+    '''
+    The number of planets
+    
+    '''
+    
+    return len(self._planets)
+  
+  def __call__(self, t, param = 'binned', out = None):
+    '''
+    The combined `'binned'` or `'unbinned'` flux of all the planets at the times `t`, 
+    written into `out` if it's given
+    
+    '''
+    
+    array = _ArrayID(param)
+    t = np.ascontiguousarray(t, dtype = 'float64')
+    res = _Output(out, (len(t),))
+    if not self.nplanets:
+      res[:] = 1.
+      return res
+    err = np.zeros(self.nplanets, dtype = ctypes.c_int)
+    iErr = _ComputeSystem(t, len(t), array, self.nplanets, self.transits, self.limbdark, 
+                          self.settings, self.arrays, res, err, self.nthreads)
+    if iErr != _ERR_NONE: RaiseError(iErr)
+    return res
+  
+  def Free(self):
+    '''
+    Frees the memory used by the planets' C arrays
+    
+    '''
+    
+    for k in range(len(getattr(self, 'arrays', []))):
+      _FreeArrays(self.arrays[k])
   
   def __del__(self):
     '''
     Free the C arrays when the last reference to the class goes out of scope!
     
     '''
-    self.Free()
\ No newline at end of file
+    
+    if _FreeArrays is not None:
+      self.Free()
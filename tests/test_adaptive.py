@@ -0,0 +1,31 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+test_adaptive.py
+----------------
+
+'''
+
+import numpy as np
+import pysyzygy as ps
+from pysyzygy.transit import Transit
+
+def test_adaptive():
+  '''
+  The adaptive grid should match a very finely sampled uniform grid to within
+  its flux tolerance (plus the error of the reference), using far fewer points.
+
+  '''
+
+  time = np.linspace(-0.3,0.3,1000)
+  for kwargs in [dict(per = 3., RpRs = 0.1, aRs = 10., b = 0.3),
+                 dict(per = 20., RpRs = 0.05, ecc = 0.5, w = 1., rhos = 1.),
+                 dict(per = 5., RpRs = 0.1, aRs = 12., b = 1.02)]:
+    ref = Transit(t0 = 0., exppts = 2000, maxpts = 2000000, **kwargs)
+    trn = Transit(t0 = 0., gridmethod = ps.ADAPTIVE, fluxtol = 1.e-7, **kwargs)
+    assert np.abs(trn(time) - ref(time)).max() < 2.e-6
+    assert np.abs(trn(time, 'unbinned') - ref(time, 'unbinned')).max() < 1.e-6
+    assert trn.arrays.nend - trn.arrays.nstart < 2000
+
+if __name__ == '__main__':
+  test_adaptive()
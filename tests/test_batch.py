@@ -0,0 +1,40 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+test_batch.py
+-------------
+
+'''
+
+import numpy as np
+from pysyzygy.transit import Transit
+
+def test_batch():
+  '''
+  Each walker of a batch should match the model computed on its own, even
+  if it gives a parameter differently from the instance (e.g., `u1` and `u2`
+  where the instance had `q1` and `q2`). A walker that fails should come
+  back as NaN without affecting the rest.
+  
+  '''
+  
+  time = np.linspace(-0.5,0.5,1000)
+  trn = Transit(per = 5., RpRs = 0.1)
+  params = [dict(RpRs = 0.05 + 0.01 * k, b = 0.1 * k) for k in range(8)]
+  params += [dict(RpRs = 2.)]                                                         # This one should fail
+  
+  res, err = trn.Batch(time, params, nthreads = 4)
+  for k, p in enumerate(params[:-1]):
+    assert err[k] == 0
+    np.testing.assert_array_equal(res[k], Transit(per = 5., **p)(time))
+  assert err[-1] != 0
+  assert np.all(np.isnan(res[-1]))
+  
+  trn = Transit(per = 5., aRs = 12., q1 = 0.3, q2 = 0.4)                              # The walkers may give the parameters another way
+  params = [dict(u1 = 0.9, u2 = 0.), dict(rhos = 2.), dict(c1 = 0.5, c2 = 0.1, c3 = 0.1, c4 = -0.1)]
+  res, err = trn.Batch(time, params)
+  assert np.all(err == 0)
+  np.testing.assert_array_equal(res[0], Transit(per = 5., aRs = 12., u1 = 0.9, u2 = 0.)(time))
+  np.testing.assert_array_equal(res[1], Transit(per = 5., rhos = 2., q1 = 0.3, q2 = 0.4)(time))
+  np.testing.assert_array_equal(res[2], Transit(per = 5., aRs = 12., **params[2])(time))
+  assert np.max(np.abs(res[0] - trn(time))) > 1.e-4
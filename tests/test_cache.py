@@ -0,0 +1,58 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+test_cache.py
+-------------
+
+'''
+
+import numpy as np
+import pysyzygy as ps
+from pysyzygy.transit import Transit
+
+def test_cache():
+  '''
+  Updating only the transit times should reuse the grid, and so should going
+  back to a recent model, but the result should be the same as computing it 
+  from scratch, and bad transit times should still be caught.
+
+  '''
+
+  time = np.arange(0., 20., ps.KEPLONGCAD)
+  shape = dict(per = 3., RpRs = 0.1, rhos = 1.2, bcirc = 0.3, esw = 0.1, ecw = 0.05, u1 = 0.5)
+  ttvs = [dict(t0 = 0.5), dict(t0 = 0.52), 
+          dict(times = [0.5, 3.51, 6.49, 9.5, 12.52, 15.5, 18.48]),
+          dict(times = [0.5, 3.51, 6.49, 9.5, 12.52, 15.5, 18.48], durscale = 1.1, 
+               depscale = [1., 0.9, 1.1, 1., 1., 1.2, 1.])]
+  for kwargs in [dict(), dict(gridmethod = ps.ADAPTIVE)]:
+    for param in ['unbinned', 'binned']:
+      trn = Transit(**dict(shape, **kwargs))
+      trn(time, param)
+      for ttv in ttvs:
+        trn.update(**dict(shape, **dict(kwargs, **ttv)))
+        assert trn.arrays.computed and (trn.settings.binned or (param == 'unbinned'))
+        ref = Transit(cachesize = 0, **dict(shape, **dict(kwargs, **ttv)))
+        assert np.array_equal(trn(time, param), ref(time, param))
+        assert trn.transit.aRs == ref.transit.aRs and trn.transit.ecc == ref.transit.ecc
+  
+  trn = Transit(cachesize = 2, t0 = 0.5, **shape)
+  first = trn(time)
+  trn.update(t0 = 0.5, **dict(shape, RpRs = 0.11))
+  trn(time)
+  trn.update(t0 = 0.5, **shape)
+  assert trn.arrays.computed
+  assert np.array_equal(trn(time), first)
+  trn.update(t0 = 0.5, **dict(shape, RpRs = 0.12))
+  trn(time)
+  trn.update(t0 = 0.5, **dict(shape, RpRs = 0.11))
+  assert not trn.arrays.computed
+  
+  trn.update(times = [0.5, 3.5, 6.5], durscale = [1., -1., 1.], **dict(shape, RpRs = 0.12))
+  try:
+    trn(time)
+    assert False
+  except Exception as e:
+    assert 'durscale' in str(e)
+
+if __name__ == '__main__':
+  test_cache()
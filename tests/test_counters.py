@@ -0,0 +1,75 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+test_counters.py
+----------------
+
+'''
+
+import os
+import sys
+import glob
+import shutil
+import tempfile
+import subprocess
+import unittest
+import numpy as np
+import pysyzygy as ps
+from pysyzygy.transit import Transit
+
+def test_counters():
+  '''
+  The hot path counters should add up when they're compiled in (with
+  `make INSTRUMENT=1`), and be `None` otherwise. If this library isn't 
+  instrumented, we build an instrumented copy and run the test against it.
+
+  '''
+
+  time = np.linspace(-0.2, 0.2, 1000)
+  trn = Transit(per = 3., RpRs = 0.1, aRs = 10., bcirc = 0.3, esw = 0.1, ecw = 0.2)
+  trn(time)
+  prof = trn.counters
+  if prof is None:
+    assert not os.environ.get('PYSYZYGY_INSTRUMENTED'), "The instrumented build has no counters."
+    tmp = tempfile.mkdtemp()
+    try:
+      src = os.path.dirname(os.path.abspath(ps.__file__))
+      dst = os.path.join(tmp, 'pysyzygy')
+      os.mkdir(dst)
+      for f in glob.glob(os.path.join(src, '*.[ch]')) + glob.glob(os.path.join(src, '*.py')) + \
+               [os.path.join(src, 'Makefile')]:
+        shutil.copy(f, dst)
+      try:
+        subprocess.check_output(['make', 'INSTRUMENT=1'], cwd = dst, stderr = subprocess.STDOUT)
+      except (OSError, subprocess.CalledProcessError) as e:
+        raise unittest.SkipTest("Can't build the instrumented library: %s" % e)
+      env = dict(os.environ, PYTHONPATH = tmp, PYSYZYGY_INSTRUMENTED = '1')
+      subprocess.check_call([sys.executable, os.path.abspath(__file__)], env = env, cwd = tmp)
+    finally:
+      shutil.rmtree(tmp)
+    return
+  assert prof['calls_compute'] == prof['calls_bin'] == prof['calls_interpolate'] == 1
+  assert prof['maxpts'] == trn.settings.maxpts
+  assert prof['gridpts'] == trn.arrays.nend - trn.arrays.nstart
+  assert prof['outside'] + prof['limb'] + prof['inside'] == prof['gridpts']
+  assert prof['kepsolves'] >= prof['gridpts'] and prof['kepiter'] > 0
+  assert prof['piblocks'] > 0 and prof['piblockit'] >= prof['piblocks']
+  assert prof['lookups'] == len(time) and prof['search'] == 0
+  trn(time, exptime = 0.01)
+  assert trn.counters['calls_compute'] == 1 and trn.counters['calls_interpolate'] == 2
+  trn.update(per = 3., RpRs = 0.12, aRs = 10., bcirc = 0.3, esw = 0.1, ecw = 0.2)   # A second model, in its own workspace
+  trn(time)
+  assert trn.counters['calls_compute'] == 2 and trn.counters['calls_interpolate'] == 3
+  assert trn.counters['gridpts'] == trn.arrays.nend - trn.arrays.nstart
+  trn.ResetCounters()
+  assert not any(trn.counters.values())
+
+  trn = Transit(per = 3., RpRs = 0.1, aRs = 10., bcirc = 0.3, gridmethod = ps.ADAPTIVE)
+  trn(time)
+  prof = trn.counters
+  assert prof['fluxpoint'] > 0 and prof['search'] > 0
+  assert prof['ellpic'] > 0 and prof['ellpicit'] >= prof['ellpic']
+  assert all(prof['time_' + stage] >= 0 for stage in ps.transit.STAGES)
+
+if __name__ == '__main__':
+  test_counters()
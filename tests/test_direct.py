@@ -0,0 +1,38 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+test_direct.py
+--------------
+
+'''
+
+import numpy as np
+import pysyzygy as ps
+from pysyzygy.transit import Transit
+
+def test_direct():
+  '''
+  Evaluating the model directly at the data points should agree with the grid
+  to within the grid's interpolation error, for both binning methods, without
+  computing the grid at all.
+
+  '''
+
+  time = np.linspace(-0.3,9.3,2000)
+  for kwargs in [dict(per = 3., RpRs = 0.1, aRs = 10., b = 0.3),
+                 dict(per = 3., RpRs = 0.1, aRs = 10., b = 0.3, binmethod = ps.TRAPEZOID),
+                 dict(per = 20., RpRs = 0.05, ecc = 0.5, w = 1., rhos = 1.)]:
+    grid = Transit(t0 = 0., **kwargs)
+    direct = Transit(t0 = 0., evalmethod = ps.DIRECT, **kwargs)
+    auto = Transit(t0 = 0., evalmethod = ps.AUTO, **kwargs)
+    assert np.abs(grid(time) - direct(time)).max() < 2.e-6
+    assert np.abs(grid(time, 'unbinned') - direct(time, 'unbinned')).max() < 5.e-5
+    assert np.abs(grid(time[::100]) - auto(time[::100])).max() < 2.e-6
+
+  for param in ['binned', 'unbinned']:
+    direct = Transit(t0 = 0., per = 3., RpRs = 0.1, aRs = 10., evalmethod = ps.DIRECT, maxpts = 100)
+    assert np.all(np.isfinite(direct(time, param)))
+    assert direct.arrays.computed == 0
+
+if __name__ == '__main__':
+  test_direct()
@@ -0,0 +1,46 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+test_dtype.py
+-------------
+
+'''
+
+import numpy as np
+import pysyzygy as ps
+from pysyzygy.transit import Transit
+
+def test_dtype():
+  '''
+  With a float32 output `dtype` the model should come back as float32, whether
+  it's called, streamed or computed in chunks, and agree with the float64
+  model to within the rounding of the flux. The gradients stay float64.
+
+  '''
+
+  time = np.linspace(-0.3, 0.3, 5000)
+  for kwargs in [dict(), dict(fluxmethod = ps.TABLE), dict(exptime = 0.1)]:
+    ref = Transit(per = 3., RpRs = 0.1, aRs = 10., u1 = 0.4, u2 = 0.2, **kwargs)
+    trn = Transit(per = 3., RpRs = 0.1, aRs = 10., u1 = 0.4, u2 = 0.2, dtype = 'float32', **kwargs)
+    for param in ['binned', 'unbinned']:
+      flux = trn(time, param)
+      assert flux.dtype == np.float32
+      assert np.allclose(flux, ref(time, param), rtol = 0, atol = 6.e-8)
+      assert np.array_equal(trn.Stream(time, param = param, chunk = 777), flux)
+      assert np.array_equal(np.concatenate(list(trn.Chunks(np.array_split(time, 3), param))), flux)
+
+  res, jac = trn(time, grad = True)
+  assert (res.dtype == np.float64) and (jac.dtype == np.float64)
+  try:
+    trn(time, out = np.empty(len(time)))
+    assert False
+  except ValueError:
+    pass
+  try:
+    Transit(dtype = 'int32')
+    assert False
+  except ValueError:
+    pass
+
+if __name__ == '__main__':
+  test_dtype()
@@ -0,0 +1,36 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+test_exposure.py
+----------------
+
+'''
+
+import numpy as np
+import pysyzygy as ps
+from pysyzygy.transit import Transit
+
+def test_exposure():
+  '''
+  Binning one model to a mix of exposure times and kernels should agree with
+  brute-force averages of the unbinned flux over each exposure.
+
+  '''
+
+  time = np.linspace(-0.15,0.15,151)
+  texp = np.array([20., 120., 600., 1800.])[np.arange(len(time)) % 4] / 86400.
+  kwargs = dict(per = 3., RpRs = 0.1, aRs = 10., b = 0.3)
+  ref = Transit(t0 = 0., exppts = 2000, maxpts = 2000000, **kwargs)
+  trn = Transit(t0 = 0., gridmethod = ps.ADAPTIVE, fluxtol = 1.e-8, **kwargs)
+  for kernel in [None, ps.TrapezoidKernel(0.2), ps.SmearKernel(0.1, 0.05)]:
+    kt, kv = ([-0.5, 0.5], [1., 1.]) if kernel is None else kernel
+    tau = np.linspace(kt[0], kt[-1], 4001)
+    weight = np.interp(tau, kt, kv)
+    brute = [np.trapz(weight * ref(t + dt * tau, 'unbinned'), tau) / np.trapz(weight, tau)
+             for t, dt in zip(time, texp)]
+    assert np.abs(trn(time, exptime = texp, kernel = kernel) - brute).max() < 2.e-7
+  assert np.allclose(trn(time, exptime = ps.KEPLONGEXP), trn(time), rtol = 0, atol = 1.e-12)
+  assert np.allclose(trn(time, exptime = 0.), trn(time, 'unbinned'), rtol = 0, atol = 1.e-12)
+
+if __name__ == '__main__':
+  test_exposure()
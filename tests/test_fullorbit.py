@@ -0,0 +1,43 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+test_fullorbit.py
+-----------------
+
+'''
+
+import numpy as np
+import pysyzygy as ps
+from pysyzygy.transit import Transit
+
+def test_fullorbit():
+  '''
+  The adaptive grid should follow the whole orbit to within `orbtol` in
+  full orbit mode, with a small fraction of the points of the uniform 
+  grid, and leave the light curve as it is on the transit-only grid. 
+  Planets that don't transit should have an orbit, too.
+
+  '''
+
+  time = np.random.RandomState(1).uniform(-300., 300., 5000)
+  for kwargs in [dict(per = 100., RpRs = 0.1, rhos = 1.4, bcirc = 0.3),
+                 dict(per = 100., RpRs = 0.1, rhos = 1.4, bcirc = 0.3, ecc = 0.6, w = 1.),
+                 dict(per = 100., RpRs = 0.1, rhos = 1.4, bcirc = 3., ecc = 0.3, w = 2.)]:
+    full = Transit(gridmethod = ps.ADAPTIVE, fullorbit = True, **kwargs)
+    unif = Transit(fullorbit = True, maxpts = 600000, **kwargs)
+    full.Compute()
+    unif.Compute()
+    assert full.arrays.nend - full.arrays.nstart < 0.05 * (unif.arrays.nend - unif.arrays.nstart)
+    assert full.arrays.time[0] == -50. and full.arrays.time[-1] == 50.
+    r = unif(time, 'r')
+    for arr in ['x', 'y', 'z', 'r']:
+      assert np.all(np.abs(full(time, arr) - unif(time, arr)) < full.settings.orbtol * r)
+    if kwargs['bcirc'] < 1.:
+      trn = Transit(gridmethod = ps.ADAPTIVE, **kwargs)
+      for param in ['unbinned', 'binned']:
+        assert np.allclose(full(time, param), trn(time, param), rtol = 0, atol = 2 * full.settings.fluxtol)
+    else:
+      assert np.all(full(time, 'binned') == 1.)
+
+if __name__ == '__main__':
+  test_fullorbit()
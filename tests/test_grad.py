@@ -0,0 +1,61 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+test_grad.py
+------------
+
+'''
+
+import numpy as np
+import pysyzygy as ps
+from pysyzygy.transit import Transit
+
+def test_grad():
+  '''
+  The analytic derivatives of the model should agree with finite differences
+  of the model evaluated directly, both on the grid points (where the two are
+  the same model) and, on the adaptive grid, for transit times with duration
+  and depth variations.
+
+  '''
+
+  dt = ps.KEPLONGEXP / 50
+  time = 0.05 + np.concatenate([np.arange(-140, 140) * dt, 6. + np.arange(-140, 140) * dt])
+  for kwargs in [dict(per = 3., RpRs = 0.1, aRs = 10., bcirc = 0.3, esw = 0.1, ecw = 0.2),
+                 dict(per = 3., RpRs = 0.1, rhos = 1., bcirc = 0., esw = 0., ecw = 0.),
+                 dict(per = 3., RpRs = 0.2, aRs = 10., bcirc = 0.8, esw = 1.e-10, ecw = 0.,
+                      binmethod = ps.TRAPEZOID)]:
+    kwargs.update(t0 = 0.05, u1 = 0.4, u2 = 0.26)
+    trn = Transit(**kwargs)
+    for param in ['binned', 'unbinned']:
+      model, jac = trn(time, param, grad = True)
+      assert np.allclose(model, trn(time, param), rtol = 0, atol = 1.e-12)
+      for k, name in enumerate(trn.gradparams):
+        h = 1.e-7 * max(abs(kwargs[name]), 0.1)
+        hi = Transit(evalmethod = ps.DIRECT, **dict(kwargs, **{name: kwargs[name] + h}))
+        lo = Transit(evalmethod = ps.DIRECT, **dict(kwargs, **{name: kwargs[name] - h}))
+        fd = (hi(time, param) - lo(time, param)) / (2 * h)
+        assert np.abs(jac[k] - fd).max() < 2.e-3 * np.abs(fd).max() + 2.e-5
+
+  tN = np.array([0.05, 3.06, 6.04])
+  time = np.concatenate([x + np.linspace(-0.1, 0.1, 51) for x in tN])[::-1]
+  kwargs = dict(per = 3., RpRs = 0.1, aRs = 10., bcirc = 0.3, esw = 0.1, ecw = 0.2, 
+                u1 = 0.4, u2 = 0.26, durscale = [1., 1.2, 0.9], depscale = [1., 0.8, 1.1])
+  trn = Transit(times = tN, gridmethod = ps.ADAPTIVE, fluxtol = 1.e-8, **kwargs)
+  model, jac = trn(time, grad = True)
+  assert np.allclose(model, trn(time), rtol = 0, atol = 1.e-12)
+  ref = dict(kwargs, evalmethod = ps.DIRECT, exppts = 1000, binmethod = ps.TRAPEZOID)
+  for k, name in enumerate(trn.gradparams):
+    if name == 't0':
+      h = 1.e-6
+      hi = Transit(times = tN + h, **ref)
+      lo = Transit(times = tN - h, **ref)
+    else:
+      h = 1.e-6 * max(abs(kwargs[name]), 0.1)
+      hi = Transit(times = tN, **dict(ref, **{name: kwargs[name] + h}))
+      lo = Transit(times = tN, **dict(ref, **{name: kwargs[name] - h}))
+    fd = (hi(time) - lo(time)) / (2 * h)
+    assert np.abs(jac[k] - fd).max() < 2.e-4 * np.abs(fd).max()
+
+if __name__ == '__main__':
+  test_grad()
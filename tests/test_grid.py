@@ -0,0 +1,34 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+test_grid.py
+------------
+
+'''
+
+import numpy as np
+import pysyzygy as ps
+from pysyzygy.transit import Transit
+
+def test_grid():
+  '''
+  The uniform grid is implicit, so interpolating onto unsorted times should give
+  the same result as onto sorted ones, with either interpolation method.
+
+  '''
+
+  time = np.linspace(-0.3,9.3,5000)
+  perm = np.random.RandomState(42).permutation(len(time))
+  for kwargs in [dict(per = 3., RpRs = 0.1, aRs = 10., b = 0.3),
+                 dict(per = 20., RpRs = 0.05, ecc = 0.5, w = 1., rhos = 1., fullorbit = True, maxpts = 100000)]:
+    trn = Transit(t0 = 0., **kwargs)
+    slow = Transit(t0 = 0., intmethod = ps.SLOWINT, **kwargs)
+    for param in ['binned', 'unbinned', 'b']:
+      ref = trn(time, param)
+      assert np.array_equal(trn(time[perm], param), ref[perm], equal_nan = True)
+      assert np.array_equal(slow(time, param), ref, equal_nan = True)
+    assert trn.arrays.dt == trn.settings.exptime / trn.settings.exppts
+    assert np.allclose(np.diff(trn.arrays.time), trn.arrays.dt, rtol = 1.e-10, atol = 0)
+
+if __name__ == '__main__':
+  test_grid()
@@ -0,0 +1,44 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+test_kepler.py
+--------------
+
+'''
+
+import numpy as np
+import pysyzygy as ps
+from pysyzygy.transit import Transit
+
+def test_kepler():
+  '''
+  The batch Kepler solver should satisfy Kepler's equation to within `keptol`
+  in about one Halley step per chunk, at any eccentricity, and give the same
+  models as the scalar solver.
+
+  '''
+
+  M = np.linspace(-10., 10., 10001)
+  for ecc in [0., 0.1, 0.5, 0.9, 0.99, 0.999]:
+    E, stats = ps.EccentricAnomaly(M, ecc, keptol = 1.e-15)
+    Mr = M - 2 * np.pi * np.round(M / (2 * np.pi))
+    Er = E - (M - Mr)
+    assert np.abs(Er - ecc * np.sin(Er) - Mr).max() < 1.e-15 * (1. + 10 * ecc)
+    assert stats.solves == len(M)
+    assert stats.iter <= 2 * stats.blocks
+
+  time = np.linspace(-0.3,9.3,2000)
+  for kwargs in [dict(per = 20., RpRs = 0.05, ecc = 0.5, w = 1., rhos = 1.),
+                 dict(per = 20., RpRs = 0.05, ecc = 0.9, w = 1., rhos = 0.3, evalmethod = ps.DIRECT),
+                 dict(per = 5., RpRs = 0.1, ecc = 0.8, w = 2., aRs = 10., fullorbit = True, maxpts = 100000),
+                 dict(per = 20., RpRs = 0.05, ecc = 0.3, w = np.pi / 2, rhos = 1., symtol = 1.e-8)]:
+    newton = Transit(t0 = 0., **kwargs)
+    halley = Transit(t0 = 0., kepsolver = ps.HALLEY, **kwargs)
+    for param in ['binned', 'unbinned', 'E', 'b', 'z']:
+      assert np.allclose(halley(time, param), newton(time, param), rtol = 0, atol = 1.e-12,
+                         equal_nan = True)
+    assert halley.arrays.kep.solves > 0
+    assert halley.arrays.kep.fallback == 0
+
+if __name__ == '__main__':
+  test_kepler()
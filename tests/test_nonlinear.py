@@ -0,0 +1,69 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+test_nonlinear.py
+-----------------
+
+'''
+
+import numpy as np
+import pysyzygy as ps
+from pysyzygy.transit import Transit
+
+X, W = np.polynomial.legendre.leggauss(500)
+
+def Occulted(b, p, c):
+  '''
+  The flux of a star with nonlinear limb darkening occulted by a planet at
+  impact parameter `b`, by brute force quadrature over rings
+
+  '''
+
+  I = lambda r: 1. - sum(c[n] * (1. - (1. - r ** 2) ** ((n + 1) / 4.)) for n in range(4))
+  def Rings(r0, r1, kap):
+    r = r0 + 0.5 * (r1 - r0) * (1. - np.cos(0.5 * np.pi * (X + 1.)))
+    dr = 0.25 * np.pi * (r1 - r0) * np.sin(0.5 * np.pi * (X + 1.))
+    return np.sum(W * kap(r) * I(r) * r * dr)
+  total = Rings(0., 1., lambda r: np.pi)
+  if b >= 1. + p:
+    return 1.
+  occ = Rings(abs(b - p), min(b + p, 1.), lambda r: 
+              np.arccos(np.clip((r ** 2 + b ** 2 - p ** 2) / (2 * r * b), -1., 1.)))
+  if b < p:
+    occ += Rings(0., p - b, lambda r: np.pi)
+  return 1. - occ / total
+
+def test_nonlinear():
+  '''
+  The nonlinear limb darkening law should agree with a brute force
+  integration over the stellar disk, both from the lookup table and
+  outside its range of radius ratios, and reduce to the quadratic law
+  when the half-integer coefficients vanish.
+
+  '''
+
+  c = dict(c1 = 0.6, c2 = -0.3, c3 = 0.5, c4 = -0.2)
+  time = np.linspace(-0.12, 0.12, 41)
+  for RpRs in [0.1, 0.7]:
+    kwargs = dict(per = 3., RpRs = RpRs, aRs = 10., bcirc = 0.4, **c)
+    trn = Transit(evalmethod = ps.DIRECT, **kwargs)
+    ref = np.array([Occulted(x, RpRs, list(c.values())) for x in trn(time, 'b')])
+    assert np.allclose(trn(time, 'unbinned'), ref, rtol = 0, atol = 1.e-6)
+    trn = Transit(evalmethod = ps.GRID, **kwargs)
+    trn.Compute()
+    b, flux = trn.arrays.b[::25], trn.arrays.flux[::25]
+    ref = np.array([Occulted(x, RpRs, list(c.values())) for x in b])
+    assert np.allclose(flux, ref, rtol = 0, atol = 1.e-6)
+
+  kwargs = dict(per = 3., RpRs = 0.1, aRs = 10., bcirc = 0.4)
+  quad = Transit(u1 = c['c2'] + 2 * c['c4'], u2 = -c['c4'], **kwargs)
+  nonl = Transit(c1 = 0., c2 = c['c2'], c3 = 0., c4 = c['c4'], **kwargs)
+  assert np.array_equal(quad(time), nonl(time))
+  try:
+    nonl(time, grad = True)
+    assert False
+  except Exception:
+    pass
+
+if __name__ == '__main__':
+  test_nonlinear()
@@ -0,0 +1,28 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+test_outputs.py
+---------------
+
+'''
+
+import numpy as np
+from pysyzygy.transit import Transit
+
+def test_outputs():
+  '''
+  Storing only the binned flux should give exactly the same light curve, and
+  any array that wasn't stored should be computed on demand when requested.
+
+  '''
+
+  time = np.linspace(-0.6,0.6,3000)
+  for kwargs in [dict(per = 3., RpRs = 0.1, aRs = 10., b = 0.3),
+                 dict(per = 20., RpRs = 0.05, ecc = 0.5, w = 1., rhos = 1.)]:
+    full = Transit(t0 = 0., **kwargs)
+    lean = Transit(t0 = 0., outputs = ['binned'], **kwargs)
+    for param in ['binned', 'unbinned', 'b', 'x', 'y', 'z', 'M', 'r']:
+      assert np.array_equal(full(time, param), lean(time, param), equal_nan = True)
+
+if __name__ == '__main__':
+  test_outputs()
@@ -0,0 +1,47 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+test_recompose.py
+-----------------
+
+'''
+
+import numpy as np
+import pysyzygy as ps
+from pysyzygy.transit import Transit
+
+def test_recompose():
+  '''
+  Updating only the limb darkening should recompose the model from the
+  occultation functions on the uniform grid, without recomputing it, and
+  give exactly the model computed from scratch; where it can't, it should
+  be recomputed.
+
+  '''
+
+  time = np.arange(-1., 10., ps.KEPLONGCAD / 3)
+  lds = [dict(u1 = 0.4, u2 = 0.26), dict(u1 = 0.1, u2 = 0.5), dict(q1 = 0.3, q2 = 0.6)]
+  nonlinear = [dict(c1 = 0.53, c2 = -0.25, c3 = 0.84, c4 = -0.37), 
+               dict(c1 = 0.4, c2 = 0.1, c3 = 0.2, c4 = -0.1)]
+  for kwargs, ldlist, same in [(dict(), lds, True),
+                               (dict(esw = 0.1, ecw = 0.2), lds, True),
+                               (dict(fullorbit = True, maxpts = 20000), lds, True),
+                               (dict(fluxmethod = ps.TABLE, binmethod = ps.TRAPEZOID), lds, True),
+                               (dict(), nonlinear, True),
+                               (dict(), lds[:1] + nonlinear[:1], False),
+                               (dict(esw = 0.1, ecw = 0.2, symtol = 1.e-6), lds, False),
+                               (dict(gridmethod = ps.ADAPTIVE), lds, False)]:
+    kwargs.update(per = 3., RpRs = 0.1, aRs = 10., bcirc = 0.3, t0 = 0.5)
+    for param in ['binned', 'unbinned']:
+      trn = Transit(**dict(kwargs, **ldlist[0]))
+      trn(time, param)
+      for ld in ldlist[1:]:
+        arrays = trn.arrays
+        trn.update(**dict(kwargs, **ld))
+        assert (trn.arrays is arrays) and (bool(trn.arrays.computed) == same)
+        ref = Transit(cachesize = 0, **dict(kwargs, **ld))
+        assert np.array_equal(trn(time, param), ref(time, param))
+        assert np.array_equal(trn.arrays.flux, ref.arrays.flux)
+
+if __name__ == '__main__':
+  test_recompose()
@@ -0,0 +1,63 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+test_stream.py
+--------------
+
+'''
+
+import os
+import shutil
+import tempfile
+import tracemalloc
+import numpy as np
+import pysyzygy as ps
+from pysyzygy.transit import Transit
+
+def test_stream():
+  '''
+  Streaming a time series through the model in chunks, from memory or from
+  memory-mapped files, should give the model evaluated in one go (to rounding),
+  in memory that doesn't grow with the length of the series.
+
+  '''
+
+  time = np.arange(0., 40., ps.KEPSHRTCAD)
+  path = tempfile.mkdtemp()
+  try:
+    np.save(os.path.join(path, 'time.npy'), time)
+    time.tofile(os.path.join(path, 'time.bin'))
+    for kwargs in [dict(per = 3., RpRs = 0.1, bcirc = 0.3, t0 = 0.5, esw = 0.1, ecw = 0.05),
+                   dict(per = 3., RpRs = 0.1, bcirc = 0.3, times = [1., 4.02, 7., 9.97, 13.1],
+                        durscale = [1., 1.1, 0.9, 1., 1.2]),
+                   dict(per = 3., RpRs = 0.1, bcirc = 0.3, t0 = 0.5, gridmethod = ps.ADAPTIVE),
+                   dict(per = 3., RpRs = 0.1, bcirc = 0.3, t0 = 0.5, evalmethod = ps.DIRECT)]:
+      trn = Transit(**kwargs)
+      for param in ['binned', 'unbinned']:
+        ref = trn(time, param)
+        assert np.allclose(trn.Stream(time, param = param, chunk = 1000), ref, rtol = 0, atol = 1.e-14)
+        res = trn.Stream(os.path.join(path, 'time.npy'), out = os.path.join(path, 'flux.npy'), 
+                         param = param)
+        assert np.allclose(np.load(os.path.join(path, 'flux.npy')), ref, rtol = 0, atol = 1.e-14)
+        del res
+        trn.Stream(os.path.join(path, 'time.bin'), out = os.path.join(path, 'flux.bin'), 
+                   param = param, chunk = 777)
+        assert np.allclose(np.fromfile(os.path.join(path, 'flux.bin')), ref, rtol = 0, atol = 1.e-14)
+        buf = np.empty(500)
+        chunks = (time[i:i + 500] for i in range(0, len(time), 500))
+        res = np.concatenate([f.copy() for f in trn.Chunks(((t, buf[:len(t)]) for t in chunks), param)])
+        assert np.allclose(res, ref, rtol = 0, atol = 1.e-14)
+
+    np.arange(0., 400., ps.KEPSHRTCAD).tofile(os.path.join(path, 'time.bin'))
+    trn = Transit(per = 3., RpRs = 0.1, bcirc = 0.3, t0 = 0.5)
+    trn.Stream(time[:10])
+    tracemalloc.start()
+    trn.Stream(os.path.join(path, 'time.bin'), out = os.path.join(path, 'flux.bin'))
+    peak = tracemalloc.get_traced_memory()[1]
+    tracemalloc.stop()
+    assert peak < 8 * ps.STREAM_CHUNK
+  finally:
+    shutil.rmtree(path)
+
+if __name__ == '__main__':
+  test_stream()
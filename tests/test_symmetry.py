@@ -0,0 +1,39 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+test_symmetry.py
+----------------
+
+'''
+
+import numpy as np
+import pysyzygy as ps
+from pysyzygy.transit import Transit
+
+def test_symmetry():
+  '''
+  Mirroring the first half of a symmetric light curve should give the same
+  arrays as computing the whole thing, and eccentric orbits should only be
+  mirrored when they're symmetric to within `symtol`.
+
+  '''
+
+  time = np.linspace(-0.4,0.4,2000)
+  for kwargs in [dict(per = 3., RpRs = 0.1, aRs = 10., b = 0.3),
+                 dict(per = 3., RpRs = 0.1, aRs = 10., b = 0.3, binmethod = ps.TRAPEZOID),
+                 dict(per = 3., RpRs = 0.1, aRs = 10., b = 0.3, gridmethod = ps.ADAPTIVE),
+                 dict(per = 3., RpRs = 0.1, aRs = 10., b = 0.3, fullorbit = True, maxpts = 100000),
+                 dict(per = 20., RpRs = 0.05, ecc = 0.3, w = np.pi / 2, rhos = 1., symtol = 1.e-8)]:
+    sym = Transit(t0 = 0., **kwargs)
+    full = Transit(t0 = 0., **dict(kwargs, symtol = -1.))
+    for param in ['binned', 'unbinned', 'b', 'x', 'y', 'z', 'M', 'r']:
+      assert np.allclose(sym(time, param), full(time, param), rtol = 0, atol = 1.e-12,
+                         equal_nan = True)
+    assert sym.arrays.nsym > 0
+
+  trn = Transit(t0 = 0., per = 20., RpRs = 0.05, ecc = 0.5, w = 1., rhos = 1., symtol = 1.e-6)
+  trn(time)
+  assert trn.arrays.nsym == 0
+
+if __name__ == '__main__':
+  test_symmetry()
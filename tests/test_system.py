@@ -0,0 +1,64 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+test_system.py
+--------------
+
+'''
+
+import ctypes
+import numpy as np
+import pysyzygy as ps
+from pysyzygy.transit import Transit, System
+
+def test_system():
+  '''
+  The light curve of a planetary system should be the sum of the flux
+  deficits of its planets, whether or not the times are sorted, and only the
+  planets whose parameters change should be recomputed. A parameter given a
+  different way in an update (e.g., `aRs` instead of `rhos`) replaces it.
+
+  '''
+
+  planets = [dict(per = 3., RpRs = 0.1, bcirc = 0.3, t0 = 0.5),
+             dict(per = 7.2, RpRs = 0.05, esw = 0.1, ecw = 0.05, t0 = 2.1),
+             dict(per = 13., RpRs = 0.03, times = [1., 14.02, 27., 39.97],
+                  durscale = [1., 1.1, 0.9, 1.])]
+  time = np.arange(0., 60., ps.KEPLONGCAD)
+  shuffled = np.random.RandomState(42).permutation(time)
+  for kwargs in [dict(), dict(gridmethod = ps.ADAPTIVE), dict(exptime = 0.1)]:
+    sys = System(planets, rhos = 1.2, u1 = 0.5, **kwargs)
+    trn = [Transit(rhos = 1.2, u1 = 0.5, **dict(p, **kwargs)) for p in planets]
+    for param in ['binned', 'unbinned']:
+      for t in [time, shuffled]:
+        ref = 1. - sum(1. - x(t, param) for x in trn)
+        assert np.allclose(sys(t, param), ref, rtol = 0, atol = 1.e-14)
+
+  for k in range(len(planets)):
+    assert sys.arrays[k].computed == 1
+  arena = [ctypes.cast(sys.arrays[k]._arena, ctypes.c_void_p).value for k in range(len(planets))]
+  changed = planets[:1] + [dict(planets[1], RpRs = 0.06)] + planets[2:]
+  sys.update(planets = changed)                                                  # Only the planet that changed is recomputed
+  assert [sys.arrays[k].computed for k in range(len(planets))] == [1, 0, 1]
+  sys(time)
+  assert [ctypes.cast(sys.arrays[k]._arena, ctypes.c_void_p).value for k in range(len(planets))] == arena
+  sys.update(planets = [dict(changed[0], t0 = 1.)] + changed[1:2])                # Shifting the transits doesn't change the grid,
+  assert [sys.arrays[k].computed for k in range(2)] == [1, 1]                     # and the workspaces are kept
+  assert [ctypes.cast(sys.arrays[k]._arena, ctypes.c_void_p).value for k in range(2)] == arena[:2]
+  sys.update(planets = planets)
+
+  sys.update(u1 = 0.3)
+  ref = 1. - sum(1. - Transit(rhos = 1.2, u1 = 0.3, exptime = 0.1, **p)(time) for p in planets)
+  assert np.allclose(sys(time), ref, rtol = 0, atol = 1.e-14)
+  sys.update(planets = planets[:1])
+  assert np.allclose(sys(time), Transit(rhos = 1.2, u1 = 0.3, exptime = 0.1, **planets[0])(time), 
+                     rtol = 0, atol = 1.e-14)
+  sys.update(aRs = 12., q1 = 0.3, q2 = 0.4)                                             # These replace `rhos`, `u1` and `u2`
+  assert np.allclose(sys(time), Transit(aRs = 12., q1 = 0.3, q2 = 0.4, exptime = 0.1, **planets[0])(time), 
+                     rtol = 0, atol = 1.e-14)
+  sys.update(rhos = 1.2, u1 = 0.9, u2 = 0.)
+  assert np.allclose(sys(time), Transit(rhos = 1.2, u1 = 0.9, u2 = 0., exptime = 0.1, **planets[0])(time), 
+                     rtol = 0, atol = 1.e-14)
+
+if __name__ == '__main__':
+  test_system()
@@ -0,0 +1,45 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+test_table.py
+-------------
+
+'''
+
+import os
+import tempfile
+import numpy as np
+import pysyzygy as ps
+from pysyzygy.transit import Transit
+
+def test_table():
+  '''
+  Interpolating the occultation functions from the lookup table should agree
+  with computing them exactly to within the table's error estimate, and saving
+  and loading the table shouldn't change anything.
+
+  '''
+
+  assert ps.FluxTableError(0.40, 0.26) < 1.e-6
+  time = np.linspace(-0.3,0.3,1000)
+  for kwargs in [dict(per = 3., RpRs = 0.1, aRs = 10., b = 0.3),
+                 dict(per = 3., RpRs = 0.1, aRs = 10., b = 0.9, exppts = 4),
+                 dict(per = 20., RpRs = 0.05, ecc = 0.5, w = 1., rhos = 1.),
+                 dict(per = 5., RpRs = 0.45, aRs = 12., b = 0.7, u1 = 0.8, u2 = -0.1),
+                 dict(per = 3., RpRs = 0.7, aRs = 10., b = 0.3)]:
+    exact = Transit(t0 = 0., **kwargs)
+    table = Transit(t0 = 0., fluxmethod = ps.TABLE, **kwargs)
+    tol = ps.FluxTableError(table.limbdark.u1, table.limbdark.u2)
+    for param in ['binned', 'unbinned']:
+      assert np.abs(table(time, param) - exact(time, param)).max() <= tol
+
+  kwargs = dict(t0 = 0., per = 3., RpRs = 0.1, aRs = 10., b = 0.3, fluxmethod = ps.TABLE)
+  before = Transit(**kwargs)(time)
+  path = os.path.join(tempfile.mkdtemp(), 'table.bin')
+  ps.SaveFluxTable(path)
+  ps.LoadFluxTable(path)
+  assert np.array_equal(Transit(**kwargs)(time), before)
+  os.remove(path)
+
+if __name__ == '__main__':
+  test_table()
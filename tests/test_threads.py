@@ -0,0 +1,55 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+test_threads.py
+---------------
+
+'''
+
+import numpy as np
+import threading
+from pysyzygy.transit import TRANSIT, LIMBDARK, SETTINGS, ARRAYS, \
+                             _InterpolateR, _FreeArrays, _ARR_BFLX, _ARR_B
+
+def test_threads():
+  '''
+  Many threads hammering on the reentrant API with a single, shared set of
+  parameters. Every thread must get the same answer as a serial run, and the
+  parameters must never be modified.
+  
+  '''
+  
+  time = np.linspace(-0.5,0.5,1000)
+  transit = TRANSIT(per = 5., RpRs = 0.1, ecc = 0.3, w = 0.5, b = 0.3)
+  limbdark = LIMBDARK()
+  settings = SETTINGS(maxpts = 20000)
+  before = bytes(bytearray(transit))
+  
+  truth = {}
+  for array in [_ARR_BFLX, _ARR_B]:
+    arrays = ARRAYS()
+    truth[array] = np.empty_like(time)
+    assert _InterpolateR(time, len(time), array, transit, limbdark, settings, 
+                         arrays, truth[array]) == 0
+    _FreeArrays(arrays)
+
+  failures = []
+  def run():
+    for n in range(20):
+      array = [_ARR_BFLX, _ARR_B][n % 2]
+      arrays = ARRAYS()
+      res = np.empty_like(time)
+      err = _InterpolateR(time, len(time), array, transit, limbdark, settings, 
+                          arrays, res)
+      _FreeArrays(arrays)
+      if (err != 0) or (not np.array_equal(res, truth[array], equal_nan = True)):
+        failures.append(err)
+  
+  threads = [threading.Thread(target = run) for i in range(16)]
+  for thread in threads:
+    thread.start()
+  for thread in threads:
+    thread.join()
+  
+  assert len(failures) == 0
+  assert bytes(bytearray(transit)) == before
@@ -0,0 +1,51 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+test_ttv.py
+-----------
+
+'''
+
+import numpy as np
+import pysyzygy as ps
+from pysyzygy.transit import Transit
+
+def test_ttv():
+  '''
+  With thousands of transit times, each point should be folded onto its nearest
+  transit whether or not the times are sorted, and the per-transit durations and
+  depths should stretch and scale the model of each transit.
+
+  '''
+
+  rand = np.random.RandomState(42)
+  kwargs = dict(per = 3., RpRs = 0.1, aRs = 10., b = 0.3)
+  epochs = 3. * np.arange(3000) + 0.01 * rand.randn(3000)
+  durscale = 1. + 0.05 * rand.randn(3000)
+  depscale = 1. + 0.1 * rand.randn(3000)
+  time = np.sort(rand.uniform(-1., 9000., 20000))
+  perm = rand.permutation(len(time))
+  
+  trn = Transit(times = epochs[::-1], durscale = durscale[::-1], depscale = depscale[::-1], **kwargs)
+  ref = Transit(t0 = 0., **kwargs)
+  k = np.argmin(np.abs(time[:, None] - epochs[None, ::50]), axis = 1) * 50            # Nearest of a subset, to check
+  near = np.abs(time - epochs[k]) < 1.
+  time, k = time[near], k[near]
+  for param in ['unbinned', 'binned']:
+    model = trn(time, param)
+    assert np.array_equal(trn(time[::-1], param), model[::-1])
+    dt = (time - epochs[k]) / durscale[k]
+    if param == 'binned':
+      expected = ref(dt, exptime = ref.settings.exptime / durscale[k])
+    else:
+      expected = ref(dt, 'unbinned')
+    assert np.allclose(model, 1. - depscale[k] * (1. - expected), rtol = 0, atol = 1.e-12)
+  
+  direct = Transit(times = epochs, durscale = durscale, depscale = depscale, evalmethod = ps.DIRECT, **kwargs)
+  assert np.abs(direct(time, 'unbinned') - trn(time, 'unbinned')).max() < 5.e-5
+  
+  time = rand.uniform(-1., 9000., 5000)
+  assert np.array_equal(trn(time), trn(np.sort(time))[np.argsort(np.argsort(time))])
+
+if __name__ == '__main__':
+  test_ttv()
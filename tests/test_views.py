@@ -0,0 +1,60 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+test_views.py
+-------------
+
+'''
+
+import gc
+import numpy as np
+import pysyzygy as ps
+from pysyzygy.transit import Transit
+
+def test_views():
+  '''
+  The arrays on the model grid should be read-only views of the C arrays
+  that outlive the model and its workspace, and the model should be written into the
+  caller's buffers in place.
+
+  '''
+
+  time = np.linspace(-0.2, 0.2, 1000)
+  trn = Transit(per = 3., RpRs = 0.1, aRs = 10., esw = 0.1, ecw = 0.2)
+  model = trn(time)
+  flux = trn.arrays.flux
+  assert not flux.flags.writeable
+  assert len(flux) == len(trn.arrays.M) == trn.arrays.nend - trn.arrays.nstart
+  assert np.allclose(np.interp(time, trn.arrays.time, flux), trn(time, 'unbinned'), rtol = 0, atol = 1.e-12)
+  copy = flux.copy()
+  del trn
+  gc.collect()
+  assert np.array_equal(flux, copy)
+  
+  trn = Transit(per = 3., RpRs = 0.1, aRs = 10., cachesize = 1)
+  trn(time, grad = True)
+  flux, grad, M = trn.arrays.flux, trn.arrays.grad, trn.arrays.M
+  copies = [x.copy() for x in [flux, grad, M]]
+  trn.update(per = 3., RpRs = 0.1, aRs = 10., maxpts = 4 * trn.settings.maxpts)  # The workspace is regrown...
+  trn(time, grad = True)
+  trn.Free()                                                                     # ...and freed, but the views are still good
+  gc.collect()
+  junk = [np.ones(len(x)) for x in copies for _ in range(100)]
+  assert all(np.array_equal(x, c) for x, c in zip([flux, grad, M], copies))
+
+  trn = Transit(per = 3., RpRs = 0.1, aRs = 10., esw = 0.1, ecw = 0.2)
+  out = np.empty_like(time)
+  jac = np.empty((len(trn.gradparams), len(time)))
+  assert trn(time, out = out) is out
+  assert np.array_equal(out, model)
+  res, grad = trn(time, grad = True, out = out, jac = jac)
+  assert (res is out) and (grad is jac)
+  assert trn.arrays.grad.shape == (len(trn.gradparams), len(trn.arrays.flux))
+  try:
+    trn(time, out = np.empty(len(time), dtype = 'float32'))
+    assert False
+  except ValueError:
+    pass
+
+if __name__ == '__main__':
+  test_views()
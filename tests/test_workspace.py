@@ -0,0 +1,40 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+test_workspace.py
+-----------------
+
+'''
+
+import numpy as np
+import ctypes
+from pysyzygy.transit import Transit
+
+def test_workspace():
+  '''
+  The workspace arena should be allocated once and reused across update/compute
+  cycles once the model cache is full, the results should match a fresh instance,
+  and `Free()` should be safe to call more than once.
+
+  '''
+
+  time = np.linspace(-0.5,0.5,1000)
+  trn = Transit(cachesize = 1, per = 5., RpRs = 0.1, t0 = 0., aRs = 12., maxpts = 20000)
+  trn(time)
+  arena = ctypes.cast(trn.arrays._arena, ctypes.c_void_p).value
+  assert trn.arrays._nalloc == 20000
+
+  for RpRs in [0.05, 0.1, 0.15]:
+    trn.update(per = 5., RpRs = RpRs, t0 = 0., aRs = 12., maxpts = 20000)
+    flux = trn(time)
+    assert ctypes.cast(trn.arrays._arena, ctypes.c_void_p).value == arena
+    assert np.array_equal(flux, Transit(per = 5., RpRs = RpRs, t0 = 0., aRs = 12.,
+                                        maxpts = 20000)(time))
+
+  trn.Free()
+  trn.Free()
+  assert trn.arrays._nalloc == 0
+  assert np.array_equal(trn(time), flux)
+
+if __name__ == '__main__':
+  test_workspace()